@@ -0,0 +1,92 @@
+#ifndef BATCH_RENAMER_H
+#define BATCH_RENAMER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "FileOperations.h"
+
+// Applies a list of renames within one filesystem as a unit: either every
+// entry ends up at its new name or, after the first failure, everything
+// already done is renamed back.
+//
+// The whole plan is checked before anything moves: sources must exist,
+// destinations must be free or vacated by another entry of the plan, no two
+// entries may land on the same name, and nothing may move into or out of a
+// directory the plan also moves. Chains (a to b while b moves on to c) are
+// ordered so each destination is free when its turn comes, and cycles (a and
+// b swapping names) are resolved with RENAME_EXCHANGE. Every rename uses
+// RENAME_NOREPLACE relative to a cached parent directory descriptor, so
+// nothing is ever overwritten and each call resolves a single component.
+//
+// With a log path, the steps are written to disk before the first rename and
+// each completed step is marked and synced before the next one, so undo() can
+// put the tree back after a crash; the log is deleted once the batch
+// completes or is rolled back.
+class BatchRenamer {
+private:
+    enum class StepKind : char { Rename = 'R', Exchange = 'X' };
+
+    // Names as canonical parent directory + final component
+    struct Entry {
+        std::string from_dir;
+        std::string from_name;
+        std::string to_dir;
+        std::string to_name;
+    };
+
+    struct Step {
+        StepKind kind;
+        size_t entry;  // for an exchange, the names of both entries' sources
+        size_t other;
+    };
+
+    // Parent directories held open at once; beyond this the cache is emptied.
+    // Reopening by path is safe because the plan never moves a parent.
+    static constexpr size_t MAX_OPEN_DIRECTORIES = 256;
+
+    std::vector<Entry> entries;
+    std::vector<Step> steps;
+    std::unordered_map<std::string, std::string> canonical_dirs;
+    std::unordered_map<std::string, int> dir_fds;
+    size_t renamed;
+    size_t exchanged;
+    size_t skipped;
+
+    bool splitPath(const std::string& path, std::string& dir, std::string& name, std::vector<OperationResult>& errors);
+    int dirFd(const std::string& dir);
+    void closeDirs();
+    void orderSteps(const std::vector<size_t>& next);
+    int applyStep(const Step& step, bool reverse);
+    bool writeLog(int fd);
+
+public:
+    BatchRenamer();
+    ~BatchRenamer();
+
+    BatchRenamer(const BatchRenamer&) = delete;
+    BatchRenamer& operator=(const BatchRenamer&) = delete;
+
+    // Checks the whole plan and orders it; false with every problem found
+    // appended to errors, in which case nothing may be executed
+    bool plan(const std::vector<std::pair<std::string, std::string>>& pairs, std::vector<OperationResult>& errors);
+
+    // Runs a checked plan. On the first failure the steps already done are
+    // undone in reverse; errors gets the failure and any step that could not
+    // be undone (the log, if any, is then kept).
+    bool execute(std::vector<OperationResult>& errors, const std::string& log_path = "");
+
+    // Reverses the completed steps recorded in a log left by an interrupted
+    // execute(), then deletes it; undone receives the number of steps undone.
+    // If the step in flight at the crash cannot be placed as done or not, no
+    // step is undone and the log is kept.
+    static bool undo(const std::string& log_path, std::vector<OperationResult>& errors, size_t& undone);
+
+    // Of the last plan: entries moved by rename, entries moved by exchange,
+    // and entries that already had their new name
+    size_t renamedCount() const;
+    size_t exchangedCount() const;
+    size_t skippedCount() const;
+};
+
+#endif // BATCH_RENAMER_H
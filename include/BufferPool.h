@@ -0,0 +1,77 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include <sys/types.h>
+
+// Page-aligned I/O buffers kept for reuse. Sizes are rounded up to a power of
+// two between MIN_SIZE and MAX_SIZE and each size keeps a free list, so copy
+// and hash loops get warm memory instead of a fresh allocation per file, and
+// every buffer is aligned well enough for O_DIRECT.
+class BufferPool {
+public:
+    static constexpr size_t ALIGNMENT = 4096;
+    static constexpr size_t MIN_SIZE = 64 * 1024;
+    static constexpr size_t MAX_SIZE = 8 * 1024 * 1024;
+    // Free buffers beyond this total are handed back to the allocator
+    static constexpr size_t MAX_RETAINED = 64 * 1024 * 1024;
+
+    // Move-only handle; the memory goes back to the pool when it is destroyed
+    class Buffer {
+    private:
+        BufferPool* pool;
+        char* memory;
+        size_t capacity;
+
+    public:
+        Buffer() : pool(nullptr), memory(nullptr), capacity(0) {}
+        Buffer(BufferPool* owner, char* data, size_t size) : pool(owner), memory(data), capacity(size) {}
+        Buffer(Buffer&& other) noexcept;
+        Buffer& operator=(Buffer&& other) noexcept;
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+        ~Buffer();
+
+        char* data() const { return memory; }
+        size_t size() const { return capacity; }
+        explicit operator bool() const { return memory != nullptr; }
+        void reset();
+    };
+
+private:
+    static constexpr size_t SIZE_CLASSES = 8;  // MIN_SIZE << 0 ... MIN_SIZE << 7
+    // adaptiveSize() caps; copies measured no faster beyond them
+    static constexpr size_t CACHED_MAX = 1024 * 1024;
+    static constexpr size_t DIRECT_MAX = 4 * 1024 * 1024;
+
+    std::mutex mutex;
+    std::vector<char*> free_lists[SIZE_CLASSES];
+    size_t retained_bytes;
+
+    void release(char* memory, size_t size);
+
+public:
+    BufferPool();
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // One pool per process, shared by all threads
+    static BufferPool& shared();
+
+    // A buffer of at least size bytes (at most MAX_SIZE); empty if memory ran out
+    Buffer acquire(size_t size);
+
+    // Buffer size for streaming a file of file_size bytes, never below the
+    // device's preferred I/O size (st_blksize). Through the page cache it
+    // stays small enough to remain in CPU cache; with O_DIRECT every call is
+    // a device request, so it may grow larger.
+    static size_t adaptiveSize(size_t file_size, blksize_t io_size, bool direct = false);
+
+    size_t retainedBytes();
+};
+
+#endif // BUFFER_POOL_H
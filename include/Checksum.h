@@ -0,0 +1,62 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Streaming XXH64 (non-cryptographic, several GB/s per core). Produces the
+// same values as the reference xxHash implementation for the same seed.
+class XXHash64 {
+private:
+    uint64_t lanes[4];
+    unsigned char pending[32];
+    size_t pending_size;
+    uint64_t total_size;
+    uint64_t seed;
+
+public:
+    explicit XXHash64(uint64_t seed = 0);
+
+    void reset();
+    void update(const void* data, size_t length);
+    uint64_t digest() const;
+
+    static uint64_t hash(const void* data, size_t length, uint64_t seed = 0);
+};
+
+// Streaming SHA-256 (FIPS 180-4), for digests that must also hold up
+// against deliberately crafted collisions. Uses the x86 SHA extensions when
+// the CPU has them; still several times slower than XXH64.
+class Sha256 {
+public:
+    static constexpr size_t DIGEST_SIZE = 32;
+
+private:
+    uint32_t state[8];
+    unsigned char pending[64];
+    size_t pending_size;
+    uint64_t total_size;
+
+    void compress(const unsigned char* blocks, size_t count);
+
+public:
+    Sha256();
+
+    void reset();
+    void update(const void* data, size_t length);
+    void digest(unsigned char out[DIGEST_SIZE]) const;
+};
+
+enum class ChecksumAlgorithm {
+    XXH64,
+    SHA256
+};
+
+const char* checksumAlgorithmName(ChecksumAlgorithm algorithm);
+
+// Lower-case, zero-padded hexadecimal form of a 64-bit digest
+std::string digestToHex(uint64_t digest);
+std::string digestToHex(const unsigned char* digest, size_t length);
+
+#endif // CHECKSUM_H
@@ -0,0 +1,146 @@
+#ifndef COPY_ENGINE_H
+#define COPY_ENGINE_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <sys/types.h>
+
+// Data transfer strategies, in the order they are attempted
+enum class CopyMethod {
+    None,
+    Reflink,        // ioctl(FICLONE): share extents (btrfs, xfs, ...)
+    CopyFileRange,  // copy_file_range(): in-kernel copy, may offload to storage
+    IoUring,        // io_uring: many reads and writes in flight (e.g. across filesystems)
+    Sendfile,       // sendfile(): in-kernel copy through the page cache
+    ReadWrite       // read()/write() through a user-space buffer
+};
+
+const char* copyMethodName(CopyMethod method);
+
+// How copied data treats the page cache
+enum class CacheMode {
+    Normal,      // cached as usual
+    DropBehind,  // each chunk is written back and dropped from the cache, on both sides
+    Direct       // O_DIRECT read/write where the filesystems allow it, else DropBehind
+};
+
+const char* cacheModeName(CacheMode mode);
+
+class XXHash64;
+class RingCopier;
+class Throttle;
+
+// Moves the contents of one open file descriptor into another, using the
+// fastest mechanism the kernel and filesystems support. Each method falls back
+// to the next on "not supported" errors, continuing from the current offset.
+class CopyEngine {
+public:
+    using ProgressFn = std::function<void(size_t bytes_copied, size_t total_bytes)>;
+
+private:
+    // Kernel methods are issued in chunks of this size so progress keeps moving
+    static constexpr size_t KERNEL_CHUNK_SIZE = 64 * 1024 * 1024;
+    // Smaller chunks outside CacheMode::Normal bound what is cached at once
+    static constexpr size_t DROP_CHUNK_SIZE = 8 * 1024 * 1024;
+
+    size_t buffer_size;  // 0: sized per copy by BufferPool::adaptiveSize()
+    CacheMode cache_mode;
+    size_t drop_start;   // destination range written back but not yet dropped
+    size_t drop_end;
+    bool method_enabled[6];
+    size_t hole_bytes;
+    size_t hole_end;  // end of the last hole copySparse() skipped rather than wrote
+    XXHash64* checksum;
+    Throttle* throttle;
+    size_t queue_depth;
+    std::unique_ptr<RingCopier> ring;  // created on first use, per engine
+    bool batching;
+    size_t batch_files;                 // copy() calls since beginBatch()
+    std::vector<size_t> batch_job_files;  // file number of each queued ring job
+
+    size_t nextChunk(size_t remaining, size_t preferred);
+    bool tryReflink(int src_fd, int dst_fd);
+    bool copyFileRange(int src_fd, int dst_fd, size_t& offset, size_t end, const ProgressFn& progress);
+    bool copyRing(int src_fd, int dst_fd, size_t& offset, size_t end, const ProgressFn& progress);
+    bool copySendfile(int src_fd, int dst_fd, size_t& offset, size_t end, const ProgressFn& progress);
+    void checksumZeros(size_t length);
+    bool copyReadWrite(int src_fd, int dst_fd, size_t& offset, size_t end, const ProgressFn& progress, bool direct);
+    void dropBehind(int src_fd, int dst_fd, size_t start, size_t end);
+    void finishDropBehind(int dst_fd);
+    CopyMethod transferExtent(int src_fd, int dst_fd, size_t offset, size_t length, const ProgressFn& progress,
+                              bool direct);
+    CopyMethod copyExtent(int src_fd, int dst_fd, size_t offset, size_t length, const ProgressFn& progress);
+    CopyMethod copySparse(int src_fd, int dst_fd, size_t offset, size_t length, const ProgressFn& progress);
+
+public:
+    // Read/write buffers come from BufferPool::shared(); a buffer_size of 0
+    // picks one per copy from the file size and the destination's st_blksize
+    explicit CopyEngine(size_t buffer_size = 0);
+
+    // Copies share configuration but not the scratch buffer, so each worker
+    // thread can own one
+    CopyEngine(const CopyEngine& other);
+    CopyEngine& operator=(const CopyEngine& other);
+    ~CopyEngine();
+
+    // Configuration; disabling methods is mainly useful for benchmarking
+    void setMethodEnabled(CopyMethod method, bool enabled);
+    bool isMethodEnabled(CopyMethod method) const;
+
+    // While a hasher is set, data goes through the read/write buffer only and
+    // every byte copied (holes as zeros) is fed to it in file order, so the
+    // source is checksummed without being read a second time. Not copied
+    // along with the configuration.
+    void setChecksum(XXHash64* hasher);
+
+    // Outside CacheMode::Normal the io_uring method is skipped, since its
+    // out-of-order completions cannot be dropped chunk by chunk
+    void setCacheMode(CacheMode mode);
+    CacheMode getCacheMode() const;
+
+    // Every transfer is charged to throttle (shared, not owned) in chunks small
+    // enough to keep its waits short. While it has limits the io_uring method
+    // is skipped, since a deep queue works against a rate limit. Copied along
+    // with the configuration.
+    void setThrottle(Throttle* shared);
+
+    // Reads plus writes kept in flight by the io_uring method (default 16)
+    void setQueueDepth(size_t depth);
+    size_t getQueueDepth() const;
+
+    // Between beginBatch() and finishBatch(), copies that reach the io_uring
+    // method are only queued and copy() returns CopyMethod::IoUring at once;
+    // finishBatch() then moves them all through one ring, several files in
+    // flight together. File descriptors and progress callbacks must stay valid
+    // until then. failures receives (n, errno) for the n-th copy() of the
+    // batch whose queued data could not be copied.
+    void beginBatch();
+    bool finishBatch(std::vector<std::pair<size_t, int>>& failures);
+
+    // Copies size bytes from the start of src_fd to the start of dst_fd (an
+    // empty regular file). An empty or pseudo-filesystem source is read until
+    // EOF instead, since its size says nothing about its contents. Returns the
+    // method that completed the copy, or CopyMethod::None with errno set.
+    CopyMethod copy(int src_fd, int dst_fd, size_t size, const ProgressFn& progress = ProgressFn());
+
+    // Clones the whole of src_fd into dst_fd (FICLONE) on filesystems that
+    // share extents. False while a hasher is set, with Reflink disabled, or
+    // when the filesystem cannot clone.
+    bool reflink(int src_fd, int dst_fd);
+
+    // Copies [offset, offset + length) of src_fd to the same range of dst_fd,
+    // leaving the rest of the destination untouched. Reflink is not attempted;
+    // callers splitting a file try reflink() on the whole of it first.
+    // Progress is reported relative to the range. Holes in a sparse source
+    // (found with SEEK_DATA/SEEK_HOLE) are skipped, and punched in the
+    // destination if it already has data there.
+    CopyMethod copyRange(int src_fd, int dst_fd, size_t offset, size_t length,
+                         const ProgressFn& progress = ProgressFn());
+
+    // Bytes of the last copy() or copyRange() that were holes and not transferred
+    size_t lastHoleBytes() const;
+};
+
+#endif // COPY_ENGINE_H
@@ -0,0 +1,72 @@
+#ifndef DIGEST_CACHE_H
+#define DIGEST_CACHE_H
+
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <sys/stat.h>
+
+// Persistent map from file identity and version to content digest, so files
+// that have not changed since they were last hashed are never read again.
+// An entry is keyed by (dev, ino, size, mtime, ctime); ctime cannot be set
+// from user space, so touch -m cannot make stale content look current.
+//
+// The store is a flat binary file, read on first use and rewritten
+// atomically (temporary file + rename) by save().
+class DigestCache {
+private:
+    struct Key {
+        uint64_t device;
+        uint64_t inode;
+        uint64_t size;
+        int64_t mtime_sec;
+        int64_t mtime_nsec;
+        int64_t ctime_sec;
+        int64_t ctime_nsec;
+
+        bool operator==(const Key& other) const;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Entry {
+        uint64_t digest;
+        bool used;  // looked up or stored since loading
+    };
+
+    // Unused entries are dropped on save once the store grows past this
+    static constexpr size_t MAX_ENTRIES = 4 * 1024 * 1024;
+
+    std::string store_path;
+    std::unordered_map<Key, Entry, KeyHash> entries;
+    std::mutex entries_mutex;
+    bool loaded;
+    bool dirty;
+    std::atomic<size_t> hits;
+    std::atomic<size_t> misses;
+
+    static Key makeKey(const struct stat& st);
+    void loadLocked();
+
+public:
+    explicit DigestCache(const std::string& path = defaultPath());
+
+    // $XDG_CACHE_HOME/file_explorer/digests, falling back to ~/.cache
+    static std::string defaultPath();
+
+    bool lookup(const struct stat& st, uint64_t& digest);
+    // Files modified within the last couple of seconds are not cached, since a
+    // further write in the same timestamp tick would go unnoticed
+    void store(const struct stat& st, uint64_t digest);
+
+    bool save();
+    size_t size();
+    size_t getHits() const;
+    size_t getMisses() const;
+};
+
+#endif // DIGEST_CACHE_H
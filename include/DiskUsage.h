@@ -0,0 +1,132 @@
+#ifndef DISK_USAGE_H
+#define DISK_USAGE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <atomic>
+#include <ctime>
+#include <functional>
+#include <chrono>
+#include <sys/stat.h>
+#include "FileId.h"
+
+class Throttle;
+
+struct UsageTotals {
+    size_t apparent_bytes = 0;   // sum of st_size
+    size_t allocated_bytes = 0;  // sum of st_blocks * 512
+    size_t files = 0;
+    size_t directories = 0;
+    size_t errors = 0;
+    size_t cached_directories = 0;  // directories answered from the cache
+};
+
+// One entry of a top-N report. Sizes are allocated bytes.
+struct UsageItem {
+    std::string path;
+    size_t bytes = 0;         // for directories, everything below it
+    size_t direct_bytes = 0;  // directories only: files directly inside
+    std::vector<std::pair<std::string, size_t>> largest_children;  // directories only, largest first
+};
+
+struct TopReport {
+    UsageItem root;
+    std::vector<UsageItem> directories;  // largest first, root excluded
+    std::vector<UsageItem> files;        // largest first
+    UsageTotals totals;
+};
+
+// Receives the largest entries found so far while a top-N scan is running
+using TopProgress = std::function<void(const TopReport& partial)>;
+
+// Receives the non-directory entries of one directory during DiskUsage::walk()
+using DirectoryVisitor = std::function<void(const std::string& directory,
+                                            const std::vector<std::pair<std::string, struct stat>>& files)>;
+
+// Parallel disk usage scanner. Every entry costs exactly one fstatat() (never
+// following symlinks), hard links are counted once per scan, and each
+// directory's own entries are cached keyed by its (dev, ino) and validated by
+// its mtime, so rescanning an unchanged tree only stats the directories.
+//
+// An unchanged directory mtime proves no entry was added, removed or renamed;
+// it does not catch a file growing in place, which is why a scan can bypass
+// the cache.
+class DiskUsage {
+private:
+    struct HardLink {
+        FileId id;
+        size_t apparent;
+        size_t allocated;
+    };
+
+    // What a directory contains directly, excluding subdirectory contents
+    struct DirectoryEntry {
+        struct timespec mtime;
+        size_t apparent_bytes;
+        size_t allocated_bytes;
+        size_t files;
+        std::vector<HardLink> hard_links;
+        std::vector<std::string> subdirectories;
+    };
+
+    struct ScanState;
+    struct WalkState;
+    struct TopState;
+    struct TopNode;
+
+    using EntryVisitor = std::function<void(const char* name, const struct stat& st)>;
+
+    // The cache is emptied when the listings it holds reach about this size,
+    // so a scan of a huge tree does not stay resident for the whole session
+    static constexpr size_t MAX_CACHED_BYTES = 64 * 1024 * 1024;
+
+    std::unordered_map<FileId, DirectoryEntry, FileIdHash> cache;
+    size_t cache_bytes;  // estimated memory held by cache
+    std::mutex cache_mutex;
+    size_t worker_count;
+    Throttle* throttle;
+
+    bool readDirectory(const std::string& path, DirectoryEntry& entry,
+                       std::vector<std::pair<std::string, struct stat>>& children,
+                       std::atomic<size_t>& errors, const EntryVisitor& visitor);
+    void scanDirectory(ScanState& state, const std::string& path, const struct stat& dir_stat);
+    void walkDirectory(WalkState& state, const std::string& path);
+    void scanTopDirectory(TopState& state, TopNode* node, const struct stat& dir_stat);
+    void finishTopNode(TopState& state, TopNode* node);
+    void snapshotTop(TopState& state, TopReport& report);
+    bool lookupCache(const FileId& id, const struct timespec& mtime, DirectoryEntry& entry);
+    void storeCache(const FileId& id, DirectoryEntry entry);
+    static size_t cachedSize(const DirectoryEntry& entry);
+
+public:
+    explicit DiskUsage(size_t workers = 0);
+
+    void setWorkerCount(size_t count);
+    // Directory reads and stats are charged to throttle as operations
+    void setThrottle(Throttle* shared);
+    void clearCache();
+    size_t cachedDirectoryCount();
+
+    // Scans path (following it if it is itself a symlink) and returns totals.
+    // Returns false with errno set if path itself cannot be examined.
+    bool scan(const std::string& path, UsageTotals& totals, bool use_cache = true);
+
+    // Single pass that keeps only the limit largest files and directories
+    // (bounded heaps) plus the directories still being scanned. Calls progress
+    // with the partial result every interval while the scan runs. Always reads
+    // the tree afresh, since cached listings do not record individual files.
+    bool scanTop(const std::string& path, size_t limit, TopReport& report,
+                 const TopProgress& progress = nullptr,
+                 std::chrono::milliseconds interval = std::chrono::milliseconds(1000));
+
+    // The same parallel traversal, handing each directory's files (lstat
+    // results) to visitor. Visitor runs on worker threads, one directory per
+    // call, possibly several at once. Returns the number of unreadable entries
+    // through errors.
+    bool walk(const std::string& path, const DirectoryVisitor& visitor, size_t* errors = nullptr);
+};
+
+#endif // DISK_USAGE_H
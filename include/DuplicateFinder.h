@@ -0,0 +1,76 @@
+#ifndef DUPLICATE_FINDER_H
+#define DUPLICATE_FINDER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "DiskUsage.h"
+#include "DigestCache.h"
+
+// Files with identical content. Hard links to one inode count as a single
+// copy, since removing them frees nothing.
+struct DuplicateGroup {
+    uint64_t size = 0;
+    uint64_t digest = 0;
+    std::vector<std::vector<std::string>> copies;  // one entry per inode: its paths
+    uint64_t reclaimable_bytes = 0;                // size * (copies - 1)
+};
+
+struct DuplicateStats {
+    size_t files = 0;            // regular files seen
+    size_t same_size = 0;        // files sharing their size with another
+    size_t partial_hashed = 0;   // inodes whose head and tail were read
+    size_t full_hashed = 0;      // inodes whose whole content was read
+    size_t hashed_bytes = 0;
+    size_t cached_files = 0;     // full digests answered by the digest cache
+    size_t errors = 0;
+};
+
+struct DuplicateReport {
+    std::string root;
+    std::vector<DuplicateGroup> groups;  // largest reclaimable_bytes first
+    size_t duplicate_files = 0;          // redundant copies across all groups
+    uint64_t reclaimable_bytes = 0;
+    DuplicateStats stats;
+};
+
+// Finds duplicate files in three narrowing stages: equal size, then an XXH64
+// of the first and last PARTIAL_SIZE bytes, then an XXH64 of the whole
+// content. Each stage only looks at what survived the previous one, and each
+// inode is read once however many hard links lead to it.
+//
+// Memory stays proportional to the same-size candidates rather than the
+// tree: a first metadata pass only counts files per size, and the second
+// keeps paths just for files whose size occurred twice, packed into a
+// directory table and a name arena.
+class DuplicateFinder {
+private:
+    struct Candidate;
+    struct SearchState;
+
+    // Bytes hashed from each end of a file in the partial stage; files up to
+    // twice this size are read whole there and skip the full stage
+    static constexpr size_t PARTIAL_SIZE = 4096;
+    // Hash tasks are batched up to this many files or bytes
+    static constexpr size_t BATCH_FILES = 256;
+    static constexpr size_t BATCH_BYTES = 64 * 1024 * 1024;
+
+    DiskUsage& disk_usage;
+    DigestCache& digest_cache;
+    size_t worker_count;
+
+    static bool sameInode(const Candidate& a, const Candidate& b);
+    std::string candidatePath(const SearchState& state, const Candidate& candidate) const;
+    bool hashPartial(const std::string& path, Candidate& candidate, SearchState& state);
+    bool hashFull(const std::string& path, Candidate& candidate, SearchState& state);
+    void hashStage(SearchState& state, bool full);
+    void keepGroups(SearchState& state);
+
+public:
+    DuplicateFinder(DiskUsage& usage, DigestCache& cache, size_t workers = 0);
+
+    // Returns false with errno set if path is not a readable directory
+    bool find(const std::string& path, DuplicateReport& report);
+};
+
+#endif // DUPLICATE_FINDER_H
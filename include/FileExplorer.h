@@ -3,9 +3,17 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <istream>
+#include <chrono>
 #include <sys/stat.h>
 #include "Navigator.h"
 #include "FileOperations.h"
+#include "SearchEngine.h"
+
+class OutputRenderer;
 
 struct FileInfo {
     std::string name;
@@ -14,20 +22,85 @@ struct FileInfo {
     size_t size;
     std::string type;
     std::string modified_time;
+    time_t modified_timestamp;
+    uid_t uid;
+    gid_t gid;
+    dev_t device;
+    ino_t inode;
+    std::string owner;
+    std::string group;
     bool is_hidden;
 };
 
+struct TreeTotals {
+    size_t directories = 0;
+    size_t files = 0;
+    size_t bytes = 0;
+};
+
 class FileExplorer {
+public:
+    // Per-command exit status, shell style
+    static const int STATUS_OK = 0;
+    static const int STATUS_FAILED = 1;
+    static const int STATUS_USAGE = 2;
+    static const int STATUS_UNKNOWN_COMMAND = 127;
+
+    using CommandHandler = std::function<int(const std::vector<std::string>& args)>;
+
 private:
+    struct ListingColumns {
+        size_t name = 20;
+        size_t type = 12;
+        size_t owner = 6;
+        size_t group = 6;
+    };
+
+    // What tree needs of a directory entry (stat follows symlinks)
+    struct TreeEntry {
+        std::string name;
+        bool is_dir;
+        size_t size;
+        dev_t device;
+        ino_t inode;
+    };
+
+    // Lines of a subtree rendered off the main thread; each slot is where a
+    // directory's totals (or why it could not be opened) go into the text
+    struct SubtreeSlot {
+        size_t offset;
+        TreeTotals totals;
+        int error;
+    };
+    struct SubtreeText {
+        std::string text;
+        std::vector<SubtreeSlot> slots;
+    };
+
     std::unique_ptr<Navigator> navigator;
     std::unique_ptr<FileOperations> file_ops;
     bool show_hidden_files;
+    bool interactive;
+    bool exit_requested;
+    std::unordered_map<std::string, CommandHandler> commands;
+    std::chrono::steady_clock::time_point last_progress_report;
 
     std::string formatPermissions(mode_t mode);
     std::string formatFileSize(size_t size);
     std::string formatTime(time_t timestamp);
     std::string getFileType(mode_t mode, const std::string& path);
     bool isHiddenFile(const std::string& name);
+    void registerCommands();
+    void printResultDetails(const OperationResult& result, size_t indent = 2);
+    bool reportBatch(const std::string& verb, const OperationResult& result);
+    void printHelp();
+    void reportThrottledProgress(const ProgressSnapshot& snapshot);
+    bool statEntry(const std::string& dir_path, const std::string& name, FileInfo& info);
+    ListingColumns measureColumns(const std::vector<FileInfo>& files);
+    void appendFileRow(OutputRenderer& out, const FileInfo& file, const ListingColumns& columns);
+    int readTreeEntries(const std::string& path, std::vector<TreeEntry>& entries);
+    TreeTotals renderSubtree(const std::string& path, const std::string& prefix, int depth, int max_depth,
+                             std::vector<std::pair<dev_t, ino_t>>& ancestors, SubtreeText& subtree, int& error);
 
 public:
     FileExplorer();
@@ -50,20 +123,42 @@ public:
     void showHistory();
 
     // File operations
-    bool copyFile(const std::string& source, const std::string& destination);
+    bool copyFile(const std::string& source, const std::string& destination, bool verify = false,
+                  bool follow_links = false);
+    bool createLink(const std::string& target, const std::string& link_path);
+    bool checksumFiles(const std::vector<std::string>& paths, ChecksumAlgorithm algorithm);
     bool moveFile(const std::string& source, const std::string& destination);
-    bool deleteFile(const std::string& path);
+    bool movePlan(const std::string& plan_path, const std::string& log_path);
+    bool compareFiles(const std::string& file1, const std::string& file2);
+    bool compareDirectories(const std::string& dir1, const std::string& dir2);
+    bool deleteFile(const std::string& path, bool confirm = true, bool background = false);
+    bool shredFile(const std::string& path, int passes, bool confirm = true);
     bool createDirectory(const std::string& path);
     bool createFile(const std::string& path);
-    void showDiskUsage(const std::string& path = "");
+    bool showDiskUsage(const std::string& path = "", bool use_cache = true);
+    bool showLargest(const std::string& path = "", size_t limit = 10);
+    bool showDuplicates(const std::string& path = "");
+    bool showMimeTypes(const std::vector<std::string>& paths);
+    bool findFiles(const std::string& path, const SearchCriteria& criteria);
+
+    // I/O limits for copies, moves and scans; 0 = unlimited
+    bool setThrottle(size_t bytes_per_second, size_t ops_per_second, bool idle_priority);
+    void showThrottle();
 
     // Display methods
-    void displayDirectory(const std::vector<FileInfo>& files);
+    void displayDirectory(const std::vector<FileInfo>& files, bool show_mime = false);
     void printCurrentDirectory();
+    bool showTree(const std::string& path = "", int max_depth = -1);
+    bool watchDirectory(const std::string& path = "", int refresh_ms = 500);
 
     // Main application loop
     void run();
 
+    // Command dispatch
+    static bool tokenize(const std::string& line, std::vector<std::string>& tokens, std::string& error);
+    int executeCommand(const std::string& line);
+    int runBatch(std::istream& input, const std::string& source_name);
+
     // Utility methods
     bool directoryExists(const std::string& path);
     void setShowHidden(bool show);
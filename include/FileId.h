@@ -0,0 +1,35 @@
+#ifndef FILE_ID_H
+#define FILE_ID_H
+
+#include <cstddef>
+#include <functional>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Identity of a file independent of its path (hard links share one)
+struct FileId {
+    dev_t device;
+    ino_t inode;
+
+    FileId(dev_t dev = 0, ino_t ino = 0) : device(dev), inode(ino) {}
+    explicit FileId(const struct stat& st) : device(st.st_dev), inode(st.st_ino) {}
+
+    bool operator==(const FileId& other) const {
+        return device == other.device && inode == other.inode;
+    }
+    bool operator!=(const FileId& other) const {
+        return !(*this == other);
+    }
+    bool operator<(const FileId& other) const {
+        return device != other.device ? device < other.device : inode < other.inode;
+    }
+};
+
+struct FileIdHash {
+    size_t operator()(const FileId& id) const {
+        size_t h = std::hash<unsigned long long>()(static_cast<unsigned long long>(id.inode));
+        return h ^ (std::hash<unsigned long long>()(static_cast<unsigned long long>(id.device)) + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2));
+    }
+};
+
+#endif // FILE_ID_H
@@ -2,33 +2,99 @@
 #define FILE_OPERATIONS_H
 
 #include <string>
+#include <vector>
 #include <functional>
+#include <atomic>
+#include <memory>
 #include <sys/stat.h>
-
-// Progress callback type for long operations
-using ProgressCallback = std::function<void(size_t bytes_processed, size_t total_bytes)>;
+#include "CopyEngine.h"
+#include "DiskUsage.h"
+#include "DuplicateFinder.h"
+#include "Checksum.h"
+#include "Throttle.h"
+#include "ProgressTracker.h"
 
 struct OperationResult {
     bool success;
     std::string message;
     int error_code;
+    std::string path;                      // item this result refers to, if any
+    std::vector<OperationResult> details;  // per-item results of multi-item operations
 
     OperationResult(bool s = false, const std::string& msg = "", int code = 0)
         : success(s), message(msg), error_code(code) {}
 };
 
+class TreeRemover;
+class DigestCache;
+
 class FileOperations {
 private:
-    static const size_t BUFFER_SIZE = 8192;
     bool verbose_output;
     ProgressCallback progress_callback;
+    ProgressTracker* progress;  // of the running operation; a batch job's reports into the batch
+    Throttle throttle;  // shared by every copy and scan this instance starts
+    CopyEngine copy_engine;
+    DiskUsage disk_usage;
+    std::unique_ptr<TreeRemover> tree_remover;
+    std::unique_ptr<DigestCache> digest_cache;  // loaded on first use
+    std::atomic<size_t> copy_method_counts[6];
+    std::atomic<size_t> copy_hole_bytes;
+    std::atomic<size_t> copy_verified_files;
+    size_t copy_symlinks;
+    size_t copy_hard_links;
+    bool verify_copies;  // set for the duration of copy()
+    bool follow_copy_links;  // likewise
+    size_t worker_count;
+    size_t device_concurrency;
+
+    // Parallel directory copy tuning
+    static constexpr size_t SMALL_FILE_SIZE = 256 * 1024;
+    static constexpr size_t SMALL_BATCH_FILES = 128;
+    static constexpr size_t SMALL_BATCH_BYTES = 8 * 1024 * 1024;
+    static constexpr size_t LARGE_FILE_SIZE = 256 * 1024 * 1024;
+    static constexpr size_t RANGE_SIZE = 64 * 1024 * 1024;
+    // Files queued on one worker's ring before it is drained (two descriptors each)
+    static constexpr size_t RING_BATCH_FILES = 32;
+
+    // Bytes read from each file per comparison step
+    static constexpr size_t COMPARE_CHUNK_SIZE = 4 * 1024 * 1024;
+
+    enum class BatchOp { Copy, Move, Remove };
+
+    struct BatchItem {
+        BatchOp op;
+        std::string source;
+        std::string destination;
+        bool recursive;
+        bool force;
+        bool verify = false;
+        bool follow_links = false;
+    };
+
+    struct CopyJob {
+        std::string source;
+        std::string destination;
+        size_t size;
+        mode_t mode;
+    };
+
+    // What a directory copy found to do; defined with scanCopyTree()
+    struct CopyScan;
 
     // Helper methods
     bool copyFile(const std::string& source, const std::string& destination, bool preserve_attributes = true);
-    bool copyDirectory(const std::string& source, const std::string& destination, bool preserve_attributes = true);
-    bool removeDirectory(const std::string& path);
+    CopyMethod copyFileWith(CopyEngine& engine, const std::string& source, const std::string& destination,
+                            bool preserve_attributes, const CopyEngine::ProgressFn& progress);
+    void copyFilesWith(CopyEngine& engine, const std::vector<const CopyJob*>& jobs, bool preserve_attributes,
+                       const std::function<void(size_t job, size_t bytes)>& progress, std::vector<int>& errors);
+    bool verifyCopy(int dst_fd, size_t size, uint64_t expected);
+    bool copyDirectory(const std::string& source, const std::string& destination, bool preserve_attributes,
+                       std::vector<OperationResult>& errors);
+    void scanCopyTree(const std::string& source, const std::string& destination, bool preserve_attributes,
+                      CopyScan& scan, std::vector<OperationResult>& errors);
+    OperationResult runBatch(const std::vector<BatchItem>& items);
     bool confirmAction(const std::string& action, const std::string& target);
-    void updateProgress(size_t current, size_t total);
     std::string formatFileSize(size_t size);
 
 public:
@@ -37,11 +103,33 @@ public:
 
     // Configuration
     void setVerbose(bool verbose);
+    // Called about 10 times a second during copies, moves and comparisons,
+    // on a reporter thread, with bytes and files done against the totals
+    // known so far, a moving-average throughput and an ETA; once more when
+    // the operation ends
     void setProgressCallback(ProgressCallback callback);
-
-    // Copy operations
-    OperationResult copy(const std::string& source, const std::string& destination, bool recursive = false, bool preserve_attributes = true);
-    OperationResult copyMultiple(const std::vector<std::string>& sources, const std::string& destination, bool recursive = false);
+    CopyEngine& getCopyEngine();
+    // Bandwidth and operation limits for copies, moves and usage scans
+    Throttle& getThrottle();
+    void setWorkerCount(size_t count);  // 0 = one per hardware thread
+    void setDeviceConcurrency(size_t limit);  // concurrent batch jobs per device
+
+    // Which copy mechanisms the most recent copy() used, e.g. "reflink" or
+    // "12 copy_file_range, 1 read/write", noting any holes left unwritten and
+    // the symlinks and hard links recreated; empty if nothing was copied
+    std::string describeLastCopy() const;
+
+    // Copy operations. With verify, each file's XXH64 is taken from the copy
+    // buffer as the data goes by, and the destination is flushed, dropped from
+    // the page cache and read back to check it; a mismatch fails with EIO.
+    // Below a source directory, symlinks are recreated as symlinks and files
+    // with several names inside the tree keep sharing one copy (hard links).
+    // With follow_links, symlinks are copied as what they point to instead;
+    // a link back to a directory being copied is reported, never entered.
+    OperationResult copy(const std::string& source, const std::string& destination, bool recursive = false,
+                         bool preserve_attributes = true, bool verify = false, bool follow_links = false);
+    OperationResult copyMultiple(const std::vector<std::string>& sources, const std::string& destination,
+                                 bool recursive = false, bool verify = false, bool follow_links = false);
 
     // Move/rename operations
     OperationResult move(const std::string& source, const std::string& destination);
@@ -51,23 +139,58 @@ public:
     // Delete operations
     OperationResult remove(const std::string& path, bool recursive = false, bool force = false);
     OperationResult removeMultiple(const std::vector<std::string>& paths, bool recursive = false, bool force = false);
+    // Overwrites the data of a file, or of every file below a directory, with
+    // passes of random data (each flushed to disk) before deleting it; files
+    // are processed in parallel and holes are skipped
     OperationResult secureDelete(const std::string& path, int passes = 3);
+    // Renames path aside and deletes it on a background thread; returns at once
+    OperationResult removeInBackground(const std::string& path);
+    size_t pendingBackgroundRemovals();
 
     // Create operations
     OperationResult createDirectory(const std::string& path, bool create_parents = false);
     OperationResult createFile(const std::string& path, const std::string& content = "");
+    // The target is stored as given and need not exist; link_path must not
     OperationResult createSymbolicLink(const std::string& target, const std::string& link_path);
 
-    // Size calculation
-    OperationResult calculateSize(const std::string& path, bool recursive = true, size_t& size_out);
+    // Size calculation. Repeated scans reuse cached directory listings whose
+    // mtime is unchanged; pass use_cache = false to re-stat every file.
+    OperationResult calculateSize(const std::string& path, bool recursive, size_t& size_out);
+    OperationResult calculateUsage(const std::string& path, UsageTotals& totals, bool use_cache = true);
+    // The limit largest files and directories under path, found in one pass
+    OperationResult findLargest(const std::string& path, size_t limit, TopReport& report,
+                                const TopProgress& progress = nullptr);
 
     // Comparison operations
-    OperationResult compareFiles(const std::string& file1, const std::string& file2);
+    // Succeeds only if the contents are identical. A difference is a failure
+    // with error_code 0; first_difference receives its offset when the sizes
+    // match. Files on different devices are read concurrently.
+    OperationResult compareFiles(const std::string& file1, const std::string& file2,
+                                 size_t* first_difference = nullptr);
+    // Succeeds only if both trees have the same names, types and contents.
+    // Otherwise details lists each entry (relative path) "added" to dir2,
+    // "removed" from it, "changed" or "unreadable"; error_code stays 0 unless
+    // a tree could not be read. File digests persist between runs, so an
+    // unchanged tree costs only a metadata scan.
     OperationResult compareDirectories(const std::string& dir1, const std::string& dir2);
+    // Groups of identical files under path, narrowed by size, then head and
+    // tail hash, then full digest; hard links count as one copy
+    OperationResult findDuplicates(const std::string& path, DuplicateReport& report);
+    DigestCache& getDigestCache();
+
+    // Hex digest of a file's content; bytes_read receives the file length
+    OperationResult checksumFile(const std::string& path, ChecksumAlgorithm algorithm, std::string& digest_out,
+                                 size_t* bytes_read = nullptr);
 
     // Batch operations
     OperationResult batchCopy(const std::vector<std::pair<std::string, std::string>>& copy_pairs);
-    OperationResult batchMove(const std::vector<std::pair<std::string, std::string>>& move_pairs);
+    // Renames within one filesystem as a unit: the whole plan is checked
+    // first (nothing moves if any entry is invalid), and a failure part way
+    // renames everything back. With log_path, an undo log survives a crash;
+    // undoBatchMove() replays it backwards.
+    OperationResult batchMove(const std::vector<std::pair<std::string, std::string>>& move_pairs,
+                              const std::string& log_path = "");
+    OperationResult undoBatchMove(const std::string& log_path);
 
     // Utility methods
     bool exists(const std::string& path);
@@ -75,6 +198,7 @@ public:
     bool isDirectory(const std::string& path);
     bool isSymbolicLink(const std::string& path);
     size_t getFileSize(const std::string& path);
+    // Sniffed from the first block (see MimeDetector); symlinks are not followed
     std::string getMimeType(const std::string& path);
 };
 
@@ -0,0 +1,58 @@
+#ifndef ID_NAME_CACHE_H
+#define ID_NAME_CACHE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <sys/types.h>
+
+// Process-wide uid/gid -> name cache. NSS lookups (which may hit LDAP or
+// other remote backends) happen at most once per id per TTL; ids that do not
+// resolve are cached too, with a shorter TTL, and shown numerically.
+class IdNameCache {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::string name;
+        bool resolved;
+        Clock::time_point expires;
+    };
+
+    std::unordered_map<uid_t, Entry> users;
+    std::unordered_map<gid_t, Entry> groups;
+    mutable std::mutex cache_mutex;
+    std::chrono::seconds positive_ttl;
+    std::chrono::seconds negative_ttl;
+    size_t nss_lookups;
+
+    IdNameCache();
+
+    Entry lookupUser(uid_t uid);
+    Entry lookupGroup(gid_t gid);
+    bool isFresh(const Entry& entry, Clock::time_point now) const;
+
+public:
+    static IdNameCache& instance();
+
+    IdNameCache(const IdNameCache&) = delete;
+    IdNameCache& operator=(const IdNameCache&) = delete;
+
+    // Configuration
+    void setTTL(std::chrono::seconds positive, std::chrono::seconds negative);
+    void clear();
+
+    // Resolve every id not already cached in one pass, outside the cache lock
+    void prefetch(const std::vector<uid_t>& uids, const std::vector<gid_t>& gids);
+
+    // Single lookups (resolve on miss)
+    std::string userName(uid_t uid);
+    std::string groupName(gid_t gid);
+
+    // Number of NSS queries issued so far
+    size_t getLookupCount() const;
+};
+
+#endif // ID_NAME_CACHE_H
@@ -0,0 +1,135 @@
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+// Minimal io_uring instance driven through the raw system calls, so no
+// liburing is needed at build or run time
+class IoRing {
+private:
+    int ring_fd;
+    void* sq_ring;
+    void* cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+    unsigned sq_entries;
+    unsigned unsubmitted;
+
+    void release();
+
+public:
+    IoRing();
+    ~IoRing();
+
+    IoRing(const IoRing&) = delete;
+    IoRing& operator=(const IoRing&) = delete;
+
+    // Returns false with errno set if the kernel has no (or a disabled) io_uring
+    bool init(unsigned entries);
+    bool isOpen() const;
+    bool registerBuffers(const struct iovec* buffers, unsigned count);
+
+    // A zeroed submission entry, or nullptr when the submission queue is full
+    struct io_uring_sqe* nextSqe();
+    // Hands queued entries to the kernel and waits for at least wait_for completions
+    bool submit(unsigned wait_for);
+    bool popCompletion(uint64_t& user_data, int& result);
+
+    // Whether an io_uring can be created here; probed once per process
+    static bool isSupported();
+};
+
+// Copies byte ranges between open files through one IoRing, keeping up to
+// queue_depth reads and writes in flight across all queued ranges. Each
+// in-flight operation owns one chunk_size buffer from a fixed pool, which is
+// registered with the kernel when RLIMIT_MEMLOCK allows it.
+class RingCopier {
+public:
+    using ProgressFn = std::function<void(size_t bytes_copied, size_t total_bytes)>;
+
+    static constexpr size_t DEFAULT_QUEUE_DEPTH = 16;
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 256 * 1024;
+
+private:
+    struct Job {
+        int src_fd;
+        int dst_fd;
+        size_t start;
+        size_t end;
+        size_t next;   // first byte not yet handed to a slot
+        size_t done;   // bytes written, in any order
+        ProgressFn progress;
+        int error;
+    };
+
+    // One buffer and at most one operation in flight
+    struct Slot {
+        size_t job;
+        size_t offset;
+        size_t length;
+        size_t written;
+        bool busy;
+        bool writing;
+    };
+
+    struct Chunk {
+        size_t job;
+        size_t offset;
+        size_t length;
+    };
+
+    IoRing ring;
+    size_t chunk_size;
+    char* buffers;
+    bool fixed_buffers;
+    bool broken;  // operations may still be in flight; never reused
+    std::vector<Slot> slots;
+    std::vector<Job> jobs;
+    std::deque<Chunk> retries;  // remainders of short reads
+
+    bool nextChunk(size_t& first_job, Chunk& chunk);
+    bool issue(size_t index);
+    void complete(size_t index, int result, size_t& in_flight);
+    void drain(size_t in_flight);
+
+public:
+    RingCopier(size_t queue_depth = DEFAULT_QUEUE_DEPTH, size_t chunk_size = DEFAULT_CHUNK_SIZE);
+    ~RingCopier();
+
+    RingCopier(const RingCopier&) = delete;
+    RingCopier& operator=(const RingCopier&) = delete;
+
+    // False if no ring could be set up, or one failed in a way that left
+    // operations in flight; add() and run() must not be used then
+    bool isReady() const;
+    size_t queueDepth() const;
+
+    // Queues [offset, offset + length) of src_fd to the same range of dst_fd;
+    // returns the job number. progress must stay valid until run() returns.
+    size_t add(int src_fd, int dst_fd, size_t offset, size_t length, const ProgressFn& progress = ProgressFn());
+    // Copies every queued range; returns false if any failed
+    bool run();
+    size_t jobCount() const;
+    // errno of a failed job, 0 if it completed (a source that shrank ends early)
+    int jobError(size_t job) const;
+    void clear();
+};
+
+#endif // IO_RING_H
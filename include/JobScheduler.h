@@ -0,0 +1,37 @@
+#ifndef JOB_SCHEDULER_H
+#define JOB_SCHEDULER_H
+
+#include <vector>
+#include <functional>
+#include <sys/types.h>
+#include "FileOperations.h"
+
+// Runs independent file operations concurrently while capping how many jobs
+// touch any one device at a time, so a batch spread over several disks keeps
+// all of them busy without piling every job onto the same spindle.
+class JobScheduler {
+public:
+    using Job = std::function<OperationResult()>;
+
+private:
+    struct PendingJob {
+        std::vector<dev_t> devices;
+        Job job;
+    };
+
+    size_t worker_count;
+    size_t per_device_limit;
+    std::vector<PendingJob> jobs;
+
+public:
+    JobScheduler(size_t workers = 0, size_t device_limit = 2);
+
+    // Queues a job that reads and/or writes the given devices
+    void add(const std::vector<dev_t>& devices, Job job);
+    size_t size() const;
+
+    // Runs every queued job and returns their results in the order added
+    std::vector<OperationResult> run();
+};
+
+#endif // JOB_SCHEDULER_H
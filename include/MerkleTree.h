@@ -0,0 +1,75 @@
+#ifndef MERKLE_TREE_H
+#define MERKLE_TREE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include "FileOperations.h"
+#include "DigestCache.h"
+
+struct MerkleStats {
+    size_t files = 0;
+    size_t directories = 0;
+    size_t hashed_files = 0;   // files whose content was read
+    size_t hashed_bytes = 0;
+    size_t cached_files = 0;   // files answered by the digest cache
+    size_t errors = 0;
+};
+
+// In-memory hash tree of a directory: every file carries an XXH64 content
+// digest, every directory a hash over its sorted (name, type, hash) entries,
+// so two trees with equal root hashes have identical names and contents.
+// Built in parallel; unchanged files come from the persistent DigestCache.
+class MerkleTree {
+public:
+    enum class EntryType : unsigned char { File, Directory, Symlink, Other, Unreadable };
+
+    struct Directory;
+
+    struct Entry {
+        std::string name;
+        EntryType type;
+        uint64_t hash;
+        std::unique_ptr<Directory> directory;  // set for EntryType::Directory
+    };
+
+    struct Directory {
+        std::vector<Entry> entries;  // sorted by name once built
+        uint64_t hash = 0;
+    };
+
+private:
+    struct BuildState;
+    struct BuildNode;
+
+    // Files at least this large are hashed in their own pool task
+    static constexpr size_t LARGE_FILE_SIZE = 1024 * 1024;
+
+    DigestCache& digest_cache;
+    size_t worker_count;
+    Directory root_directory;
+    MerkleStats build_stats;
+
+    void scanDirectory(BuildState& state, BuildNode* node);
+    void hashEntry(BuildState& state, int dir_fd, Entry& entry);
+    void finishNode(BuildNode* node);
+
+public:
+    MerkleTree(DigestCache& cache, size_t workers = 0);
+
+    // Returns false with errno set if path is not a readable directory
+    bool build(const std::string& path);
+
+    const Directory& root() const;
+    const MerkleStats& stats() const;
+
+    // Appends one result per differing entry (path relative to the roots,
+    // message "added", "removed", "changed" or "unreadable"), descending only
+    // into subdirectories whose hashes differ
+    static void diff(const Directory& left, const Directory& right, const std::string& prefix,
+                     std::vector<OperationResult>& changes);
+};
+
+#endif // MERKLE_TREE_H
@@ -0,0 +1,86 @@
+#ifndef MIME_DETECTOR_H
+#define MIME_DETECTOR_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+#include <sys/stat.h>
+#include "FileId.h"
+
+// Content-based MIME types. The first block of a file is matched against a
+// table of magic signatures compiled into byte tries, one per offset that
+// signatures start at (one walk each finds the longest matching signature,
+// wildcards included); files no signature claims
+// are classed as text or binary by their bytes. Extensions of formats that
+// have no magic number (source code, JSON, CSV...) are trusted outright, so
+// those files are never opened. Results are cached per (dev, ino) and reused
+// while the mtime is unchanged.
+class MimeDetector {
+public:
+    // Bytes read from the start of a file; the deepest signature ends at 262
+    static constexpr size_t HEADER_SIZE = 4096;
+
+private:
+    struct TrieNode {
+        std::vector<std::pair<unsigned char, uint32_t>> edges;
+        uint32_t any = 0;             // child for any byte, 0 if none
+        const char* mime = nullptr;   // a signature ends here
+    };
+
+    struct CacheEntry {
+        int64_t mtime_ns;
+        const char* mime;
+    };
+
+    // The cache is emptied when it reaches this many files
+    static constexpr size_t MAX_CACHED = 1 << 16;
+
+    // A trie of the signatures starting at offset
+    struct Root {
+        size_t offset;
+        uint32_t node;
+    };
+
+    std::vector<TrieNode> trie;
+    std::vector<Root> roots;
+    uint32_t first_byte[256];  // children of the offset 0 root, by byte
+    std::unordered_map<std::string, const char*> trusted_extensions;
+    std::unordered_map<FileId, CacheEntry, FileIdHash> cache;
+    std::mutex cache_mutex;
+
+    uint32_t root(size_t offset);
+    uint32_t child(uint32_t node, unsigned char byte);
+    void addSignature(size_t offset, const char* bytes, size_t length, size_t offset2, const char* bytes2,
+                      size_t length2, const char* mime);
+    const char* matchTrie(uint32_t node, const unsigned char* data, size_t length, size_t position,
+                          size_t& depth) const;
+
+public:
+    MimeDetector();
+
+    MimeDetector(const MimeDetector&) = delete;
+    MimeDetector& operator=(const MimeDetector&) = delete;
+
+    // One detector per process, shared by all threads
+    static MimeDetector& shared();
+
+    // MIME type of path, whose lstat() or stat() is st. Non-regular files get
+    // inode/* types. When the file has to be read and header is given, the
+    // bytes read are left in it so the caller need not read them again; a
+    // header that already holds the start of the file is used as is.
+    const char* detect(const std::string& path, const struct stat& st, std::string* header = nullptr);
+
+    // Signatures and the text check only, for bytes already in memory
+    const char* sniff(const char* data, size_t length) const;
+
+    // Whether mime matches filter: "image/png", "image/*", "image", or "text"
+    // (which also covers text-based application types such as JSON)
+    static bool matches(const std::string& mime, const std::string& filter);
+    static bool isTextType(const std::string& mime);
+
+    void clearCache();
+};
+
+#endif // MIME_DETECTOR_H
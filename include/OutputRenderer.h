@@ -0,0 +1,53 @@
+#ifndef OUTPUT_RENDERER_H
+#define OUTPUT_RENDERER_H
+
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+// Buffered text renderer for large listings. Rows are formatted into a single
+// reusable buffer and written to the file descriptor in large chunks instead of
+// going through iostream formatting for every column.
+class OutputRenderer {
+private:
+    static const size_t DEFAULT_FLUSH_THRESHOLD = 64 * 1024;
+
+    int output_fd;
+    size_t flush_threshold;
+    std::vector<char> buffer;
+    size_t used;
+    size_t rows_rendered;
+
+    void reserve(size_t extra);
+
+public:
+    OutputRenderer(int fd = STDOUT_FILENO, size_t threshold = DEFAULT_FLUSH_THRESHOLD);
+    ~OutputRenderer();
+
+    // Raw appends
+    void append(const char* data, size_t length);
+    void append(const std::string& text);
+    void append(char c);
+    void appendRepeated(char c, size_t count);
+    // Whole rows formatted elsewhere (each ending in '\n'), flushed as they go
+    void appendRows(const char* data, size_t length);
+
+    // Column helpers (left aligned, padded like std::setw; never truncates)
+    void appendPadded(const char* data, size_t length, size_t width);
+    void appendPadded(const std::string& text, size_t width);
+    void appendNumber(unsigned long long value);
+    void appendFileSize(size_t size);
+
+    // Ends the current row and flushes once the buffer passes the threshold
+    void endRow();
+    void flush();
+
+    size_t getRowsRendered() const;
+
+    // Formats a human readable size ("12.3 KB") into out, returns the length.
+    // out must hold at least FILE_SIZE_CHARS bytes.
+    static const size_t FILE_SIZE_CHARS = 32;
+    static size_t formatFileSize(char* out, size_t size);
+};
+
+#endif // OUTPUT_RENDERER_H
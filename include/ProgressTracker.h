@@ -0,0 +1,93 @@
+#ifndef PROGRESS_TRACKER_H
+#define PROGRESS_TRACKER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+struct ProgressSnapshot {
+    size_t bytes_done = 0;
+    size_t bytes_total = 0;     // 0 while unknown
+    size_t files_done = 0;
+    size_t files_total = 0;
+    double elapsed_seconds = 0;
+    double bytes_per_second = 0;  // moving average
+    double eta_seconds = -1;      // -1 while it cannot be estimated
+    bool finished = false;        // the last snapshot of the operation
+};
+
+using ProgressCallback = std::function<void(const ProgressSnapshot& snapshot)>;
+
+// Progress of one operation, however many threads contribute to it. Workers
+// only add to relaxed atomic counters; a reporter thread samples them at a
+// fixed interval, keeps an exponential moving average of the throughput and
+// hands a snapshot to the callback, so the callback never runs more often
+// than the interval and never on a worker's time.
+//
+// A tracker made with a parent has no callback of its own and passes every
+// count up as well, so one part of a larger operation can be measured on its
+// own while the whole still reports as one.
+class ProgressTracker {
+public:
+    static constexpr std::chrono::milliseconds DEFAULT_INTERVAL{100};
+
+private:
+    // Time constant of the throughput average: older samples fade over ~3s
+    static constexpr double AVERAGE_SECONDS = 3.0;
+
+    std::atomic<size_t> bytes_done;
+    std::atomic<size_t> files_done;
+    std::atomic<size_t> bytes_total;
+    std::atomic<size_t> files_total;
+    std::atomic<bool> totals_fixed;
+    ProgressTracker* parent;
+
+    ProgressCallback callback;
+    std::chrono::milliseconds interval;
+    std::chrono::steady_clock::time_point start_time;
+    std::chrono::steady_clock::time_point last_sample;
+    size_t last_bytes;
+    double average_rate;
+
+    std::thread reporter;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+
+    ProgressSnapshot sample(bool finished);
+    void run();
+
+public:
+    explicit ProgressTracker(ProgressCallback callback, std::chrono::milliseconds interval = DEFAULT_INTERVAL);
+    explicit ProgressTracker(ProgressTracker* parent);
+    ~ProgressTracker();
+
+    ProgressTracker(const ProgressTracker&) = delete;
+    ProgressTracker& operator=(const ProgressTracker&) = delete;
+
+    // Hot path: a relaxed atomic add per tracker in the chain
+    void addBytes(size_t bytes) {
+        bytes_done.fetch_add(bytes, std::memory_order_relaxed);
+        if (parent) parent->addBytes(bytes);
+    }
+    void addFiles(size_t files = 1) {
+        files_done.fetch_add(files, std::memory_order_relaxed);
+        if (parent) parent->addFiles(files);
+    }
+    size_t bytesDone() const { return bytes_done.load(std::memory_order_relaxed); }
+    size_t filesDone() const { return files_done.load(std::memory_order_relaxed); }
+
+    // Totals either grow as parts of the operation discover their work, or
+    // are fixed once by whoever scanned everything up front
+    void addTotals(size_t bytes, size_t files);
+    void setTotals(size_t bytes, size_t files);
+
+    // Stops the reporter after one final snapshot; also done by the destructor
+    void finish();
+};
+
+#endif // PROGRESS_TRACKER_H
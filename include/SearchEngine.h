@@ -18,12 +18,14 @@ struct SearchCriteria {
     bool search_content = false;
     bool recursive = true;
     bool include_hidden = false;
+    std::string mime_type;  // "image/png", "image/*", "image" or "text"; empty for any
 };
 
 struct SearchResult {
     std::string path;
     std::string name;
     std::string type;
+    std::string mime;  // set when the search filtered by MIME type
     size_t size;
     std::vector<std::pair<int, std::string>> content_matches; // line number, matching line
 };
@@ -35,7 +37,8 @@ private:
 
     bool matchesCriteria(const std::string& path, const struct stat& file_stat, const SearchCriteria& criteria);
     bool matchesNamePattern(const std::string& name, const SearchCriteria& criteria);
-    std::vector<std::pair<int, std::string>> searchInFile(const std::string& file_path, const SearchCriteria& criteria);
+    std::vector<std::pair<int, std::string>> searchInFile(const std::string& file_path, const SearchCriteria& criteria,
+                                                          const std::string& head = "");
     void searchInDirectory(const std::string& dir_path, const SearchCriteria& criteria, std::vector<SearchResult>& results);
     std::string globToRegex(const std::string& glob_pattern);
 
@@ -0,0 +1,55 @@
+#ifndef SECURE_ERASER_H
+#define SECURE_ERASER_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include "FileOperations.h"
+
+// Overwrites files in place with random data before unlinking them. Only
+// the data extents are written (SEEK_DATA/SEEK_HOLE): a hole has no blocks
+// to recover, and writing it would allocate new ones. Each pass is flushed
+// with fdatasync() before the next begins, so no pass can be merged away in
+// the page cache. A hard-linked file is overwritten once and every name of it
+// found below the root is unlinked; a file that also has names elsewhere is
+// left alone and reported. Files are erased in parallel.
+//
+// In-place overwriting is only meaningful where the filesystem writes in
+// place (ext4, xfs); copy-on-write filesystems and SSD remapping may keep
+// the old blocks regardless.
+class SecureEraser {
+private:
+    struct EraseJob {
+        std::vector<std::string> names;  // first one is opened for writing
+        size_t size;
+    };
+
+    struct EraseState;
+
+    size_t worker_count;
+    Throttle* throttle;
+    std::atomic<size_t> erased_files;
+    std::atomic<size_t> data_bytes;
+    std::atomic<size_t> hole_bytes;
+
+    void scanTree(EraseState& state, const std::string& path, std::vector<EraseJob>& jobs);
+    bool eraseFile(EraseState& state, const EraseJob& job, size_t passes);
+
+public:
+    explicit SecureEraser(size_t workers = 0, Throttle* throttle = nullptr);
+
+    // Erases path, a regular file or every regular file below a directory
+    // (directories and other entries are left for the caller to remove).
+    // Keeps going past failures, which are appended to errors; a file that
+    // fails is left in place. Overwritten bytes and files go to progress.
+    bool erase(const std::string& path, size_t passes, std::vector<OperationResult>& errors,
+               ProgressTracker* progress = nullptr);
+
+    // Totals of the last erase(): files unlinked, data bytes overwritten per
+    // pass, and hole bytes that needed no writing
+    size_t erasedFiles() const;
+    size_t dataBytes() const;
+    size_t holeBytes() const;
+};
+
+#endif // SECURE_ERASER_H
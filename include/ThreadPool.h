@@ -0,0 +1,55 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <chrono>
+
+// Fixed-size worker pool. Tasks must not block waiting on other tasks queued
+// in the same pool; callers that need results wait from outside the pool.
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex queue_mutex;
+    std::condition_variable task_available;
+    std::condition_variable tasks_finished;
+    size_t active_tasks;
+    bool stopping;
+
+    void workerLoop();
+    void enqueue(std::function<void()> task);
+
+public:
+    explicit ThreadPool(size_t thread_count = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <typename F>
+    auto submit(F&& task) -> std::future<decltype(task())> {
+        using Result = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> result = packaged->get_future();
+        enqueue([packaged]() { (*packaged)(); });
+        return result;
+    }
+
+    // Blocks until the queue is empty and no task is running
+    void wait();
+    // Like wait(), but gives up after timeout; returns true if the pool went idle
+    bool waitFor(std::chrono::milliseconds timeout);
+    size_t size() const;
+
+    // Worker count used when none is given: one per hardware thread
+    static size_t defaultThreadCount();
+};
+
+#endif // THREAD_POOL_H
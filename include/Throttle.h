@@ -0,0 +1,81 @@
+#ifndef THROTTLE_H
+#define THROTTLE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+
+struct ThrottleStats {
+    size_t bytes_limit = 0;    // per second, 0 = unlimited
+    size_t ops_limit = 0;
+    double bytes_rate = 0;     // measured over the last sample window
+    double ops_rate = 0;
+    size_t bytes_total = 0;    // charged since the throttle was created
+    size_t ops_total = 0;
+    double waited_seconds = 0; // time callers spent sleeping off their debt
+    bool idle_priority = false;
+};
+
+// Token buckets on bytes and operations per second, shared by every thread
+// that charges them. A caller takes what it needs up front and sleeps off any
+// debt, so a request larger than the burst waits in proportion instead of
+// failing, and concurrent callers queue up behind each other's debt.
+class Throttle {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Bucket {
+        size_t limit = 0;
+        double tokens = 0;
+    };
+
+    // Unused allowance carried over, in seconds of the limit
+    static constexpr double BURST_SECONDS = 0.1;
+    // Rates are measured over windows of at least this long
+    static constexpr double SAMPLE_SECONDS = 0.5;
+
+    std::mutex mutex;
+    std::atomic<bool> limited;        // lets unlimited callers skip the lock
+    std::atomic<size_t> chunk_bytes;  // chunkSize() cap, 0 = none
+    Bucket bytes;
+    Bucket ops;
+    Clock::time_point last_refill;
+    double waited;
+    bool idle_priority;
+
+    std::atomic<size_t> bytes_total;
+    std::atomic<size_t> ops_total;
+    Clock::time_point sample_start;
+    size_t sample_bytes;
+    size_t sample_ops;
+    double bytes_rate;
+    double ops_rate;
+
+    void refill(Bucket& bucket, double elapsed);
+
+public:
+    Throttle();
+
+    Throttle(const Throttle&) = delete;
+    Throttle& operator=(const Throttle&) = delete;
+
+    // 0 removes a limit; takes effect for the next charge
+    void setLimits(size_t bytes_per_second, size_t ops_per_second);
+    bool isLimited() const;
+
+    // Largest transfer worth issuing at once: about 1/20 s of the byte limit,
+    // so waits stay short and even
+    size_t chunkSize(size_t preferred) const;
+
+    // Charges bytes and ops, sleeping until the limits allow them
+    void acquire(size_t byte_count, size_t op_count = 1);
+
+    // Moves the calling thread to the idle I/O scheduling class (or back to
+    // the default); threads it starts afterwards inherit the class
+    bool setIdlePriority(bool idle);
+
+    ThrottleStats stats();
+};
+
+#endif // THROTTLE_H
@@ -0,0 +1,73 @@
+#ifndef TREE_MOVER_H
+#define TREE_MOVER_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <atomic>
+#include "FileOperations.h"
+
+// Moves a file or tree to another filesystem without ever holding two full
+// copies: each source file is deleted as soon as its copy is durable, so the
+// extra space in use at any moment is bounded by the files in flight.
+//
+// Progress is appended to a journal next to the destination
+// (".<name>.move-journal"). Records are written only after the data they
+// describe has reached the disk, and a large file's source is only punched
+// behind a checkpoint record that was written in full and synced, so the
+// source never gives up data the journal cannot lead back to. Running the same move again after an interruption
+// skips what the journal and the shrinking source tree say is done, and
+// continues large files from their last checkpoint. Large files also give up
+// their space as they go, so one huge file costs no more than a checkpoint.
+class TreeMover {
+private:
+    struct MoveJob {
+        std::string relative;  // path below the source root, "" for a single file
+        size_t size;
+        mode_t mode;
+    };
+
+    struct MoveState;
+
+    // Small files are committed in groups: copied, made durable with one
+    // syncfs() of the destination filesystem, journaled, then unlinked
+    static constexpr size_t GROUP_FILES = 128;
+    static constexpr size_t GROUP_BYTES = 64 * 1024 * 1024;
+    // Larger files are copied alone, checkpointed this often, and the source
+    // is hole-punched behind each checkpoint unless it has other hard links
+    static constexpr size_t CHECKPOINT_BYTES = 256 * 1024 * 1024;
+
+    const CopyEngine& copy_engine;
+    size_t worker_count;
+    size_t resumed_files;
+    size_t moved_files;
+
+    static std::string journalPath(const std::string& destination);
+    bool openJournal(MoveState& state, std::vector<OperationResult>& errors);
+    bool appendJournal(MoveState& state, char type, const std::string& relative, uint64_t offset);
+    void scanTree(MoveState& state, const std::string& relative, std::vector<MoveJob>& files,
+                  std::vector<MoveJob>& directories);
+    bool copyEntry(MoveState& state, CopyEngine& engine, const MoveJob& job, size_t start);
+    void moveGroup(MoveState& state, const std::vector<const MoveJob*>& group);
+    void moveLarge(MoveState& state, const MoveJob& job);
+
+public:
+    TreeMover(const CopyEngine& engine, size_t workers = 0);
+
+    // Moves source (a file or directory) to destination, resuming an earlier
+    // interrupted move of the same pair. A new move of a directory needs the
+    // destination absent or an empty directory, as rename() does. Keeps going past failures, which are
+    // appended to errors; the journal is kept until a run finishes cleanly.
+    // Totals and moved bytes and files go to progress when one is given.
+    bool move(const std::string& source, const std::string& destination, std::vector<OperationResult>& errors,
+              ProgressTracker* progress = nullptr);
+
+    // Files completed by this run, and how many of those an earlier run had
+    // already copied
+    size_t movedFiles() const;
+    size_t resumedFiles() const;
+};
+
+#endif // TREE_MOVER_H
@@ -0,0 +1,66 @@
+#ifndef TREE_REMOVER_H
+#define TREE_REMOVER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "FileOperations.h"
+
+// Deletes directory trees relative to directory file descriptors: entries are
+// classified by d_type (fstatat only when the filesystem leaves it unknown),
+// removed with unlinkat(), and symlinks are never followed. The top of a tree
+// fans out across a worker pool; deeper levels are removed serially inside
+// each task so the number of open directories stays bounded.
+//
+// Trees can also be renamed aside and deleted by a background thread, which
+// is joined (finishing the queue) when the remover is destroyed.
+class TreeRemover {
+private:
+    struct RemoveState;
+    struct RemoveNode;
+
+    // Directories held open for parallel fan-out; beyond this, removal is serial
+    static constexpr size_t MAX_OPEN_DIRECTORIES = 256;
+
+    size_t worker_count;
+
+    std::thread background_thread;
+    std::deque<std::string> background_queue;
+    std::mutex background_mutex;
+    std::condition_variable background_ready;
+    std::condition_variable background_idle;
+    bool background_busy;
+    bool stopping;
+
+    void removeNode(RemoveState& state, RemoveNode* node);
+    void finishNode(RemoveState& state, RemoveNode* node);
+    bool removeSerial(RemoveState& state, int parent_fd, const char* name, const std::string& path);
+    void backgroundLoop();
+
+public:
+    explicit TreeRemover(size_t workers = 0);
+    ~TreeRemover();
+
+    TreeRemover(const TreeRemover&) = delete;
+    TreeRemover& operator=(const TreeRemover&) = delete;
+
+    void setWorkerCount(size_t count);
+
+    // Removes the directory at path and everything below it. Keeps going past
+    // failures; each one is appended to errors. Returns true if path is gone.
+    bool removeTree(const std::string& path, std::vector<OperationResult>& errors);
+
+    // Renames path to a hidden sibling and queues it for background deletion.
+    // Returns the new name, or an empty string with errno set on failure.
+    std::string removeLater(const std::string& path);
+
+    // Number of trees still waiting to be deleted, and a way to wait for them
+    size_t pendingCount();
+    void waitIdle();
+};
+
+#endif // TREE_REMOVER_H
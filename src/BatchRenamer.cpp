@@ -0,0 +1,467 @@
+#include "BatchRenamer.h"
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const char LOG_MAGIC[8] = {'F', 'E', 'B', 'R', 'E', 'N', '0', '1'};
+
+// Appended to the log after the step list, one byte per step
+static const char MARK_DONE = 'D';
+static const char MARK_UNDONE = 'U';
+
+static const size_t NO_ENTRY = SIZE_MAX;
+
+static std::string joinPath(const std::string& dir, const std::string& name) {
+    return dir == "/" ? dir + name : dir + "/" + name;
+}
+
+static void addError(std::vector<OperationResult>& errors, const std::string& path, int code,
+                     const std::string& message) {
+    errors.emplace_back(false, message + ": " + strerror(code), code);
+    errors.back().path = path;
+}
+
+// Each marker is on disk before the next step starts, so at most the step
+// in flight at a crash is unrecorded
+static bool appendMark(int fd, char mark) {
+    return write(fd, &mark, 1) == 1 && fdatasync(fd) == 0;
+}
+
+static void appendString(std::string& out, const std::string& text) {
+    uint32_t length = text.size();
+    out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    out += text;
+}
+
+static bool readString(const std::string& in, size_t& position, std::string& text) {
+    uint32_t length;
+    if (position + sizeof(length) > in.size()) return false;
+    memcpy(&length, in.data() + position, sizeof(length));
+    position += sizeof(length);
+    if (position + length > in.size()) return false;
+    text.assign(in, position, length);
+    position += length;
+    return true;
+}
+
+BatchRenamer::BatchRenamer() : renamed(0), exchanged(0), skipped(0) {
+}
+
+BatchRenamer::~BatchRenamer() {
+    closeDirs();
+}
+
+bool BatchRenamer::splitPath(const std::string& path, std::string& dir, std::string& name,
+                             std::vector<OperationResult>& errors) {
+    std::string trimmed = path;
+    while (trimmed.size() > 1 && trimmed.back() == '/') trimmed.pop_back();
+    size_t slash = trimmed.rfind('/');
+    std::string parent = slash == std::string::npos ? "." : (slash == 0 ? "/" : trimmed.substr(0, slash));
+    name = slash == std::string::npos ? trimmed : trimmed.substr(slash + 1);
+    if (name.empty() || name == "." || name == "..") {
+        addError(errors, path, EINVAL, "Not a name that can be renamed");
+        return false;
+    }
+
+    // Canonical parents make "a/x", "./a/x" and "a/../a/x" the same name
+    auto cached = canonical_dirs.find(parent);
+    if (cached == canonical_dirs.end()) {
+        char* resolved = realpath(parent.c_str(), nullptr);
+        if (!resolved) {
+            addError(errors, path, errno, "Parent directory not found");
+            return false;
+        }
+        cached = canonical_dirs.emplace(parent, resolved).first;
+        free(resolved);
+    }
+    dir = cached->second;
+    return true;
+}
+
+int BatchRenamer::dirFd(const std::string& dir) {
+    auto found = dir_fds.find(dir);
+    if (found != dir_fds.end()) {
+        return found->second;
+    }
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        dir_fds.emplace(dir, fd);
+    }
+    return fd;
+}
+
+void BatchRenamer::closeDirs() {
+    for (const auto& entry : dir_fds) {
+        close(entry.second);
+    }
+    dir_fds.clear();
+}
+
+bool BatchRenamer::plan(const std::vector<std::pair<std::string, std::string>>& pairs,
+                        std::vector<OperationResult>& errors) {
+    entries.clear();
+    steps.clear();
+    renamed = 0;
+    exchanged = 0;
+    skipped = 0;
+    size_t first_error = errors.size();
+
+    std::unordered_map<std::string, size_t> by_source;
+    std::unordered_map<std::string, size_t> by_destination;
+    std::unordered_set<std::string> moved_dirs;
+    std::vector<std::pair<std::string, std::string>> paths;  // canonical, per entry
+
+    for (const auto& pair : pairs) {
+        Entry entry;
+        if (!splitPath(pair.first, entry.from_dir, entry.from_name, errors) ||
+            !splitPath(pair.second, entry.to_dir, entry.to_name, errors)) {
+            continue;
+        }
+        std::string from = joinPath(entry.from_dir, entry.from_name);
+        std::string to = joinPath(entry.to_dir, entry.to_name);
+        if (from == to) {
+            skipped++;
+            continue;
+        }
+
+        if (dir_fds.size() >= MAX_OPEN_DIRECTORIES - 1) closeDirs();
+        int from_fd = dirFd(entry.from_dir);
+        int to_fd = dirFd(entry.to_dir);
+        struct stat source_stat, parent_stat;
+        if (from_fd < 0 || fstatat(from_fd, entry.from_name.c_str(), &source_stat, AT_SYMLINK_NOFOLLOW) != 0) {
+            addError(errors, from, errno, "Source not found");
+            continue;
+        }
+        if (to_fd < 0 || fstat(to_fd, &parent_stat) != 0) {
+            addError(errors, entry.to_dir, errno, "Cannot open destination directory");
+            continue;
+        }
+        if (source_stat.st_dev != parent_stat.st_dev) {
+            addError(errors, from, EXDEV, "Destination " + to + " is on another filesystem");
+            continue;
+        }
+        if (by_source.count(from)) {
+            addError(errors, from, EINVAL, "Listed twice as a source");
+            continue;
+        }
+        if (by_destination.count(to)) {
+            addError(errors, to, EEXIST, "Two entries move to this name");
+            continue;
+        }
+
+        by_source.emplace(from, entries.size());
+        by_destination.emplace(to, entries.size());
+        if (S_ISDIR(source_stat.st_mode)) moved_dirs.insert(from);
+        entries.push_back(std::move(entry));
+        paths.emplace_back(std::move(from), std::move(to));
+    }
+
+    // Anything under a moved directory would change path mid-batch
+    auto insideMovedDir = [&moved_dirs](std::string dir) {
+        while (!moved_dirs.empty()) {
+            if (moved_dirs.count(dir)) return true;
+            size_t slash = dir.rfind('/');
+            if (slash == 0 || slash == std::string::npos) return false;
+            dir.resize(slash);
+        }
+        return false;
+    };
+
+    std::vector<size_t> next(entries.size(), NO_ENTRY);
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Entry& entry = entries[i];
+        const std::string& to = paths[i].second;
+        auto vacated = by_source.find(to);
+        if (vacated != by_source.end()) {
+            next[i] = vacated->second;
+        } else {
+            if (dir_fds.size() >= MAX_OPEN_DIRECTORIES) closeDirs();
+            struct stat existing;
+            int to_fd = dirFd(entry.to_dir);
+            if (to_fd >= 0 && fstatat(to_fd, entry.to_name.c_str(), &existing, AT_SYMLINK_NOFOLLOW) == 0) {
+                addError(errors, to, EEXIST, "Destination exists");
+                continue;
+            }
+        }
+        if (insideMovedDir(entry.from_dir) || insideMovedDir(entry.to_dir)) {
+            addError(errors, paths[i].first, EINVAL, "Inside a directory this batch also moves; split the batch");
+        }
+    }
+
+    if (errors.size() > first_error) {
+        return false;
+    }
+    orderSteps(next);
+    return true;
+}
+
+// next[i] is the entry that must leave entry i's destination first. Every
+// destination is unique, so entries form simple chains and cycles: chains
+// run from their free end backwards, and a cycle of k entries takes k - 1
+// exchanges of its first name with each of the others in turn.
+void BatchRenamer::orderSteps(const std::vector<size_t>& next) {
+    std::vector<char> state(entries.size(), 0);  // 0 new, 1 on the current path, 2 placed
+    std::vector<size_t> path;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (state[i] != 0) continue;
+
+        path.clear();
+        size_t j = i;
+        while (j != NO_ENTRY && state[j] == 0) {
+            state[j] = 1;
+            path.push_back(j);
+            j = next[j];
+        }
+
+        size_t chain_end = path.size();
+        if (j != NO_ENTRY && state[j] == 1) {
+            size_t start = 0;
+            while (path[start] != j) start++;
+            for (size_t m = start + 1; m < path.size(); m++) {
+                steps.push_back({StepKind::Exchange, path[start], path[m]});
+            }
+            for (size_t m = start; m < path.size(); m++) state[path[m]] = 2;
+            exchanged += path.size() - start;
+            chain_end = start;
+        }
+        for (size_t k = chain_end; k-- > 0;) {
+            steps.push_back({StepKind::Rename, path[k], 0});
+            state[path[k]] = 2;
+            renamed++;
+        }
+    }
+}
+
+int BatchRenamer::applyStep(const Step& step, bool reverse) {
+    if (dir_fds.size() >= MAX_OPEN_DIRECTORIES - 1) closeDirs();
+    const Entry& entry = entries[step.entry];
+    int result;
+    if (step.kind == StepKind::Exchange) {
+        const Entry& other = entries[step.other];
+        result = renameat2(dirFd(entry.from_dir), entry.from_name.c_str(), dirFd(other.from_dir),
+                           other.from_name.c_str(), RENAME_EXCHANGE);
+    } else if (!reverse) {
+        result = renameat2(dirFd(entry.from_dir), entry.from_name.c_str(), dirFd(entry.to_dir),
+                           entry.to_name.c_str(), RENAME_NOREPLACE);
+    } else {
+        result = renameat2(dirFd(entry.to_dir), entry.to_name.c_str(), dirFd(entry.from_dir),
+                           entry.from_name.c_str(), RENAME_NOREPLACE);
+    }
+    return result == 0 ? 0 : errno;
+}
+
+bool BatchRenamer::writeLog(int fd) {
+    std::string log(LOG_MAGIC, sizeof(LOG_MAGIC));
+    uint32_t count = steps.size();
+    log.append(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const Step& step : steps) {
+        const Entry& entry = entries[step.entry];
+        log += static_cast<char>(step.kind);
+        appendString(log, joinPath(entry.from_dir, entry.from_name));
+        if (step.kind == StepKind::Exchange) {
+            appendString(log, joinPath(entries[step.other].from_dir, entries[step.other].from_name));
+        } else {
+            appendString(log, joinPath(entry.to_dir, entry.to_name));
+        }
+    }
+
+    for (size_t written = 0; written < log.size();) {
+        ssize_t n = write(fd, log.data() + written, log.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        written += n;
+    }
+    return fdatasync(fd) == 0;
+}
+
+bool BatchRenamer::execute(std::vector<OperationResult>& errors, const std::string& log_path) {
+    int log_fd = -1;
+    if (!log_path.empty()) {
+        // An existing log belongs to a batch that never finished
+        log_fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (log_fd < 0) {
+            addError(errors, log_path, errno, errno == EEXIST ? "Undo log of an unfinished batch exists"
+                                                              : "Cannot create undo log");
+            return false;
+        }
+        if (!writeLog(log_fd)) {
+            addError(errors, log_path, errno, "Cannot write undo log");
+            close(log_fd);
+            unlink(log_path.c_str());
+            return false;
+        }
+    }
+
+    size_t done = 0;
+    int err = 0;
+    for (; done < steps.size(); done++) {
+        err = applyStep(steps[done], false);
+        if (err != 0) {
+            const Entry& entry = entries[steps[done].entry];
+            addError(errors, joinPath(entry.from_dir, entry.from_name), err,
+                     steps[done].kind == StepKind::Exchange ? "Exchange failed" : "Rename failed");
+            break;
+        }
+        if (log_fd >= 0 && !appendMark(log_fd, MARK_DONE)) {
+            err = errno;
+            addError(errors, log_path, err, "Cannot write undo log");
+            done++;
+            break;
+        }
+    }
+
+    // Roll back newest first, so every name is free again when its turn comes
+    bool clean = true;
+    while (err != 0 && done > 0) {
+        done--;
+        int undo_err = applyStep(steps[done], true);
+        if (undo_err != 0) {
+            const Entry& entry = entries[steps[done].entry];
+            addError(errors, joinPath(entry.to_dir, entry.to_name), undo_err, "Could not roll back");
+            clean = false;
+            break;
+        }
+        if (log_fd >= 0 && !appendMark(log_fd, MARK_UNDONE)) {
+            addError(errors, log_path, errno, "Cannot write undo log");
+            clean = false;
+            break;
+        }
+    }
+    closeDirs();
+
+    if (log_fd >= 0) {
+        close(log_fd);
+        if (clean) unlink(log_path.c_str());
+    }
+    if (err != 0) {
+        renamed = 0;
+        exchanged = 0;
+    }
+    return err == 0;
+}
+
+bool BatchRenamer::undo(const std::string& log_path, std::vector<OperationResult>& errors, size_t& undone) {
+    undone = 0;
+    int fd = open(log_path.c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+    if (fd < 0) {
+        addError(errors, log_path, errno, "Cannot open undo log");
+        return false;
+    }
+    std::string log;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0 || (n < 0 && errno == EINTR)) {
+        if (n > 0) log.append(buffer, n);
+    }
+
+    struct LoggedStep {
+        char kind;
+        std::string first;
+        std::string second;
+    };
+    std::vector<LoggedStep> logged;
+    size_t position = sizeof(LOG_MAGIC) + sizeof(uint32_t);
+    uint32_t count = 0;
+    bool valid = log.size() >= position && memcmp(log.data(), LOG_MAGIC, sizeof(LOG_MAGIC)) == 0;
+    if (valid) memcpy(&count, log.data() + sizeof(LOG_MAGIC), sizeof(count));
+    for (uint32_t i = 0; valid && i < count; i++) {
+        LoggedStep step;
+        step.kind = log[position++];
+        valid = position <= log.size() && readString(log, position, step.first) &&
+                readString(log, position, step.second);
+        logged.push_back(std::move(step));
+    }
+    if (!valid) {
+        addError(errors, log_path, EINVAL, "Not a batch rename log");
+        close(fd);
+        return false;
+    }
+
+    size_t applied = 0;
+    bool rolling_back = false;
+    for (; position < log.size(); position++) {
+        if (log[position] == MARK_DONE) {
+            applied++;
+        } else if (log[position] == MARK_UNDONE && applied > 0) {
+            applied--;
+            rolling_back = true;
+        }
+    }
+
+    // The step in flight at the crash may have run without being marked: the
+    // next one going forward, the last one done while rolling back. A rename
+    // shows which by where the name is now; an exchange, or a rename with
+    // both or neither name present, cannot be told and the log is kept.
+    size_t pending = rolling_back ? applied - 1 : applied;
+    if ((rolling_back ? applied > 0 : applied < logged.size())) {
+        const LoggedStep& step = logged[pending];
+        struct stat st;
+        bool at_first = lstat(step.first.c_str(), &st) == 0;
+        bool at_second = lstat(step.second.c_str(), &st) == 0;
+        bool known = step.kind == static_cast<char>(StepKind::Rename) && at_first != at_second;
+        if (!known) {
+            errors.emplace_back(false, "Cannot tell whether the step to " + step.second + " ran; log kept", EAGAIN);
+            errors.back().path = step.first;
+            close(fd);
+            return false;
+        }
+        if (at_second && !rolling_back) {
+            if (!appendMark(fd, MARK_DONE)) {
+                addError(errors, log_path, errno, "Cannot write undo log");
+                close(fd);
+                return false;
+            }
+            applied++;
+        } else if (at_first && rolling_back) {
+            if (!appendMark(fd, MARK_UNDONE)) {
+                addError(errors, log_path, errno, "Cannot write undo log");
+                close(fd);
+                return false;
+            }
+            applied--;
+        }
+    }
+
+    bool success = true;
+    while (applied > 0) {
+        const LoggedStep& step = logged[--applied];
+        int result = step.kind == static_cast<char>(StepKind::Exchange)
+            ? renameat2(AT_FDCWD, step.first.c_str(), AT_FDCWD, step.second.c_str(), RENAME_EXCHANGE)
+            : renameat2(AT_FDCWD, step.second.c_str(), AT_FDCWD, step.first.c_str(), RENAME_NOREPLACE);
+        if (result != 0) {
+            addError(errors, step.second, errno, "Could not roll back");
+            success = false;
+            break;
+        }
+        undone++;
+        if (!appendMark(fd, MARK_UNDONE)) {
+            addError(errors, log_path, errno, "Cannot write undo log");
+            success = false;
+            break;
+        }
+    }
+    close(fd);
+    if (success) unlink(log_path.c_str());
+    return success;
+}
+
+size_t BatchRenamer::renamedCount() const {
+    return renamed;
+}
+
+size_t BatchRenamer::exchangedCount() const {
+    return exchanged;
+}
+
+size_t BatchRenamer::skippedCount() const {
+    return skipped;
+}
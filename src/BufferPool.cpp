@@ -0,0 +1,100 @@
+#include "BufferPool.h"
+#include <algorithm>
+#include <cstdlib>
+
+BufferPool::Buffer::Buffer(Buffer&& other) noexcept
+    : pool(other.pool), memory(other.memory), capacity(other.capacity) {
+    other.memory = nullptr;
+    other.capacity = 0;
+}
+
+BufferPool::Buffer& BufferPool::Buffer::operator=(Buffer&& other) noexcept {
+    if (this != &other) {
+        reset();
+        pool = other.pool;
+        memory = other.memory;
+        capacity = other.capacity;
+        other.memory = nullptr;
+        other.capacity = 0;
+    }
+    return *this;
+}
+
+BufferPool::Buffer::~Buffer() {
+    reset();
+}
+
+void BufferPool::Buffer::reset() {
+    if (memory) {
+        pool->release(memory, capacity);
+    }
+    memory = nullptr;
+    capacity = 0;
+}
+
+BufferPool::BufferPool() : retained_bytes(0) {
+}
+
+BufferPool::~BufferPool() {
+    for (auto& list : free_lists) {
+        for (char* memory : list) free(memory);
+    }
+}
+
+BufferPool& BufferPool::shared() {
+    static BufferPool pool;
+    return pool;
+}
+
+static size_t sizeClass(size_t size) {
+    size_t index = 0;
+    while ((BufferPool::MIN_SIZE << index) < size && (BufferPool::MIN_SIZE << index) < BufferPool::MAX_SIZE) {
+        index++;
+    }
+    return index;
+}
+
+BufferPool::Buffer BufferPool::acquire(size_t size) {
+    size_t index = sizeClass(size);
+    size_t capacity = MIN_SIZE << index;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!free_lists[index].empty()) {
+            char* memory = free_lists[index].back();
+            free_lists[index].pop_back();
+            retained_bytes -= capacity;
+            return Buffer(this, memory, capacity);
+        }
+    }
+
+    void* memory = nullptr;
+    if (posix_memalign(&memory, ALIGNMENT, capacity) != 0) {
+        return Buffer();
+    }
+    return Buffer(this, static_cast<char*>(memory), capacity);
+}
+
+void BufferPool::release(char* memory, size_t size) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (retained_bytes + size <= MAX_RETAINED) {
+            free_lists[sizeClass(size)].push_back(memory);
+            retained_bytes += size;
+            return;
+        }
+    }
+    free(memory);
+}
+
+size_t BufferPool::adaptiveSize(size_t file_size, blksize_t io_size, bool direct) {
+    // An eighth of the file, so mid-sized files still take a few calls and
+    // small ones do not tie up a large buffer
+    size_t size = std::clamp(file_size / 8, MIN_SIZE, direct ? DIRECT_MAX : CACHED_MAX);
+    size = std::max(size, std::min(static_cast<size_t>(io_size > 0 ? io_size : 0), MAX_SIZE));
+    return MIN_SIZE << sizeClass(size);
+}
+
+size_t BufferPool::retainedBytes() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return retained_bytes;
+}
@@ -0,0 +1,326 @@
+#include "Checksum.h"
+#include <algorithm>
+#include <cstring>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Unaligned little-endian loads (memcpy compiles to a single mov on x86)
+static inline uint64_t read64(const unsigned char* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t read32(const unsigned char* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t input) {
+    acc += input * PRIME64_2;
+    acc = rotateLeft(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t mergeRound(uint64_t acc, uint64_t lane) {
+    acc ^= round64(0, lane);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+XXHash64::XXHash64(uint64_t seed_value) : seed(seed_value) {
+    reset();
+}
+
+void XXHash64::reset() {
+    lanes[0] = seed + PRIME64_1 + PRIME64_2;
+    lanes[1] = seed + PRIME64_2;
+    lanes[2] = seed;
+    lanes[3] = seed - PRIME64_1;
+    pending_size = 0;
+    total_size = 0;
+}
+
+void XXHash64::update(const void* data, size_t length) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + length;
+    total_size += length;
+
+    if (pending_size + length < 32) {
+        memcpy(pending + pending_size, p, length);
+        pending_size += length;
+        return;
+    }
+
+    if (pending_size > 0) {
+        size_t fill = 32 - pending_size;
+        memcpy(pending + pending_size, p, fill);
+        p += fill;
+        for (int i = 0; i < 4; i++) {
+            lanes[i] = round64(lanes[i], read64(pending + i * 8));
+        }
+        pending_size = 0;
+    }
+
+    // Four independent lanes keep the multipliers busy in parallel
+    uint64_t v1 = lanes[0], v2 = lanes[1], v3 = lanes[2], v4 = lanes[3];
+    while (end - p >= 32) {
+        v1 = round64(v1, read64(p));
+        v2 = round64(v2, read64(p + 8));
+        v3 = round64(v3, read64(p + 16));
+        v4 = round64(v4, read64(p + 24));
+        p += 32;
+    }
+    lanes[0] = v1; lanes[1] = v2; lanes[2] = v3; lanes[3] = v4;
+
+    pending_size = end - p;
+    memcpy(pending, p, pending_size);
+}
+
+uint64_t XXHash64::digest() const {
+    uint64_t h;
+    if (total_size >= 32) {
+        h = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) + rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+        for (int i = 0; i < 4; i++) {
+            h = mergeRound(h, lanes[i]);
+        }
+    } else {
+        h = seed + PRIME64_5;
+    }
+    h += total_size;
+
+    const unsigned char* p = pending;
+    const unsigned char* end = pending + pending_size;
+    while (end - p >= 8) {
+        h ^= round64(0, read64(p));
+        h = rotateLeft(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if (end - p >= 4) {
+        h ^= static_cast<uint64_t>(read32(p)) * PRIME64_1;
+        h = rotateLeft(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= *p * PRIME64_5;
+        h = rotateLeft(h, 11) * PRIME64_1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t XXHash64::hash(const void* data, size_t length, uint64_t seed) {
+    XXHash64 hasher(seed);
+    hasher.update(data, length);
+    return hasher.digest();
+}
+
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotateRight(uint32_t value, int bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+static void compressBlock(uint32_t state[8], const unsigned char* block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (static_cast<uint32_t>(block[i * 4]) << 24) | (static_cast<uint32_t>(block[i * 4 + 1]) << 16) |
+               (static_cast<uint32_t>(block[i * 4 + 2]) << 8) | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotateRight(w[i - 15], 7) ^ rotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotateRight(w[i - 2], 17) ^ rotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+        uint32_t choice = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + choice + SHA256_K[i] + w[i];
+        uint32_t s0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+        uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + majority;
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+Sha256::Sha256() {
+    reset();
+}
+
+void Sha256::reset() {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(state, initial, sizeof(state));
+    pending_size = 0;
+    total_size = 0;
+}
+
+#if defined(__x86_64__)
+// Two rounds per sha256rnds2; the state lives in ABEF/CDGH register order
+__attribute__((target("sha,sse4.1")))
+static void compressShaExtensions(uint32_t state[8], const unsigned char* data, size_t count) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0])), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4])), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; count > 0; count--, data += 64) {
+        __m128i abef = state0;
+        __m128i cdgh = state1;
+        __m128i words[4];
+        for (int i = 0; i < 16; i++) {
+            __m128i w;
+            if (i < 4) {
+                w = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 16)), byte_swap);
+            } else {
+                w = _mm_sha256msg1_epu32(words[i & 3], words[(i + 1) & 3]);
+                w = _mm_add_epi32(w, _mm_alignr_epi8(words[(i + 3) & 3], words[(i + 2) & 3], 4));
+                w = _mm_sha256msg2_epu32(w, words[(i + 3) & 3]);
+            }
+            words[i & 3] = w;
+
+            __m128i wk = _mm_add_epi32(w, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&SHA256_K[i * 4])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(wk, 0x0E));
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), _mm_blend_epi16(tmp, state1, 0xF0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), _mm_alignr_epi8(state1, tmp, 8));
+}
+
+static bool hasShaExtensions() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    bool sha = ebx & (1u << 29);
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+    return sha && (ecx & bit_SSE4_1) && (ecx & bit_SSSE3);
+}
+#endif
+
+void Sha256::compress(const unsigned char* blocks, size_t count) {
+#if defined(__x86_64__)
+    static const bool use_extensions = hasShaExtensions();
+    if (use_extensions) {
+        compressShaExtensions(state, blocks, count);
+        return;
+    }
+#endif
+    for (; count > 0; count--, blocks += 64) {
+        compressBlock(state, blocks);
+    }
+}
+
+void Sha256::update(const void* data, size_t length) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    total_size += length;
+
+    if (pending_size > 0) {
+        size_t fill = std::min(length, sizeof(pending) - pending_size);
+        memcpy(pending + pending_size, p, fill);
+        pending_size += fill;
+        p += fill;
+        length -= fill;
+        if (pending_size < sizeof(pending)) {
+            return;
+        }
+        compress(pending, 1);
+        pending_size = 0;
+    }
+
+    // Whole blocks straight from the caller's buffer
+    size_t blocks = length / sizeof(pending);
+    compress(p, blocks);
+    p += blocks * sizeof(pending);
+    length -= blocks * sizeof(pending);
+    memcpy(pending, p, length);
+    pending_size = length;
+}
+
+void Sha256::digest(unsigned char out[DIGEST_SIZE]) const {
+    // Pad a copy, so the running state can still be extended
+    Sha256 final_state = *this;
+    uint64_t bit_length = total_size * 8;
+    unsigned char padding[72] = {0x80};
+    size_t padding_size = (pending_size < 56 ? 56 : 120) - pending_size;
+    for (int i = 0; i < 8; i++) {
+        padding[padding_size + i] = static_cast<unsigned char>(bit_length >> (56 - i * 8));
+    }
+    final_state.update(padding, padding_size + 8);
+
+    for (int i = 0; i < 8; i++) {
+        out[i * 4] = static_cast<unsigned char>(final_state.state[i] >> 24);
+        out[i * 4 + 1] = static_cast<unsigned char>(final_state.state[i] >> 16);
+        out[i * 4 + 2] = static_cast<unsigned char>(final_state.state[i] >> 8);
+        out[i * 4 + 3] = static_cast<unsigned char>(final_state.state[i]);
+    }
+}
+
+const char* checksumAlgorithmName(ChecksumAlgorithm algorithm) {
+    switch (algorithm) {
+        case ChecksumAlgorithm::SHA256: return "sha256";
+        default: return "xxh64";
+    }
+}
+
+std::string digestToHex(const unsigned char* digest, size_t length) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(length * 2, '0');
+    for (size_t i = 0; i < length; i++) {
+        hex[i * 2] = digits[digest[i] >> 4];
+        hex[i * 2 + 1] = digits[digest[i] & 0xf];
+    }
+    return hex;
+}
+
+std::string digestToHex(uint64_t digest) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (int i = 15; i >= 0; i--) {
+        hex[i] = digits[digest & 0xf];
+        digest >>= 4;
+    }
+    return hex;
+}
@@ -0,0 +1,558 @@
+#include "CopyEngine.h"
+#include "Checksum.h"
+#include "IoRing.h"
+#include "Throttle.h"
+#include "BufferPool.h"
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+#include <linux/magic.h>
+
+const char* copyMethodName(CopyMethod method) {
+    switch (method) {
+        case CopyMethod::Reflink: return "reflink";
+        case CopyMethod::CopyFileRange: return "copy_file_range";
+        case CopyMethod::IoUring: return "io_uring";
+        case CopyMethod::Sendfile: return "sendfile";
+        case CopyMethod::ReadWrite: return "read/write";
+        default: return "none";
+    }
+}
+
+const char* cacheModeName(CacheMode mode) {
+    switch (mode) {
+        case CacheMode::DropBehind: return "drop-behind";
+        case CacheMode::Direct: return "direct";
+        default: return "cached";
+    }
+}
+
+// Errors meaning "this mechanism does not work for this pair of files",
+// as opposed to a real I/O failure that should abort the copy
+static bool isUnsupportedError(int err) {
+    return err == ENOSYS || err == EOPNOTSUPP || err == ENOTSUP || err == EXDEV ||
+           err == EINVAL || err == ENOTTY;
+}
+
+CopyEngine::CopyEngine(size_t size)
+    : buffer_size(size), cache_mode(CacheMode::Normal), drop_start(0), drop_end(0), hole_bytes(0), hole_end(0),
+      checksum(nullptr), throttle(nullptr),
+      queue_depth(RingCopier::DEFAULT_QUEUE_DEPTH), batching(false), batch_files(0) {
+    std::fill(std::begin(method_enabled), std::end(method_enabled), true);
+}
+
+CopyEngine::CopyEngine(const CopyEngine& other)
+    : buffer_size(other.buffer_size), cache_mode(other.cache_mode), drop_start(0), drop_end(0), hole_bytes(0), hole_end(0),
+      checksum(nullptr), throttle(other.throttle),
+      queue_depth(other.queue_depth), batching(false), batch_files(0) {
+    std::copy(std::begin(other.method_enabled), std::end(other.method_enabled), std::begin(method_enabled));
+}
+
+CopyEngine& CopyEngine::operator=(const CopyEngine& other) {
+    buffer_size = other.buffer_size;
+    cache_mode = other.cache_mode;
+    throttle = other.throttle;
+    std::copy(std::begin(other.method_enabled), std::end(other.method_enabled), std::begin(method_enabled));
+    if (queue_depth != other.queue_depth) {
+        queue_depth = other.queue_depth;
+        ring.reset();
+    }
+    return *this;
+}
+
+// Setting up a ring and pinning its buffers costs milliseconds, more than
+// copying a batch of small files, so a finished engine leaves its ring to the
+// next engine created on the same thread
+static thread_local std::unique_ptr<RingCopier> spare_ring;
+
+CopyEngine::~CopyEngine() {
+    if (ring && ring->isReady()) {
+        spare_ring = std::move(ring);
+    }
+}
+
+void CopyEngine::setQueueDepth(size_t depth) {
+    if (depth != queue_depth) {
+        queue_depth = std::max<size_t>(depth, 1);
+        ring.reset();
+    }
+}
+
+size_t CopyEngine::getQueueDepth() const {
+    return queue_depth;
+}
+
+void CopyEngine::beginBatch() {
+    batching = true;
+    batch_files = 0;
+    batch_job_files.clear();
+}
+
+bool CopyEngine::finishBatch(std::vector<std::pair<size_t, int>>& failures) {
+    batching = false;
+    if (batch_job_files.empty()) {
+        return true;
+    }
+
+    ring->run();
+    for (size_t job = 0; job < ring->jobCount(); job++) {
+        int err = ring->jobError(job);
+        // A file with several extents fails once
+        if (err != 0 && (failures.empty() || failures.back().first != batch_job_files[job])) {
+            failures.emplace_back(batch_job_files[job], err);
+        }
+    }
+    ring->clear();
+    batch_job_files.clear();
+    return failures.empty();
+}
+
+void CopyEngine::setMethodEnabled(CopyMethod method, bool enabled) {
+    // The read/write loop is the last resort and always stays available
+    if (method != CopyMethod::ReadWrite && method != CopyMethod::None) {
+        method_enabled[static_cast<int>(method)] = enabled;
+    }
+}
+
+bool CopyEngine::isMethodEnabled(CopyMethod method) const {
+    return method_enabled[static_cast<int>(method)];
+}
+
+void CopyEngine::setChecksum(XXHash64* hasher) {
+    checksum = hasher;
+}
+
+void CopyEngine::checksumZeros(size_t length) {
+    static const char zeros[64 * 1024] = {};
+    while (length > 0) {
+        size_t chunk = std::min(length, sizeof(zeros));
+        checksum->update(zeros, chunk);
+        length -= chunk;
+    }
+}
+
+void CopyEngine::setCacheMode(CacheMode mode) {
+    cache_mode = mode;
+}
+
+CacheMode CopyEngine::getCacheMode() const {
+    return cache_mode;
+}
+
+void CopyEngine::setThrottle(Throttle* shared) {
+    throttle = shared;
+}
+
+// Transfers are charged once done, so the wait for each falls before the
+// next and failed attempts cost nothing
+size_t CopyEngine::nextChunk(size_t remaining, size_t preferred) {
+    if (cache_mode != CacheMode::Normal) preferred = std::min(preferred, DROP_CHUNK_SIZE);
+    size_t chunk = std::min(remaining, preferred);
+    return throttle ? throttle->chunkSize(chunk) : chunk;
+}
+
+size_t CopyEngine::lastHoleBytes() const {
+    return hole_bytes;
+}
+
+bool CopyEngine::tryReflink(int src_fd, int dst_fd) {
+    if (throttle) throttle->acquire(0);  // shares extents: metadata only
+    return ioctl(dst_fd, FICLONE, src_fd) == 0;
+}
+
+bool CopyEngine::reflink(int src_fd, int dst_fd) {
+    return !checksum && isMethodEnabled(CopyMethod::Reflink) && tryReflink(src_fd, dst_fd);
+}
+
+bool CopyEngine::copyFileRange(int src_fd, int dst_fd, size_t& offset, size_t end, const ProgressFn& progress) {
+    while (offset < end) {
+        loff_t in_off = offset;
+        loff_t out_off = offset;
+        size_t chunk = nextChunk(end - offset, KERNEL_CHUNK_SIZE);
+        ssize_t copied = copy_file_range(src_fd, &in_off, dst_fd, &out_off, chunk, 0);
+
+        if (copied < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (copied == 0) {
+            break;  // source shrank underneath us
+        }
+
+        offset += copied;
+        if (cache_mode != CacheMode::Normal) dropBehind(src_fd, dst_fd, offset - copied, offset);
+        if (throttle) throttle->acquire(copied);
+        if (progress) progress(offset, end);
+    }
+    return true;
+}
+
+bool CopyEngine::copyRing(int src_fd, int dst_fd, size_t& offset, size_t end, const ProgressFn& progress) {
+    if (!ring && spare_ring && spare_ring->queueDepth() == queue_depth) {
+        ring = std::move(spare_ring);
+    }
+    if (!ring) {
+        ring.reset(new RingCopier(queue_depth));
+    }
+    if (!ring->isReady()) {
+        errno = ENOSYS;
+        return false;
+    }
+
+    if (throttle) throttle->acquire(end - offset);  // never limited here, only counted
+    if (batching) {
+        ring->add(src_fd, dst_fd, offset, end - offset, progress);
+        batch_job_files.push_back(batch_files - 1);
+        offset = end;
+        return true;
+    }
+
+    size_t job = ring->add(src_fd, dst_fd, offset, end - offset, progress);
+    bool ok = ring->run();
+    int err = ring->jobError(job);
+    ring->clear();
+    if (!ok) {
+        errno = err;
+        return false;  // offset stays put: the next method redoes the whole range
+    }
+    offset = end;
+    return true;
+}
+
+bool CopyEngine::copySendfile(int src_fd, int dst_fd, size_t& offset, size_t end, const ProgressFn& progress) {
+    if (lseek(dst_fd, offset, SEEK_SET) < 0) {
+        return false;
+    }
+
+    while (offset < end) {
+        off_t in_off = offset;
+        size_t chunk = nextChunk(end - offset, KERNEL_CHUNK_SIZE);
+        ssize_t copied = sendfile(dst_fd, src_fd, &in_off, chunk);
+
+        if (copied < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (copied == 0) {
+            break;
+        }
+
+        offset += copied;
+        if (cache_mode != CacheMode::Normal) dropBehind(src_fd, dst_fd, offset - copied, offset);
+        if (throttle) throttle->acquire(copied);
+        if (progress) progress(offset, end);
+    }
+    return true;
+}
+
+// O_DIRECT on an open descriptor can be switched off again with F_SETFL
+static void clearDirect(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags >= 0) fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+}
+
+bool CopyEngine::copyReadWrite(int src_fd, int dst_fd, size_t& offset, size_t end, const ProgressFn& progress,
+                               bool direct) {
+    size_t size = buffer_size;
+    if (size == 0) {
+        struct stat dst_stat;
+        size = BufferPool::adaptiveSize(end - offset, fstat(dst_fd, &dst_stat) == 0 ? dst_stat.st_blksize : 0, direct);
+    }
+    BufferPool::Buffer buffer = BufferPool::shared().acquire(size);
+    if (!buffer) {
+        errno = ENOMEM;
+        return false;
+    }
+    size = std::min(size, buffer.size());
+
+    while (offset < end) {
+        size_t chunk = nextChunk(end - offset, size);
+        // O_DIRECT moves whole blocks; reading past the end just comes up short
+        size_t request = direct ? std::min((chunk + BufferPool::ALIGNMENT - 1) & ~(BufferPool::ALIGNMENT - 1),
+                                           buffer.size())
+                                : chunk;
+        ssize_t bytes_read = pread(src_fd, buffer.data(), request, offset);
+        if (bytes_read < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EINVAL && direct) {
+                // Alignment this filesystem will not take: finish through the cache
+                clearDirect(src_fd);
+                clearDirect(dst_fd);
+                direct = false;
+                continue;
+            }
+            return false;
+        }
+        if (bytes_read == 0) {
+            break;
+        }
+        bytes_read = std::min<size_t>(bytes_read, end - offset);
+        if (checksum) {
+            checksum->update(buffer.data(), bytes_read);
+        }
+
+        ssize_t written = 0;
+        while (written < bytes_read) {
+            // A partial block (the end of the file) has to go through the cache
+            if (direct && (bytes_read - written) % BufferPool::ALIGNMENT != 0) {
+                clearDirect(src_fd);
+                clearDirect(dst_fd);
+                direct = false;
+            }
+            ssize_t n = pwrite(dst_fd, buffer.data() + written, bytes_read - written, offset + written);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EINVAL && direct) {
+                    clearDirect(src_fd);
+                    clearDirect(dst_fd);
+                    direct = false;
+                    continue;
+                }
+                return false;
+            }
+            written += n;
+        }
+
+        offset += bytes_read;
+        if (cache_mode != CacheMode::Normal) dropBehind(src_fd, dst_fd, offset - bytes_read, offset);
+        if (throttle) throttle->acquire(bytes_read);
+        if (progress) progress(offset, end);
+    }
+    return true;
+}
+
+// Clean pages can be dropped at once, dirty ones only after writeback: this
+// chunk's writeback is started, the previous chunk's is waited for and its
+// pages dropped, so the disk stays busy while at most two chunks are cached
+void CopyEngine::dropBehind(int src_fd, int dst_fd, size_t start, size_t end) {
+    posix_fadvise(src_fd, start, end - start, POSIX_FADV_DONTNEED);
+    sync_file_range(dst_fd, start, end - start, SYNC_FILE_RANGE_WRITE);
+    finishDropBehind(dst_fd);
+    drop_start = start;
+    drop_end = end;
+}
+
+void CopyEngine::finishDropBehind(int dst_fd) {
+    if (drop_end > drop_start) {
+        sync_file_range(dst_fd, drop_start, drop_end - drop_start,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(dst_fd, drop_start, drop_end - drop_start, POSIX_FADV_DONTNEED);
+    }
+    drop_start = drop_end = 0;
+}
+
+// Whether st_size says how much a read returns. Empty files are read anyway,
+// which costs one call; a size with no blocks behind it is checked against
+// the pseudo filesystems whose sizes are placeholders (procfs, sysfs...).
+static bool sizeIsReliable(int fd, const struct stat& st) {
+    if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+        return false;
+    }
+    struct statfs fs;
+    if (st.st_blocks > 0 || fstatfs(fd, &fs) != 0) {
+        return true;
+    }
+    switch (fs.f_type) {
+        case PROC_SUPER_MAGIC:
+        case SYSFS_MAGIC:
+        case DEBUGFS_MAGIC:
+        case TRACEFS_MAGIC:
+        case SECURITYFS_MAGIC:
+        case CGROUP_SUPER_MAGIC:
+        case CGROUP2_SUPER_MAGIC:
+            return false;
+        default:
+            return true;
+    }
+}
+
+CopyMethod CopyEngine::copy(int src_fd, int dst_fd, size_t size, const ProgressFn& progress) {
+    hole_bytes = 0;
+    batch_files++;
+
+    // Sources whose size cannot be trusted are streamed until EOF
+    struct stat src_stat;
+    if (size == 0 || (fstat(src_fd, &src_stat) == 0 && !sizeIsReliable(src_fd, src_stat))) {
+        ProgressFn streamed;
+        if (progress) {
+            streamed = [&progress](size_t current, size_t) { progress(current, current); };
+        }
+        size_t offset = 0;
+        if (!copyReadWrite(src_fd, dst_fd, offset, SIZE_MAX, streamed, false)) {
+            return CopyMethod::None;
+        }
+        if (progress) progress(offset, offset);
+        return CopyMethod::ReadWrite;
+    }
+
+    if (reflink(src_fd, dst_fd)) {
+        if (progress) progress(size, size);
+        return CopyMethod::Reflink;
+    }
+
+    CopyMethod method = copyRange(src_fd, dst_fd, 0, size, progress);
+
+    // A trailing hole is never written, so extend the destination over it. A
+    // copy cut short because the source shrank keeps its real length.
+    struct stat dst_stat;
+    if (method != CopyMethod::None && hole_end > 0 && fstat(dst_fd, &dst_stat) == 0 &&
+        static_cast<size_t>(dst_stat.st_size) < hole_end && ftruncate(dst_fd, hole_end) != 0) {
+        return CopyMethod::None;
+    }
+    return method;
+}
+
+CopyMethod CopyEngine::copyRange(int src_fd, int dst_fd, size_t offset, size_t length, const ProgressFn& progress) {
+    hole_bytes = 0;
+    hole_end = 0;
+
+    // Fewer allocated blocks than the size implies holes (or compression)
+    struct stat src_stat;
+    if (fstat(src_fd, &src_stat) == 0 && S_ISREG(src_stat.st_mode) &&
+        static_cast<size_t>(src_stat.st_blocks) * 512 < static_cast<size_t>(src_stat.st_size)) {
+        // Extent callbacks are temporaries, so sparse files never wait for a batch
+        bool was_batching = batching;
+        batching = false;
+        CopyMethod method = copySparse(src_fd, dst_fd, offset, length, progress);
+        batching = was_batching;
+        return method;
+    }
+    return copyExtent(src_fd, dst_fd, offset, length, progress);
+}
+
+CopyMethod CopyEngine::copySparse(int src_fd, int dst_fd, size_t offset, size_t length, const ProgressFn& progress) {
+    size_t end = offset + length;
+    size_t position = offset;
+    CopyMethod method = CopyMethod::ReadWrite;  // reported if the range is all hole
+
+    // Extent progress is relative to the extent; rebase it onto the range
+    auto rebased = [&progress, offset, length](size_t base) {
+        ProgressFn shifted;
+        if (progress) {
+            shifted = [&progress, offset, length, base](size_t current, size_t) { progress(base - offset + current, length); };
+        }
+        return shifted;
+    };
+
+    // A fresh (empty or ftruncate'd) destination already reads as zeros
+    struct stat dst_stat;
+    bool punch_holes = fstat(dst_fd, &dst_stat) == 0 && dst_stat.st_blocks > 0;
+
+    while (position < end) {
+        off_t data = lseek(src_fd, position, SEEK_DATA);
+        bool at_eof = data < 0;
+        if (at_eof) {
+            if (errno != ENXIO) {
+                // SEEK_DATA unsupported here: copy the rest densely
+                return copyExtent(src_fd, dst_fd, position, end - position, rebased(position));
+            }
+            // Nothing but hole up to EOF, which falls short of end if the source shrank
+            struct stat src_stat;
+            data = fstat(src_fd, &src_stat) == 0 ? std::max<off_t>(src_stat.st_size, position) : end;
+        }
+        size_t data_start = std::min(static_cast<size_t>(data), end);
+
+        if (data_start > position) {
+            hole_bytes += data_start - position;
+            hole_end = data_start;
+            if (checksum) checksumZeros(data_start - position);
+            if (punch_holes) {
+                fallocate(dst_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, position, data_start - position);
+            }
+        }
+        if (at_eof || data_start >= end) {
+            break;
+        }
+
+        off_t hole = lseek(src_fd, data_start, SEEK_HOLE);
+        size_t data_end = hole < 0 ? end : std::min(static_cast<size_t>(hole), end);
+
+        method = copyExtent(src_fd, dst_fd, data_start, data_end - data_start, rebased(data_start));
+        if (method == CopyMethod::None) {
+            return method;
+        }
+        position = data_end;
+    }
+
+    if (progress) progress(length, length);
+    return method;
+}
+
+CopyMethod CopyEngine::transferExtent(int src_fd, int dst_fd, size_t offset, size_t length, const ProgressFn& progress,
+                                      bool direct) {
+    size_t start = offset;
+    size_t end = offset + length;
+    ProgressFn range_progress;
+    if (progress) {
+        range_progress = [&progress, start, length](size_t current, size_t) { progress(current - start, length); };
+    }
+
+    // Each method picks up at the offset the previous one reached. Kernel
+    // copies never show the data to user space, so checksumming rules them
+    // out, and neither can do O_DIRECT.
+    if (!checksum && !direct && isMethodEnabled(CopyMethod::CopyFileRange)) {
+        if (copyFileRange(src_fd, dst_fd, offset, end, range_progress)) {
+            return CopyMethod::CopyFileRange;
+        }
+        if (!isUnsupportedError(errno)) {
+            return CopyMethod::None;
+        }
+    }
+
+    // Completions arrive out of order, which a running checksum cannot follow
+    if (!checksum && cache_mode == CacheMode::Normal && isMethodEnabled(CopyMethod::IoUring) &&
+        !(throttle && throttle->isLimited())) {
+        if (copyRing(src_fd, dst_fd, offset, end, progress ? range_progress : ProgressFn())) {
+            return CopyMethod::IoUring;
+        }
+        if (!isUnsupportedError(errno)) {
+            return CopyMethod::None;
+        }
+    }
+
+    if (!checksum && !direct && isMethodEnabled(CopyMethod::Sendfile)) {
+        if (copySendfile(src_fd, dst_fd, offset, end, range_progress)) {
+            return CopyMethod::Sendfile;
+        }
+        if (!isUnsupportedError(errno)) {
+            return CopyMethod::None;
+        }
+    }
+
+    if (copyReadWrite(src_fd, dst_fd, offset, end, range_progress, direct)) {
+        return CopyMethod::ReadWrite;
+    }
+    return CopyMethod::None;
+}
+
+CopyMethod CopyEngine::copyExtent(int src_fd, int dst_fd, size_t offset, size_t length, const ProgressFn& progress) {
+    if (cache_mode == CacheMode::Normal) {
+        return transferExtent(src_fd, dst_fd, offset, length, progress, false);
+    }
+
+    // O_DIRECT needs block-aligned offsets; filesystems without it refuse
+    // the flag, and the copy then drops pages behind itself instead
+    int src_flags = fcntl(src_fd, F_GETFL);
+    int dst_flags = fcntl(dst_fd, F_GETFL);
+    bool direct = cache_mode == CacheMode::Direct && offset % BufferPool::ALIGNMENT == 0 && src_flags >= 0 &&
+                  dst_flags >= 0 && fcntl(src_fd, F_SETFL, src_flags | O_DIRECT) == 0 &&
+                  fcntl(dst_fd, F_SETFL, dst_flags | O_DIRECT) == 0;
+
+    drop_start = drop_end = 0;
+    CopyMethod method = transferExtent(src_fd, dst_fd, offset, length, progress, direct);
+    int err = errno;
+    finishDropBehind(dst_fd);
+    if (cache_mode == CacheMode::Direct && src_flags >= 0 && dst_flags >= 0) {
+        fcntl(src_fd, F_SETFL, src_flags);
+        fcntl(dst_fd, F_SETFL, dst_flags);
+    }
+    errno = err;
+    return method;
+}
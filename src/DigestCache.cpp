@@ -0,0 +1,202 @@
+#include "DigestCache.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <ctime>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char STORE_MAGIC[8] = {'F', 'E', 'D', 'I', 'G', 'S', 'T', '1'};
+static const size_t RECORD_SIZE = 8 * sizeof(uint64_t);
+static const time_t SETTLE_SECONDS = 2;
+
+bool DigestCache::Key::operator==(const Key& other) const {
+    return device == other.device && inode == other.inode && size == other.size &&
+           mtime_sec == other.mtime_sec && mtime_nsec == other.mtime_nsec &&
+           ctime_sec == other.ctime_sec && ctime_nsec == other.ctime_nsec;
+}
+
+size_t DigestCache::KeyHash::operator()(const Key& key) const {
+    uint64_t h = key.inode * 0x9E3779B97F4A7C15ULL;
+    h ^= key.device + 0x632BE59BD9B4E019ULL + (h << 6) + (h >> 2);
+    h ^= static_cast<uint64_t>(key.mtime_nsec) + (h << 6) + (h >> 2);
+    return static_cast<size_t>(h);
+}
+
+DigestCache::DigestCache(const std::string& path)
+    : store_path(path), loaded(false), dirty(false), hits(0), misses(0) {
+}
+
+std::string DigestCache::defaultPath() {
+    const char* cache_home = getenv("XDG_CACHE_HOME");
+    std::string base;
+    if (cache_home && cache_home[0] == '/') {
+        base = cache_home;
+    } else {
+        const char* home = getenv("HOME");
+        base = std::string(home ? home : "/tmp") + "/.cache";
+    }
+    return base + "/file_explorer/digests";
+}
+
+DigestCache::Key DigestCache::makeKey(const struct stat& st) {
+    Key key;
+    key.device = st.st_dev;
+    key.inode = st.st_ino;
+    key.size = st.st_size;
+    key.mtime_sec = st.st_mtim.tv_sec;
+    key.mtime_nsec = st.st_mtim.tv_nsec;
+    key.ctime_sec = st.st_ctim.tv_sec;
+    key.ctime_nsec = st.st_ctim.tv_nsec;
+    return key;
+}
+
+void DigestCache::loadLocked() {
+    loaded = true;
+    int fd = open(store_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    char magic[sizeof(STORE_MAGIC)];
+    if (read(fd, magic, sizeof(magic)) != static_cast<ssize_t>(sizeof(magic)) ||
+        memcmp(magic, STORE_MAGIC, sizeof(magic)) != 0) {
+        close(fd);
+        return;  // unknown format: start over, save() replaces it
+    }
+
+    std::vector<char> buffer(RECORD_SIZE * 16384);
+    size_t filled = 0;
+    while (true) {
+        ssize_t n = read(fd, buffer.data() + filled, buffer.size() - filled);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        filled += n;
+
+        size_t records = filled / RECORD_SIZE;
+        for (size_t i = 0; i < records; i++) {
+            uint64_t fields[8];
+            memcpy(fields, buffer.data() + i * RECORD_SIZE, RECORD_SIZE);
+            Key key{fields[0], fields[1], fields[2], static_cast<int64_t>(fields[3]), static_cast<int64_t>(fields[4]),
+                    static_cast<int64_t>(fields[5]), static_cast<int64_t>(fields[6])};
+            entries[key] = Entry{fields[7], false};
+        }
+        filled -= records * RECORD_SIZE;
+        memmove(buffer.data(), buffer.data() + records * RECORD_SIZE, filled);
+    }
+    close(fd);
+}
+
+bool DigestCache::lookup(const struct stat& st, uint64_t& digest) {
+    std::lock_guard<std::mutex> lock(entries_mutex);
+    if (!loaded) loadLocked();
+
+    auto it = entries.find(makeKey(st));
+    if (it == entries.end()) {
+        misses++;
+        return false;
+    }
+    it->second.used = true;
+    digest = it->second.digest;
+    hits++;
+    return true;
+}
+
+void DigestCache::store(const struct stat& st, uint64_t digest) {
+    time_t now = time(nullptr);
+    if (now - st.st_mtim.tv_sec < SETTLE_SECONDS || now - st.st_ctim.tv_sec < SETTLE_SECONDS) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(entries_mutex);
+    if (!loaded) loadLocked();
+    entries[makeKey(st)] = Entry{digest, true};
+    dirty = true;
+}
+
+// mkdir -p for the directory part of path
+static bool createParents(const std::string& path) {
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        std::string dir = path.substr(0, slash);
+        if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DigestCache::save() {
+    std::lock_guard<std::mutex> lock(entries_mutex);
+    if (!dirty) {
+        return true;
+    }
+
+    if (entries.size() > MAX_ENTRIES) {
+        for (auto it = entries.begin(); it != entries.end();) {
+            it = it->second.used ? std::next(it) : entries.erase(it);
+        }
+    }
+
+    if (!createParents(store_path)) {
+        return false;
+    }
+    std::string temp_path = store_path + ".tmp." + std::to_string(getpid());
+    int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+
+    std::vector<char> buffer;
+    buffer.reserve(RECORD_SIZE * 16384);
+    buffer.insert(buffer.end(), STORE_MAGIC, STORE_MAGIC + sizeof(STORE_MAGIC));
+
+    bool ok = true;
+    auto flush = [&]() {
+        size_t written = 0;
+        while (ok && written < buffer.size()) {
+            ssize_t n = write(fd, buffer.data() + written, buffer.size() - written);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) ok = false;
+            else written += n;
+        }
+        buffer.clear();
+    };
+
+    for (const auto& item : entries) {
+        const Key& key = item.first;
+        uint64_t fields[8] = {key.device, key.inode, key.size,
+                              static_cast<uint64_t>(key.mtime_sec), static_cast<uint64_t>(key.mtime_nsec),
+                              static_cast<uint64_t>(key.ctime_sec), static_cast<uint64_t>(key.ctime_nsec),
+                              item.second.digest};
+        const char* bytes = reinterpret_cast<const char*>(fields);
+        buffer.insert(buffer.end(), bytes, bytes + RECORD_SIZE);
+        if (buffer.size() + RECORD_SIZE > buffer.capacity()) {
+            flush();
+        }
+    }
+    flush();
+
+    if (close(fd) != 0) ok = false;
+    if (!ok || rename(temp_path.c_str(), store_path.c_str()) != 0) {
+        unlink(temp_path.c_str());
+        return false;
+    }
+    dirty = false;
+    return true;
+}
+
+size_t DigestCache::size() {
+    std::lock_guard<std::mutex> lock(entries_mutex);
+    if (!loaded) loadLocked();
+    return entries.size();
+}
+
+size_t DigestCache::getHits() const {
+    return hits;
+}
+
+size_t DigestCache::getMisses() const {
+    return misses;
+}
@@ -0,0 +1,522 @@
+#include "DiskUsage.h"
+#include "ThreadPool.h"
+#include "Throttle.h"
+#include <algorithm>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Stats are charged to the throttle in groups of this many
+static const size_t THROTTLE_OPS = 64;
+
+// Directories modified this recently are not cached: a change landing in the
+// same timestamp tick as the scan would otherwise go unnoticed next time
+static const time_t CACHE_SETTLE_SECONDS = 2;
+
+struct DiskUsage::ScanState {
+    ThreadPool* pool;
+    bool use_cache;
+    std::atomic<size_t> apparent_bytes{0};
+    std::atomic<size_t> allocated_bytes{0};
+    std::atomic<size_t> files{0};
+    std::atomic<size_t> directories{0};
+    std::atomic<size_t> errors{0};
+    std::atomic<size_t> cached_directories{0};
+    std::unordered_set<FileId, FileIdHash> seen_links;
+    std::mutex links_mutex;
+};
+
+struct DiskUsage::WalkState {
+    ThreadPool* pool;
+    const DirectoryVisitor* visitor;
+    std::atomic<size_t> errors{0};
+};
+
+DiskUsage::DiskUsage(size_t workers) : cache_bytes(0), worker_count(workers), throttle(nullptr) {
+}
+
+void DiskUsage::setWorkerCount(size_t count) {
+    worker_count = count;
+}
+
+void DiskUsage::setThrottle(Throttle* shared) {
+    throttle = shared;
+}
+
+void DiskUsage::clearCache() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache.clear();
+    cache_bytes = 0;
+}
+
+size_t DiskUsage::cachedDirectoryCount() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return cache.size();
+}
+
+bool DiskUsage::lookupCache(const FileId& id, const struct timespec& mtime, DirectoryEntry& entry) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = cache.find(id);
+    if (it == cache.end() || it->second.mtime.tv_sec != mtime.tv_sec || it->second.mtime.tv_nsec != mtime.tv_nsec) {
+        return false;
+    }
+    entry = it->second;
+    return true;
+}
+
+// Rough footprint of one cached listing: the map node, its hard links and
+// the subdirectory names
+size_t DiskUsage::cachedSize(const DirectoryEntry& entry) {
+    size_t size = sizeof(FileId) + sizeof(DirectoryEntry) + 4 * sizeof(void*);
+    size += entry.hard_links.capacity() * sizeof(HardLink);
+    for (const auto& name : entry.subdirectories) {
+        size += sizeof(std::string) + name.size();
+    }
+    return size;
+}
+
+void DiskUsage::storeCache(const FileId& id, DirectoryEntry entry) {
+    size_t size = cachedSize(entry);
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = cache.find(id);
+    if (it != cache.end()) {
+        cache_bytes -= cachedSize(it->second);
+        cache.erase(it);
+    }
+    if (cache_bytes + size > MAX_CACHED_BYTES) {
+        cache.clear();
+        cache_bytes = 0;
+    }
+    cache.emplace(id, std::move(entry));
+    cache_bytes += size;
+}
+
+bool DiskUsage::readDirectory(const std::string& path, DirectoryEntry& entry,
+                              std::vector<std::pair<std::string, struct stat>>& children,
+                              std::atomic<size_t>& errors, const EntryVisitor& visitor) {
+    int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR* dir = fd >= 0 ? fdopendir(fd) : nullptr;
+    if (!dir) {
+        if (fd >= 0) close(fd);
+        errors.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    entry.apparent_bytes = 0;
+    entry.allocated_bytes = 0;
+    entry.files = 0;
+
+    size_t uncharged = 1;  // the open and listing
+    struct dirent* dent;
+    while ((dent = readdir(dir)) != nullptr) {
+        const char* name = dent->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        if (throttle && ++uncharged >= THROTTLE_OPS) {
+            throttle->acquire(0, uncharged);
+            uncharged = 0;
+        }
+
+        struct stat st;
+        if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            errors.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        size_t allocated = static_cast<size_t>(st.st_blocks) * 512;
+        if (S_ISDIR(st.st_mode)) {
+            entry.subdirectories.push_back(name);
+            children.emplace_back(name, st);
+            continue;
+        }
+
+        if (visitor) {
+            visitor(name, st);
+        }
+        if (st.st_nlink > 1) {
+            entry.hard_links.push_back({FileId(st), static_cast<size_t>(st.st_size), allocated});
+        } else {
+            entry.apparent_bytes += st.st_size;
+            entry.allocated_bytes += allocated;
+            entry.files++;
+        }
+    }
+    closedir(dir);
+    if (throttle && uncharged > 0) throttle->acquire(0, uncharged);
+    return true;
+}
+
+void DiskUsage::scanDirectory(ScanState& state, const std::string& path, const struct stat& dir_stat) {
+    FileId id(dir_stat);
+    DirectoryEntry entry;
+    std::vector<std::pair<std::string, struct stat>> children;
+
+    state.directories.fetch_add(1, std::memory_order_relaxed);
+    state.apparent_bytes.fetch_add(dir_stat.st_size, std::memory_order_relaxed);
+    state.allocated_bytes.fetch_add(static_cast<size_t>(dir_stat.st_blocks) * 512, std::memory_order_relaxed);
+
+    if (state.use_cache && lookupCache(id, dir_stat.st_mtim, entry)) {
+        state.cached_directories.fetch_add(1, std::memory_order_relaxed);
+
+        // Only subdirectories need a fresh stat: their own mtimes validate them
+        if (throttle) throttle->acquire(0, entry.subdirectories.size());
+        for (const auto& name : entry.subdirectories) {
+            struct stat child_stat;
+            std::string child_path = path + "/" + name;
+            if (fstatat(AT_FDCWD, child_path.c_str(), &child_stat, AT_SYMLINK_NOFOLLOW) == 0 &&
+                S_ISDIR(child_stat.st_mode)) {
+                children.emplace_back(name, child_stat);
+            } else {
+                state.errors.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    } else {
+        if (!readDirectory(path, entry, children, state.errors, nullptr)) {
+            return;
+        }
+        entry.mtime = dir_stat.st_mtim;
+
+        if (time(nullptr) - dir_stat.st_mtim.tv_sec >= CACHE_SETTLE_SECONDS) {
+            storeCache(id, entry);
+        }
+    }
+
+    for (auto& child : children) {
+        std::string child_path = path + "/" + child.first;
+        struct stat child_stat = child.second;
+        state.pool->submit([this, &state, child_path, child_stat]() {
+            scanDirectory(state, child_path, child_stat);
+        });
+    }
+
+    state.apparent_bytes.fetch_add(entry.apparent_bytes, std::memory_order_relaxed);
+    state.allocated_bytes.fetch_add(entry.allocated_bytes, std::memory_order_relaxed);
+    state.files.fetch_add(entry.files, std::memory_order_relaxed);
+
+    if (!entry.hard_links.empty()) {
+        std::lock_guard<std::mutex> lock(state.links_mutex);
+        for (const auto& link : entry.hard_links) {
+            if (state.seen_links.insert(link.id).second) {
+                state.apparent_bytes.fetch_add(link.apparent, std::memory_order_relaxed);
+                state.allocated_bytes.fetch_add(link.allocated, std::memory_order_relaxed);
+                state.files.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+bool DiskUsage::scan(const std::string& path, UsageTotals& totals, bool use_cache) {
+    totals = UsageTotals();
+
+    struct stat root_stat;
+    if (stat(path.c_str(), &root_stat) != 0) {
+        return false;
+    }
+
+    if (!S_ISDIR(root_stat.st_mode)) {
+        totals.apparent_bytes = root_stat.st_size;
+        totals.allocated_bytes = static_cast<size_t>(root_stat.st_blocks) * 512;
+        totals.files = 1;
+        return true;
+    }
+
+    ScanState state;
+    state.use_cache = use_cache;
+    {
+        ThreadPool pool(worker_count);
+        state.pool = &pool;
+        pool.submit([this, &state, &path, &root_stat]() { scanDirectory(state, path, root_stat); });
+        pool.wait();
+    }
+
+    totals.apparent_bytes = state.apparent_bytes;
+    totals.allocated_bytes = state.allocated_bytes;
+    totals.files = state.files;
+    totals.directories = state.directories;
+    totals.errors = state.errors;
+    totals.cached_directories = state.cached_directories;
+    return true;
+}
+
+void DiskUsage::walkDirectory(WalkState& state, const std::string& path) {
+    DirectoryEntry entry;
+    std::vector<std::pair<std::string, struct stat>> children;
+    std::vector<std::pair<std::string, struct stat>> files;
+
+    bool listed = readDirectory(path, entry, children, state.errors,
+        [&files](const char* name, const struct stat& st) { files.emplace_back(name, st); });
+    if (!listed) {
+        return;
+    }
+
+    for (const auto& child : children) {
+        std::string child_path = path + "/" + child.first;
+        state.pool->submit([this, &state, child_path]() { walkDirectory(state, child_path); });
+    }
+    if (!files.empty()) {
+        (*state.visitor)(path, files);
+    }
+}
+
+bool DiskUsage::walk(const std::string& path, const DirectoryVisitor& visitor, size_t* errors) {
+    struct stat root_stat;
+    if (stat(path.c_str(), &root_stat) != 0) {
+        return false;
+    }
+    if (!S_ISDIR(root_stat.st_mode)) {
+        errno = ENOTDIR;
+        return false;
+    }
+
+    WalkState state;
+    state.visitor = &visitor;
+    {
+        ThreadPool pool(worker_count);
+        state.pool = &pool;
+        pool.submit([this, &state, &path]() { walkDirectory(state, path); });
+        pool.wait();
+    }
+
+    if (errors) *errors = state.errors;
+    return true;
+}
+
+namespace {
+
+// Immediate children listed under each directory of a top-N report
+const size_t BREAKDOWN_ENTRIES = 5;
+
+std::string joinPath(const std::string& dir, const char* name) {
+    if (!dir.empty() && dir.back() == '/') {
+        return dir + name;
+    }
+    return dir + "/" + name;
+}
+
+bool largerItem(const UsageItem& a, const UsageItem& b) {
+    return a.bytes > b.bytes;
+}
+
+// Keeps heap as a min-heap of at most limit items; floor tracks the smallest
+// size still worth offering once the heap is full
+void offerItem(std::vector<UsageItem>& heap, std::atomic<size_t>& floor, size_t limit, UsageItem item) {
+    if (heap.size() < limit) {
+        heap.push_back(std::move(item));
+        std::push_heap(heap.begin(), heap.end(), largerItem);
+    } else if (item.bytes > heap.front().bytes) {
+        std::pop_heap(heap.begin(), heap.end(), largerItem);
+        heap.back() = std::move(item);
+        std::push_heap(heap.begin(), heap.end(), largerItem);
+    } else {
+        return;
+    }
+    if (heap.size() == limit) {
+        floor.store(heap.front().bytes, std::memory_order_relaxed);
+    }
+}
+
+void keepLargest(std::vector<std::pair<std::string, size_t>>& largest, const std::string& name, size_t bytes) {
+    if (largest.size() == BREAKDOWN_ENTRIES && bytes <= largest.back().second) {
+        return;
+    }
+    auto pos = std::find_if(largest.begin(), largest.end(),
+        [bytes](const std::pair<std::string, size_t>& entry) { return entry.second < bytes; });
+    largest.insert(pos, std::make_pair(name, bytes));
+    if (largest.size() > BREAKDOWN_ENTRIES) {
+        largest.pop_back();
+    }
+}
+
+} // namespace
+
+struct DiskUsage::TopState {
+    ThreadPool* pool;
+    size_t limit;
+    std::atomic<size_t> apparent_bytes{0};
+    std::atomic<size_t> allocated_bytes{0};
+    std::atomic<size_t> files{0};
+    std::atomic<size_t> directories{0};
+    std::atomic<size_t> errors{0};
+    std::unordered_set<FileId, FileIdHash> seen_links;
+    std::mutex links_mutex;
+
+    std::mutex heap_mutex;
+    std::vector<UsageItem> file_heap;
+    std::vector<UsageItem> directory_heap;
+    std::atomic<size_t> file_floor{0};
+    std::atomic<size_t> directory_floor{0};
+    UsageItem root;
+};
+
+// A directory whose subtree is still being scanned. It is freed as soon as
+// its last subdirectory finishes, so only the scan frontier stays in memory.
+struct DiskUsage::TopNode {
+    TopNode* parent;
+    std::string path;
+    std::string name;
+    std::atomic<size_t> pending{1};  // own listing plus unfinished subdirectories
+    std::atomic<size_t> bytes{0};
+    size_t direct_bytes = 0;
+    std::mutex children_mutex;
+    std::vector<std::pair<std::string, size_t>> largest_children;
+};
+
+void DiskUsage::scanTopDirectory(TopState& state, TopNode* node, const struct stat& dir_stat) {
+    DirectoryEntry entry;
+    std::vector<std::pair<std::string, struct stat>> children;
+    std::vector<std::pair<std::string, size_t>> largest;
+    size_t link_apparent = 0;
+    size_t link_allocated = 0;
+    size_t link_files = 0;
+
+    size_t own_allocated = static_cast<size_t>(dir_stat.st_blocks) * 512;
+    state.directories.fetch_add(1, std::memory_order_relaxed);
+    state.apparent_bytes.fetch_add(dir_stat.st_size, std::memory_order_relaxed);
+    state.allocated_bytes.fetch_add(own_allocated, std::memory_order_relaxed);
+
+    auto visitor = [&](const char* name, const struct stat& st) {
+        size_t allocated = static_cast<size_t>(st.st_blocks) * 512;
+        if (st.st_nlink > 1) {
+            {
+                std::lock_guard<std::mutex> lock(state.links_mutex);
+                if (!state.seen_links.insert(FileId(st)).second) {
+                    return;
+                }
+            }
+            link_apparent += st.st_size;
+            link_allocated += allocated;
+            link_files++;
+        }
+
+        keepLargest(largest, name, allocated);
+        if (allocated > state.file_floor.load(std::memory_order_relaxed)) {
+            UsageItem item;
+            item.path = joinPath(node->path, name);
+            item.bytes = allocated;
+            std::lock_guard<std::mutex> lock(state.heap_mutex);
+            offerItem(state.file_heap, state.file_floor, state.limit, std::move(item));
+        }
+    };
+
+    if (readDirectory(node->path, entry, children, state.errors, visitor)) {
+        size_t direct = entry.allocated_bytes + link_allocated;
+        state.apparent_bytes.fetch_add(entry.apparent_bytes + link_apparent, std::memory_order_relaxed);
+        state.allocated_bytes.fetch_add(direct, std::memory_order_relaxed);
+        state.files.fetch_add(entry.files + link_files, std::memory_order_relaxed);
+
+        node->direct_bytes = direct;
+        node->bytes.fetch_add(own_allocated + direct, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(node->children_mutex);
+            for (const auto& child : largest) {
+                keepLargest(node->largest_children, child.first, child.second);
+            }
+        }
+    } else {
+        node->bytes.fetch_add(own_allocated, std::memory_order_relaxed);
+    }
+
+    node->pending.fetch_add(children.size());
+    for (auto& child : children) {
+        TopNode* child_node = new TopNode();
+        child_node->parent = node;
+        child_node->path = joinPath(node->path, child.first.c_str());
+        child_node->name = child.first;
+        struct stat child_stat = child.second;
+        state.pool->submit([this, &state, child_node, child_stat]() {
+            scanTopDirectory(state, child_node, child_stat);
+        });
+    }
+
+    finishTopNode(state, node);
+}
+
+void DiskUsage::finishTopNode(TopState& state, TopNode* node) {
+    // Walk upwards while each finished directory was the last one its parent waited for
+    while (node && node->pending.fetch_sub(1) == 1) {
+        UsageItem item;
+        item.path = node->path;
+        item.bytes = node->bytes.load();
+        item.direct_bytes = node->direct_bytes;
+        item.largest_children = std::move(node->largest_children);
+
+        TopNode* parent = node->parent;
+        if (!parent) {
+            state.root = std::move(item);
+        } else {
+            parent->bytes.fetch_add(item.bytes);
+            {
+                std::lock_guard<std::mutex> lock(parent->children_mutex);
+                keepLargest(parent->largest_children, node->name + "/", item.bytes);
+            }
+            if (item.bytes > state.directory_floor.load(std::memory_order_relaxed)) {
+                std::lock_guard<std::mutex> lock(state.heap_mutex);
+                offerItem(state.directory_heap, state.directory_floor, state.limit, std::move(item));
+            }
+        }
+
+        delete node;
+        node = parent;
+    }
+}
+
+void DiskUsage::snapshotTop(TopState& state, TopReport& report) {
+    {
+        std::lock_guard<std::mutex> lock(state.heap_mutex);
+        report.files = state.file_heap;
+        report.directories = state.directory_heap;
+    }
+    std::sort(report.files.begin(), report.files.end(), largerItem);
+    std::sort(report.directories.begin(), report.directories.end(), largerItem);
+
+    report.totals.apparent_bytes = state.apparent_bytes;
+    report.totals.allocated_bytes = state.allocated_bytes;
+    report.totals.files = state.files;
+    report.totals.directories = state.directories;
+    report.totals.errors = state.errors;
+}
+
+bool DiskUsage::scanTop(const std::string& path, size_t limit, TopReport& report,
+                        const TopProgress& progress, std::chrono::milliseconds interval) {
+    report = TopReport();
+
+    struct stat root_stat;
+    if (stat(path.c_str(), &root_stat) != 0) {
+        return false;
+    }
+
+    report.root.path = path;
+    if (!S_ISDIR(root_stat.st_mode)) {
+        report.root.bytes = static_cast<size_t>(root_stat.st_blocks) * 512;
+        report.totals.apparent_bytes = root_stat.st_size;
+        report.totals.allocated_bytes = report.root.bytes;
+        report.totals.files = 1;
+        return true;
+    }
+
+    TopState state;
+    state.limit = std::max<size_t>(limit, 1);
+    {
+        ThreadPool pool(worker_count);
+        state.pool = &pool;
+
+        TopNode* root = new TopNode();
+        root->parent = nullptr;
+        root->path = path;
+        pool.submit([this, &state, root, &root_stat]() { scanTopDirectory(state, root, root_stat); });
+
+        while (!pool.waitFor(interval)) {
+            if (progress) {
+                TopReport partial;
+                snapshotTop(state, partial);
+                progress(partial);
+            }
+        }
+    }
+
+    snapshotTop(state, report);
+    report.root = std::move(state.root);
+    return true;
+}
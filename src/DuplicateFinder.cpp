@@ -0,0 +1,312 @@
+#include "DuplicateFinder.h"
+#include "Checksum.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+struct DuplicateFinder::Candidate {
+    uint64_t size;
+    uint64_t device;
+    uint64_t inode;
+    uint64_t key;       // 0, then the partial hash, then the content digest
+    size_t directory;   // index into SearchState::directories
+    size_t name;        // offset of the NUL-terminated name in SearchState::names
+    bool complete;      // key already covers the whole content
+    bool dropped;       // unreadable, changed, or left without a duplicate
+};
+
+struct DuplicateFinder::SearchState {
+    std::mutex mutex;
+    std::vector<std::string> directories;
+    std::string names;
+    std::vector<Candidate> candidates;
+
+    std::atomic<size_t> partial_hashed{0};
+    std::atomic<size_t> full_hashed{0};
+    std::atomic<size_t> hashed_bytes{0};
+    std::atomic<size_t> cached_files{0};
+    std::atomic<size_t> errors{0};
+};
+
+namespace {
+
+// Reads exactly length bytes at offset unless the file ends first
+ssize_t readAt(int fd, char* buffer, size_t length, off_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pread(fd, buffer + done, length - done, offset + done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        if (n == 0) break;
+        done += n;
+    }
+    return done;
+}
+
+} // namespace
+
+DuplicateFinder::DuplicateFinder(DiskUsage& usage, DigestCache& cache, size_t workers)
+    : disk_usage(usage), digest_cache(cache), worker_count(workers) {
+}
+
+bool DuplicateFinder::sameInode(const Candidate& a, const Candidate& b) {
+    return a.device == b.device && a.inode == b.inode;
+}
+
+std::string DuplicateFinder::candidatePath(const SearchState& state, const Candidate& candidate) const {
+    return state.directories[candidate.directory] + "/" + (state.names.c_str() + candidate.name);
+}
+
+// Head and tail of the file; small files are read whole, which settles them
+bool DuplicateFinder::hashPartial(const std::string& path, Candidate& candidate, SearchState& state) {
+    int fd = open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    char buffer[2 * PARTIAL_SIZE];
+    size_t wanted = std::min<uint64_t>(candidate.size, sizeof(buffer));
+    ssize_t head = readAt(fd, buffer, std::min(wanted, PARTIAL_SIZE), 0);
+    ssize_t tail = 0;
+    if (head >= 0 && wanted > PARTIAL_SIZE) {
+        off_t offset = candidate.size <= sizeof(buffer) ? PARTIAL_SIZE : candidate.size - PARTIAL_SIZE;
+        tail = readAt(fd, buffer + head, wanted - PARTIAL_SIZE, offset);
+    }
+    close(fd);
+    if (head < 0 || tail < 0 || static_cast<size_t>(head + tail) != wanted) {
+        return false;  // unreadable, or shrank since it was listed
+    }
+
+    candidate.key = XXHash64::hash(buffer, wanted);
+    candidate.complete = candidate.size <= sizeof(buffer);
+    state.partial_hashed++;
+    state.hashed_bytes += wanted;
+    return true;
+}
+
+// Whole-content digest, shared with the directory comparison cache
+bool DuplicateFinder::hashFull(const std::string& path, Candidate& candidate, SearchState& state) {
+    int fd = open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || static_cast<uint64_t>(st.st_size) != candidate.size) {
+        if (fd >= 0) close(fd);
+        return false;
+    }
+
+    if (digest_cache.lookup(st, candidate.key)) {
+        close(fd);
+        candidate.complete = true;
+        state.cached_files++;
+        return true;
+    }
+
+    static thread_local std::vector<char> buffer(1024 * 1024);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    XXHash64 hasher;
+    uint64_t total = 0;
+    while (true) {
+        ssize_t n = read(fd, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            close(fd);
+            return false;
+        }
+        if (n == 0) break;
+        hasher.update(buffer.data(), n);
+        total += n;
+    }
+    close(fd);
+    if (total != candidate.size) {
+        return false;
+    }
+
+    candidate.key = hasher.digest();
+    candidate.complete = true;
+    digest_cache.store(st, candidate.key);
+    state.full_hashed++;
+    state.hashed_bytes += total;
+    return true;
+}
+
+// Hashes the first link of every inode still in play, in batches on the
+// pool, then copies each result to the inode's other links
+void DuplicateFinder::hashStage(SearchState& state, bool full) {
+    std::vector<Candidate>& candidates = state.candidates;
+    {
+        ThreadPool pool(worker_count);
+        std::vector<size_t> batch;
+        uint64_t batch_bytes = 0;
+
+        auto flush = [&]() {
+            if (batch.empty()) return;
+            pool.submit([this, &state, full, indices = std::move(batch)]() {
+                for (size_t index : indices) {
+                    Candidate& candidate = state.candidates[index];
+                    std::string path = candidatePath(state, candidate);
+                    if (!(full ? hashFull(path, candidate, state) : hashPartial(path, candidate, state))) {
+                        candidate.dropped = true;
+                        state.errors++;
+                    }
+                }
+            });
+            batch.clear();
+            batch_bytes = 0;
+        };
+
+        for (size_t i = 0; i < candidates.size(); i++) {
+            if ((i > 0 && sameInode(candidates[i - 1], candidates[i])) || (full && candidates[i].complete)) {
+                continue;
+            }
+            batch.push_back(i);
+            batch_bytes += full ? candidates[i].size : 2 * PARTIAL_SIZE;
+            if (batch.size() >= BATCH_FILES || batch_bytes >= BATCH_BYTES) {
+                flush();
+            }
+        }
+        flush();
+        pool.wait();
+    }
+
+    for (size_t i = 1; i < candidates.size(); i++) {
+        if (sameInode(candidates[i - 1], candidates[i])) {
+            candidates[i].key = candidates[i - 1].key;
+            candidates[i].complete = candidates[i - 1].complete;
+            candidates[i].dropped = candidates[i - 1].dropped;
+        }
+    }
+}
+
+// Sorts candidates into runs of equal (size, key) and keeps only runs that
+// span at least two inodes
+void DuplicateFinder::keepGroups(SearchState& state) {
+    std::vector<Candidate>& candidates = state.candidates;
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                    [](const Candidate& c) { return c.dropped; }),
+                     candidates.end());
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return std::tie(a.size, a.key, a.device, a.inode) < std::tie(b.size, b.key, b.device, b.inode);
+    });
+
+    size_t start = 0;
+    while (start < candidates.size()) {
+        size_t end = start + 1;
+        size_t inodes = 1;
+        while (end < candidates.size() && candidates[end].size == candidates[start].size &&
+               candidates[end].key == candidates[start].key) {
+            if (!sameInode(candidates[end - 1], candidates[end])) inodes++;
+            end++;
+        }
+        if (inodes < 2) {
+            for (size_t i = start; i < end; i++) candidates[i].dropped = true;
+        }
+        start = end;
+    }
+
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                    [](const Candidate& c) { return c.dropped; }),
+                     candidates.end());
+    candidates.shrink_to_fit();
+}
+
+bool DuplicateFinder::find(const std::string& path, DuplicateReport& report) {
+    report = DuplicateReport();
+    report.root = path;
+    SearchState state;
+
+    // Pass 1: how many files have each size (saturating at two)
+    std::unordered_map<uint64_t, unsigned char> size_counts;
+    size_t files = 0;
+    size_t walk_errors = 0;
+    bool walked = disk_usage.walk(path, [&](const std::string&, const std::vector<std::pair<std::string, struct stat>>& entries) {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        for (const auto& entry : entries) {
+            if (!S_ISREG(entry.second.st_mode)) continue;
+            files++;
+            if (entry.second.st_size == 0) continue;  // nothing to reclaim
+            unsigned char& count = size_counts[entry.second.st_size];
+            if (count < 2) count++;
+        }
+    }, &walk_errors);
+    if (!walked) {
+        return false;
+    }
+
+    // Pass 2: remember only files whose size is shared. size_counts is no
+    // longer written, so workers may look it up without the lock.
+    disk_usage.walk(path, [&](const std::string& directory, const std::vector<std::pair<std::string, struct stat>>& entries) {
+        std::vector<const std::pair<std::string, struct stat>*> matches;
+        for (const auto& entry : entries) {
+            if (!S_ISREG(entry.second.st_mode) || entry.second.st_size == 0) continue;
+            auto it = size_counts.find(entry.second.st_size);
+            if (it != size_counts.end() && it->second >= 2) {
+                matches.push_back(&entry);
+            }
+        }
+        if (matches.empty()) return;
+
+        std::lock_guard<std::mutex> lock(state.mutex);
+        size_t directory_index = state.directories.size();
+        state.directories.push_back(directory);
+        for (const auto* entry : matches) {
+            const struct stat& st = entry->second;
+            state.candidates.push_back(Candidate{static_cast<uint64_t>(st.st_size), static_cast<uint64_t>(st.st_dev),
+                                                 static_cast<uint64_t>(st.st_ino), 0, directory_index,
+                                                 state.names.size(), false, false});
+            state.names.append(entry->first.c_str(), entry->first.size() + 1);
+        }
+    });
+    std::unordered_map<uint64_t, unsigned char>().swap(size_counts);
+    size_t same_size = state.candidates.size();
+
+    keepGroups(state);         // equal size, at least two inodes
+    hashStage(state, false);   // head and tail
+    keepGroups(state);
+    hashStage(state, true);    // whole content, for files too big to be settled above
+    keepGroups(state);
+
+    // Runs of equal (size, digest) are the groups; runs of equal inode within
+    // them are the copies
+    const std::vector<Candidate>& candidates = state.candidates;
+    for (size_t start = 0; start < candidates.size();) {
+        DuplicateGroup group;
+        group.size = candidates[start].size;
+        group.digest = candidates[start].key;
+        size_t i = start;
+        for (; i < candidates.size() && candidates[i].size == group.size && candidates[i].key == group.digest; i++) {
+            if (i == start || !sameInode(candidates[i - 1], candidates[i])) {
+                group.copies.emplace_back();
+            }
+            group.copies.back().push_back(candidatePath(state, candidates[i]));
+        }
+        start = i;
+
+        for (auto& links : group.copies) {
+            std::sort(links.begin(), links.end());
+        }
+        std::sort(group.copies.begin(), group.copies.end());
+        group.reclaimable_bytes = group.size * (group.copies.size() - 1);
+        report.duplicate_files += group.copies.size() - 1;
+        report.reclaimable_bytes += group.reclaimable_bytes;
+        report.groups.push_back(std::move(group));
+    }
+    std::sort(report.groups.begin(), report.groups.end(), [](const DuplicateGroup& a, const DuplicateGroup& b) {
+        if (a.reclaimable_bytes != b.reclaimable_bytes) return a.reclaimable_bytes > b.reclaimable_bytes;
+        return a.copies.front().front() < b.copies.front().front();
+    });
+
+    report.stats.files = files;
+    report.stats.same_size = same_size;
+    report.stats.partial_hashed = state.partial_hashed;
+    report.stats.full_hashed = state.full_hashed;
+    report.stats.hashed_bytes = state.hashed_bytes;
+    report.stats.cached_files = state.cached_files;
+    report.stats.errors = walk_errors + state.errors;
+    return true;
+}
@@ -1,5 +1,10 @@
 #include "FileExplorer.h"
+#include "OutputRenderer.h"
+#include "IdNameCache.h"
+#include "ThreadPool.h"
+#include "MimeDetector.h"
 #include <iostream>
+#include <fstream>
 #include <iomanip>
 #include <algorithm>
 #include <cstring>
@@ -9,13 +14,24 @@
 #include <grp.h>
 #include <ctime>
 #include <sstream>
-
-FileExplorer::FileExplorer() : show_hidden_files(false) {
+#include <deque>
+#include <map>
+#include <set>
+#include <chrono>
+#include <poll.h>
+#include <sys/inotify.h>
+
+FileExplorer::FileExplorer() : show_hidden_files(false), interactive(true), exit_requested(false) {
     navigator = std::make_unique<Navigator>();
     file_ops = std::make_unique<FileOperations>(true);
+    registerCommands();
 }
 
 FileExplorer::~FileExplorer() {
+    size_t pending = file_ops->pendingBackgroundRemovals();
+    if (pending > 0) {
+        std::cout << "Waiting for " << pending << " background delete(s) to finish..." << std::endl;
+    }
 }
 
 std::string FileExplorer::formatPermissions(mode_t mode) {
@@ -62,24 +78,15 @@ std::string FileExplorer::formatPermissions(mode_t mode) {
 }
 
 std::string FileExplorer::formatFileSize(size_t size) {
-    const char* units[] = {"B", "KB", "MB", "GB", "TB"};
-    int unit = 0;
-    double size_d = static_cast<double>(size);
-
-    while (size_d >= 1024.0 && unit < 4) {
-        size_d /= 1024.0;
-        unit++;
-    }
-
-    std::stringstream ss;
-    ss << std::fixed << std::setprecision(1) << size_d << " " << units[unit];
-    return ss.str();
+    char buffer[OutputRenderer::FILE_SIZE_CHARS];
+    return std::string(buffer, OutputRenderer::formatFileSize(buffer, size));
 }
 
 std::string FileExplorer::formatTime(time_t timestamp) {
     char buffer[80];
-    struct tm* timeinfo = localtime(&timestamp);
-    strftime(buffer, sizeof(buffer), "%b %d %H:%M", timeinfo);
+    struct tm timeinfo;
+    localtime_r(&timestamp, &timeinfo);
+    strftime(buffer, sizeof(buffer), "%b %d %H:%M", &timeinfo);
     return std::string(buffer);
 }
 
@@ -97,6 +104,29 @@ bool FileExplorer::isHiddenFile(const std::string& name) {
     return !name.empty() && name[0] == '.';
 }
 
+bool FileExplorer::statEntry(const std::string& dir_path, const std::string& name, FileInfo& info) {
+    std::string full_path = dir_path + "/" + name;
+    struct stat file_stat;
+
+    if (stat(full_path.c_str(), &file_stat) != 0) {
+        return false;
+    }
+
+    info.name = name;
+    info.path = full_path;
+    info.permissions = formatPermissions(file_stat.st_mode);
+    info.size = file_stat.st_size;
+    info.type = getFileType(file_stat.st_mode, full_path);
+    info.modified_time = formatTime(file_stat.st_mtime);
+    info.modified_timestamp = file_stat.st_mtime;
+    info.uid = file_stat.st_uid;
+    info.gid = file_stat.st_gid;
+    info.device = file_stat.st_dev;
+    info.inode = file_stat.st_ino;
+    info.is_hidden = isHiddenFile(name);
+    return true;
+}
+
 std::vector<FileInfo> FileExplorer::listDirectory(const std::string& path) {
     std::vector<FileInfo> files;
     std::string target_path = path.empty() ? navigator->getCurrentPath() : path;
@@ -116,25 +146,28 @@ std::vector<FileInfo> FileExplorer::listDirectory(const std::string& path) {
             continue;
         }
 
-        std::string full_path = target_path + "/" + name;
-        struct stat file_stat;
-
-        if (stat(full_path.c_str(), &file_stat) == 0) {
-            FileInfo info;
-            info.name = name;
-            info.path = full_path;
-            info.permissions = formatPermissions(file_stat.st_mode);
-            info.size = file_stat.st_size;
-            info.type = getFileType(file_stat.st_mode, full_path);
-            info.modified_time = formatTime(file_stat.st_mtime);
-            info.is_hidden = isHiddenFile(name);
-
+        FileInfo info;
+        if (statEntry(target_path, name, info)) {
             files.push_back(info);
         }
     }
 
     closedir(dir);
 
+    // Resolve owner/group names once per distinct id rather than per entry
+    std::vector<uid_t> uids;
+    std::vector<gid_t> gids;
+    for (const auto& info : files) {
+        uids.push_back(info.uid);
+        gids.push_back(info.gid);
+    }
+    IdNameCache& id_cache = IdNameCache::instance();
+    id_cache.prefetch(uids, gids);
+    for (auto& info : files) {
+        info.owner = id_cache.userName(info.uid);
+        info.group = id_cache.groupName(info.gid);
+    }
+
     // Sort files: directories first, then files, both alphabetically
     std::sort(files.begin(), files.end(), [](const FileInfo& a, const FileInfo& b) {
         bool a_is_dir = a.type == "Directory";
@@ -162,209 +195,1115 @@ std::string FileExplorer::getCurrentPath() const {
     return navigator->getCurrentPath();
 }
 
-void FileExplorer::displayDirectory(const std::vector<FileInfo>& files) {
+FileExplorer::ListingColumns FileExplorer::measureColumns(const std::vector<FileInfo>& files) {
+    ListingColumns columns;
+    for (const auto& file : files) {
+        columns.name = std::max(columns.name, file.name.size() + 2);
+        columns.type = std::max(columns.type, file.type.size() + 1);
+        columns.owner = std::max(columns.owner, file.owner.size() + 1);
+        columns.group = std::max(columns.group, file.group.size() + 1);
+    }
+    return columns;
+}
+
+void FileExplorer::appendFileRow(OutputRenderer& out, const FileInfo& file, const ListingColumns& columns) {
+    size_t name_len = file.name.size();
+    out.append(file.name);
+    if (file.type == "Directory") {
+        out.append('/');
+        name_len++;
+    } else if (file.type == "Symbolic Link") {
+        out.append('@');
+        name_len++;
+    }
+    if (name_len < columns.name) {
+        out.appendRepeated(' ', columns.name - name_len);
+    }
+
+    char size_buf[OutputRenderer::FILE_SIZE_CHARS];
+    out.appendPadded(size_buf, OutputRenderer::formatFileSize(size_buf, file.size), 12);
+    out.appendPadded(file.type, columns.type);
+    out.appendPadded(file.modified_time, 14);
+    out.appendPadded(file.owner, columns.owner);
+    out.appendPadded(file.group, columns.group);
+    out.append(file.permissions);
+    out.endRow();
+}
+
+void FileExplorer::displayDirectory(const std::vector<FileInfo>& files, bool show_mime) {
     if (files.empty()) {
-        std::cout << "Directory is empty or cannot be accessed." << std::endl;
+        std::cout << "Directory is empty or cannot be accessed.\n";
         return;
     }
 
-    std::cout << "\nDirectory listing for: " << navigator->getCurrentPath() << "\n";
-    std::cout << std::string(80, '=') << "\n";
+    // With show_mime, regular files are typed by content instead; like the
+    // rest of the listing, this follows symbolic links
+    std::vector<FileInfo> typed;
+    if (show_mime) {
+        typed = files;
+        for (auto& file : typed) {
+            struct stat st;
+            if (file.type == "Regular File" && stat(file.path.c_str(), &st) == 0) {
+                file.type = MimeDetector::shared().detect(file.path, st);
+            }
+        }
+    }
+    const std::vector<FileInfo>& shown = show_mime ? typed : files;
+
+    // Compute column widths once for the whole listing
+    ListingColumns columns = measureColumns(shown);
+    size_t rule_width = std::max<size_t>(80, columns.name + 12 + columns.type + 14 + columns.owner + columns.group + 10);
+
+    OutputRenderer out;
+    out.append("\nDirectory listing for: ");
+    out.append(navigator->getCurrentPath());
+    out.endRow();
+    out.appendRepeated('=', rule_width);
+    out.endRow();
 
     // Print header
-    std::cout << std::left << std::setw(20) << "Name"
-              << std::setw(12) << "Size"
-              << std::setw(12) << "Type"
-              << std::setw(14) << "Modified"
-              << "Permissions" << "\n";
-    std::cout << std::string(80, '-') << "\n";
+    out.appendPadded("Name", columns.name);
+    out.appendPadded("Size", 12);
+    out.appendPadded("Type", columns.type);
+    out.appendPadded("Modified", 14);
+    out.appendPadded("Owner", columns.owner);
+    out.appendPadded("Group", columns.group);
+    out.append("Permissions");
+    out.endRow();
+    out.appendRepeated('-', rule_width);
+    out.endRow();
 
     // Print files
-    for (const auto& file : files) {
-        std::string display_name = file.name;
-        if (file.type == "Directory") {
-            display_name += "/";
-        } else if (file.type == "Symbolic Link") {
-            display_name += "@";
-        }
-
-        std::cout << std::left << std::setw(20) << display_name
-                  << std::setw(12) << formatFileSize(file.size)
-                  << std::setw(12) << file.type
-                  << std::setw(14) << file.modified_time
-                  << file.permissions << "\n";
+    for (const auto& file : shown) {
+        appendFileRow(out, file, columns);
     }
 
-    std::cout << std::string(80, '=') << "\n";
-    std::cout << "Total: " << files.size() << " items\n";
+    out.appendRepeated('=', rule_width);
+    out.endRow();
+    out.append("Total: ");
+    out.appendNumber(files.size());
+    out.append(" items");
+    out.endRow();
 }
 
 void FileExplorer::printCurrentDirectory() {
-    std::cout << "Current directory: " << current_path << std::endl;
+    std::cout << "Current directory: " << navigator->getCurrentPath() << "\n";
 }
 
-void FileExplorer::run() {
-    std::string command;
+// Reads path's entries in listing order (directories first, then by name),
+// following symlinks like listDirectory() but without its owner lookups. The
+// directory is closed again before the caller descends, so the depth of a
+// tree never costs more than one descriptor. Returns 0 or the opendir errno.
+int FileExplorer::readTreeEntries(const std::string& path, std::vector<TreeEntry>& entries) {
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        return errno;
+    }
 
-    printCurrentDirectory();
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || (!show_hidden_files && isHiddenFile(name))) {
+            continue;
+        }
+        struct stat st;
+        if (fstatat(dirfd(dir), name, &st, 0) != 0) {
+            continue;  // listDirectory() leaves it out too
+        }
+        entries.push_back({name, S_ISDIR(st.st_mode), static_cast<size_t>(st.st_size), st.st_dev, st.st_ino});
+    }
+    closedir(dir);
 
-    while (true) {
-        std::cout << "\nFile Explorer> ";
-        std::getline(std::cin, command);
+    std::sort(entries.begin(), entries.end(), [](const TreeEntry& a, const TreeEntry& b) {
+        if (a.is_dir != b.is_dir) {
+            return a.is_dir > b.is_dir;
+        }
+        return a.name < b.name;
+    });
+    return 0;
+}
+
+// Appends the lines below path to subtree.text. A directory's totals are only
+// known once its contents are in, so its line gets a slot at the point where
+// they go, filled in afterwards; nothing written is ever copied again.
+// error receives readTreeEntries()'s result for path itself.
+TreeTotals FileExplorer::renderSubtree(const std::string& path, const std::string& prefix, int depth, int max_depth,
+                                       std::vector<std::pair<dev_t, ino_t>>& ancestors, SubtreeText& subtree,
+                                       int& error) {
+    TreeTotals totals;
+    std::vector<TreeEntry> entries;
+    error = readTreeEntries(path, entries);
+
+    char size_buf[OutputRenderer::FILE_SIZE_CHARS];
+    for (size_t i = 0; i < entries.size(); i++) {
+        const TreeEntry& entry = entries[i];
+        bool last = (i + 1 == entries.size());
+
+        subtree.text += prefix;
+        subtree.text += last ? "\u2514\u2500\u2500 " : "\u251c\u2500\u2500 ";
+        subtree.text += entry.name;
+
+        if (!entry.is_dir) {
+            subtree.text += "  (";
+            subtree.text.append(size_buf, OutputRenderer::formatFileSize(size_buf, entry.size));
+            subtree.text += ")\n";
+            totals.files++;
+            totals.bytes += entry.size;
+            continue;
+        }
+
+        totals.directories++;
+        subtree.text += '/';
 
-        if (command.empty()) {
+        // Symlinked directories can point back up the tree; never walk into an ancestor
+        std::pair<dev_t, ino_t> id(entry.device, entry.inode);
+        if (std::find(ancestors.begin(), ancestors.end(), id) != ancestors.end()) {
+            subtree.text += "  [recursive, not followed]\n";
+            continue;
+        }
+        if (max_depth >= 0 && depth >= max_depth) {
+            subtree.text += '\n';
             continue;
         }
 
-        if (command == "exit" || command == "quit") {
-            std::cout << "Exiting File Explorer..." << std::endl;
+        size_t slot = subtree.slots.size();
+        subtree.slots.push_back({subtree.text.size(), TreeTotals(), 0});
+        subtree.text += '\n';
+
+        int child_error = 0;
+        ancestors.push_back(id);
+        TreeTotals child = renderSubtree(path + "/" + entry.name, prefix + (last ? "    " : "\u2502   "),
+                                         depth + 1, max_depth, ancestors, subtree, child_error);
+        ancestors.pop_back();
+        subtree.slots[slot].totals = child;
+        subtree.slots[slot].error = child_error;
+
+        totals.directories += child.directories;
+        totals.files += child.files;
+        totals.bytes += child.bytes;
+    }
+    return totals;
+}
+
+// A directory's totals after its name, or why it could not be listed
+static void appendTreeTotals(OutputRenderer& out, const TreeTotals& totals, int error) {
+    if (error != 0) {
+        out.append("  [cannot open: ");
+        out.append(strerror(error));
+        out.append(']');
+        return;
+    }
+    out.append("  [");
+    out.appendFileSize(totals.bytes);
+    out.append(", ");
+    out.appendNumber(totals.files);
+    out.append(" files]");
+}
+
+bool FileExplorer::showTree(const std::string& path, int max_depth) {
+    std::string root = path.empty() ? getCurrentPath() : path;
+
+    struct stat root_stat;
+    if (stat(root.c_str(), &root_stat) != 0 || !S_ISDIR(root_stat.st_mode)) {
+        std::cerr << "Error: Cannot open directory '" << root << "'" << std::endl;
+        return false;
+    }
+    std::vector<TreeEntry> entries;
+    int root_error = readTreeEntries(root, entries);
+    if (root_error != 0) {
+        std::cerr << "Error: Cannot open directory '" << root << "': " << strerror(root_error) << std::endl;
+        return false;
+    }
+
+    struct RenderedSubtree {
+        SubtreeText subtree;
+        TreeTotals totals;
+        int error = 0;
+    };
+    std::vector<std::future<RenderedSubtree>> subtrees(entries.size());
+    std::pair<dev_t, ino_t> root_id(root_stat.st_dev, root_stat.st_ino);
+
+    // Each top-level subdirectory is rendered to text on a worker while the
+    // ones before it are printed; the main thread only writes that text out
+    // with the totals filled in. Only a bounded window of subtrees is in
+    // flight at once.
+    ThreadPool pool;
+    size_t window = pool.size() * 2;
+    size_t next_submit = 0;
+    bool descend = (max_depth < 0 || max_depth > 1);
+
+    OutputRenderer out;
+    out.append(root);
+    out.endRow();
+
+    TreeTotals totals;
+    for (size_t i = 0; i < entries.size(); i++) {
+        for (; next_submit < entries.size() && next_submit < i + window; next_submit++) {
+            const TreeEntry& entry = entries[next_submit];
+            std::pair<dev_t, ino_t> id(entry.device, entry.inode);
+            if (!descend || !entry.is_dir || id == root_id) {
+                continue;
+            }
+            std::string child_path = root + "/" + entry.name;
+            std::string prefix = next_submit + 1 == entries.size() ? "    " : "\u2502   ";
+            subtrees[next_submit] = pool.submit([this, child_path, prefix, max_depth, root_id, id]() {
+                RenderedSubtree result;
+                std::vector<std::pair<dev_t, ino_t>> ancestors = {root_id, id};
+                result.totals = renderSubtree(child_path, prefix, 2, max_depth, ancestors, result.subtree,
+                                              result.error);
+                return result;
+            });
+        }
+
+        const TreeEntry& entry = entries[i];
+        bool last = (i + 1 == entries.size());
+        out.append(last ? "\u2514\u2500\u2500 " : "\u251c\u2500\u2500 ");
+        out.append(entry.name);
+
+        if (!entry.is_dir) {
+            out.append("  (");
+            out.appendFileSize(entry.size);
+            out.append(')');
+            out.endRow();
+            totals.files++;
+            totals.bytes += entry.size;
+            continue;
+        }
+
+        totals.directories++;
+        out.append('/');
+        if (!subtrees[i].valid()) {
+            if (descend) {
+                out.append("  [recursive, not followed]");
+            }
+            out.endRow();
+            continue;
+        }
+
+        RenderedSubtree result = subtrees[i].get();
+        appendTreeTotals(out, result.totals, result.error);
+        out.endRow();
+
+        const std::string& text = result.subtree.text;
+        size_t written = 0;
+        for (const SubtreeSlot& slot : result.subtree.slots) {
+            out.appendRows(text.data() + written, slot.offset - written);
+            appendTreeTotals(out, slot.totals, slot.error);
+            written = slot.offset;
+        }
+        out.appendRows(text.data() + written, text.size() - written);
+
+        totals.directories += result.totals.directories;
+        totals.files += result.totals.files;
+        totals.bytes += result.totals.bytes;
+    }
+
+    out.append("\n");
+    out.appendNumber(totals.directories);
+    out.append(" directories, ");
+    out.appendNumber(totals.files);
+    out.append(" files, ");
+    out.appendFileSize(totals.bytes);
+    out.append(" total");
+    out.endRow();
+    return true;
+}
+
+bool FileExplorer::watchDirectory(const std::string& path, int refresh_ms) {
+    std::string target_path = path.empty() ? getCurrentPath() : path;
+
+    int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        std::cerr << "Error: Cannot initialize inotify: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    const uint32_t watch_mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+                                IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+    if (inotify_add_watch(inotify_fd, target_path.c_str(), watch_mask) < 0) {
+        std::cerr << "Error: Cannot watch '" << target_path << "': " << strerror(errno) << std::endl;
+        close(inotify_fd);
+        return false;
+    }
+
+    std::vector<FileInfo> initial = listDirectory(target_path);
+    displayDirectory(initial);
+
+    ListingColumns columns = measureColumns(initial);
+    std::map<std::string, FileInfo> entries;
+    for (auto& info : initial) {
+        entries[info.name] = std::move(info);
+    }
+
+    std::cout << "Watching '" << target_path << "' (press Enter to stop)" << std::endl;
+
+    // Events only record which names changed; a frame re-stats each of them at
+    // most once, so a burst of events on one file costs a single stat and row.
+    std::set<std::string> changed;
+    std::chrono::steady_clock::time_point frame_deadline;
+    alignas(struct inotify_event) char event_buf[64 * 1024];
+    bool watching = true;
+    bool stopped_by_input = false;
+
+    while (watching) {
+        if (std::cin.rdbuf()->in_avail() > 0) {
+            stopped_by_input = true;
+            break;
+        }
+
+        int timeout = -1;
+        if (!changed.empty()) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                frame_deadline - std::chrono::steady_clock::now()).count();
+            timeout = static_cast<int>(std::max<long long>(remaining, 0));
+        }
+
+        struct pollfd fds[2] = {{inotify_fd, POLLIN, 0}, {STDIN_FILENO, POLLIN, 0}};
+        int ready = poll(fds, 2, timeout);
+        if (ready < 0 && errno != EINTR) {
+            break;
+        }
+
+        if (fds[1].revents & (POLLIN | POLLHUP)) {
+            stopped_by_input = true;
             break;
-        } else if (command == "help" || command == "?") {
-            std::cout << "\nAvailable commands:\n";
-            std::cout << "  ls, list           - List current directory contents\n";
-            std::cout << "  cd [path]          - Change directory\n";
-            std::cout << "  cd ..              - Go to parent directory\n";
-            std::cout << "  cd ~               - Go to home directory\n";
-            std::cout << "  cd -               - Go to previous directory\n";
-            std::cout << "  back               - Go back in history\n";
-            std::cout << "  forward            - Go forward in history\n";
-            std::cout << "  pwd                - Print current directory path\n";
-            std::cout << "  bookmark [name]    - Bookmark current directory\n";
-            std::cout << "  goto [name]        - Go to bookmarked directory\n";
-            std::cout << "  unmark [name]      - Remove bookmark\n";
-            std::cout << "  bookmarks          - Show all bookmarks\n";
-            std::cout << "  history            - Show navigation history\n";
-            std::cout << "  cp [src] [dst]     - Copy file/directory\n";
-            std::cout << "  mv [src] [dst]     - Move/rename file/directory\n";
-            std::cout << "  rm [path]          - Delete file/directory\n";
-            std::cout << "  mkdir [path]       - Create directory\n";
-            std::cout << "  touch [file]       - Create empty file\n";
-            std::cout << "  du [path]          - Show disk usage\n";
-            std::cout << "  hidden             - Toggle hidden files display\n";
-            std::cout << "  help, ?            - Show this help message\n";
-            std::cout << "  exit, quit         - Exit file explorer\n";
-        } else if (command == "ls" || command == "list") {
-            auto files = listDirectory();
-            displayDirectory(files);
-        } else if (command.substr(0, 2) == "cd") {
-            size_t space_pos = command.find(' ');
-            if (space_pos != std::string::npos) {
-                std::string path = command.substr(space_pos + 1);
-                if (changeDirectory(path)) {
-                    printCurrentDirectory();
+        }
+
+        if (fds[0].revents & POLLIN) {
+            ssize_t length;
+            while ((length = read(inotify_fd, event_buf, sizeof(event_buf))) > 0) {
+                for (char* ptr = event_buf; ptr < event_buf + length;) {
+                    const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+                    ptr += sizeof(struct inotify_event) + event->len;
+
+                    if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                        std::cout << "Watched directory was removed or moved." << std::endl;
+                        watching = false;
+                        break;
+                    }
+                    if (event->mask & IN_Q_OVERFLOW) {
+                        // Events were dropped; reconcile every known and current name
+                        for (const auto& item : entries) {
+                            changed.insert(item.first);
+                        }
+                        for (const auto& info : listDirectory(target_path)) {
+                            changed.insert(info.name);
+                        }
+                    } else if (event->len > 0) {
+                        changed.insert(event->name);
+                    }
                 }
-            } else {
-                changeDirectory("~");
-                printCurrentDirectory();
+                if (!watching) break;
             }
-        } else if (command == "pwd") {
-            printCurrentDirectory();
-        } else if (command == "back") {
-            if (goBack()) {
-                printCurrentDirectory();
+
+            if (!changed.empty() && timeout < 0) {
+                frame_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(refresh_ms);
             }
-        } else if (command == "forward") {
-            if (goForward()) {
-                printCurrentDirectory();
+        }
+
+        if (!watching || changed.empty() || std::chrono::steady_clock::now() < frame_deadline) {
+            continue;
+        }
+
+        // Apply the coalesced changes and redraw only the affected rows
+        OutputRenderer out;
+        char time_buf[16];
+        time_t now = time(nullptr);
+        struct tm now_tm;
+        localtime_r(&now, &now_tm);
+        strftime(time_buf, sizeof(time_buf), "%H:%M:%S", &now_tm);
+        size_t rows_before = out.getRowsRendered();
+
+        for (const auto& name : changed) {
+            if (name == "." || name == ".." || (!show_hidden_files && isHiddenFile(name))) {
+                continue;
             }
-        } else if (command.substr(0, 8) == "bookmark") {
-            size_t space_pos = command.find(' ');
-            if (space_pos != std::string::npos) {
-                std::string name = command.substr(space_pos + 1);
-                addBookmark(name, getCurrentPath(), "User bookmark");
+
+            FileInfo info;
+            auto existing = entries.find(name);
+            bool present = statEntry(target_path, name, info);
+
+            if (!present) {
+                if (existing != entries.end()) {
+                    out.append("- ");
+                    appendFileRow(out, existing->second, columns);
+                    entries.erase(existing);
+                }
+                continue;
+            }
+
+            IdNameCache& id_cache = IdNameCache::instance();
+            info.owner = id_cache.userName(info.uid);
+            info.group = id_cache.groupName(info.gid);
+
+            if (existing == entries.end()) {
+                out.append("+ ");
+            } else if (existing->second.size != info.size ||
+                       existing->second.modified_timestamp != info.modified_timestamp ||
+                       existing->second.permissions != info.permissions ||
+                       existing->second.inode != info.inode) {
+                out.append("~ ");
             } else {
-                std::cout << "Usage: bookmark [name]" << std::endl;
+                continue;
             }
-        } else if (command.substr(0, 4) == "goto") {
-            size_t space_pos = command.find(' ');
-            if (space_pos != std::string::npos) {
-                std::string name = command.substr(space_pos + 1);
-                if (goToBookmark(name)) {
-                    printCurrentDirectory();
-                }
+            appendFileRow(out, info, columns);
+            entries[name] = std::move(info);
+        }
+        changed.clear();
+
+        if (out.getRowsRendered() > rows_before) {
+            std::cout << "[" << time_buf << "] " << entries.size() << " items" << std::endl;
+            out.flush();
+        }
+    }
+
+    close(inotify_fd);
+
+    // Consume the line that stopped the watch so it is not run as a command
+    if (stopped_by_input) {
+        std::string discard;
+        std::getline(std::cin, discard);
+    }
+    std::cout << "Stopped watching '" << target_path << "'" << std::endl;
+    return true;
+}
+
+void FileExplorer::printHelp() {
+    std::cout << "\nAvailable commands:\n";
+    std::cout << "  ls, list [--mime]  - List current directory contents (--mime types files by content)\n";
+    std::cout << "  cd [path]          - Change directory\n";
+    std::cout << "  cd ..              - Go to parent directory\n";
+    std::cout << "  cd ~               - Go to home directory\n";
+    std::cout << "  cd -               - Go to previous directory\n";
+    std::cout << "  back               - Go back in history\n";
+    std::cout << "  forward            - Go forward in history\n";
+    std::cout << "  pwd                - Print current directory path\n";
+    std::cout << "  bookmark [name]    - Bookmark current directory\n";
+    std::cout << "  goto [name]        - Go to bookmarked directory\n";
+    std::cout << "  unmark [name]      - Remove bookmark\n";
+    std::cout << "  bookmarks          - Show all bookmarks\n";
+    std::cout << "  history            - Show navigation history\n";
+    std::cout << "  cp [-L] [--verify] [src...] [dst] - Copy files/directories (several into a directory);\n";
+    std::cout << "                       symlinks and hard links inside are kept as links, -L copies\n";
+    std::cout << "                       what symlinks point to (loops are skipped);\n";
+    std::cout << "                       --verify checksums the data and reads the copy back;\n";
+    std::cout << "                       --nocache drops copied data from the page cache as it goes,\n";
+    std::cout << "                       --direct bypasses it with O_DIRECT where supported\n";
+    std::cout << "  hash [--sha256] [file...] - Print xxh64 (default) or SHA-256 digests\n";
+    std::cout << "  mv [src...] [dst]  - Move/rename files/directories\n";
+    std::cout << "  mvbatch [--log FILE] [plan] - Apply the renames listed in plan (source<TAB>destination\n";
+    std::cout << "                       per line) all or nothing; --undo FILE reverts an interrupted one\n";
+    std::cout << "  cmp [file1] [file2] - Compare two files byte by byte\n";
+    std::cout << "  diff [dir1] [dir2] - List entries added (+), removed (-) or changed (~) in dir2\n";
+    std::cout << "  rm [-f] [-b] [path...] - Delete files/directories (-f skips confirmation,\n";
+    std::cout << "                       -b moves them aside and deletes in the background)\n";
+    std::cout << "  shred [-f] [-n PASSES] [path...] - Overwrite files with random data (3 passes\n";
+    std::cout << "                       by default), then delete them\n";
+    std::cout << "  ln -s [target] [link] - Create a symbolic link to target\n";
+    std::cout << "  mkdir [path]       - Create directory\n";
+    std::cout << "  touch [file]       - Create empty file\n";
+    std::cout << "  du [--fresh] [path] - Show disk usage (--fresh ignores cached listings)\n";
+    std::cout << "  du --top N [path]  - List the N largest directories and files\n";
+    std::cout << "  biggest [N] [path] - Same as du --top N (default 10)\n";
+    std::cout << "  dupes [path]       - List groups of identical files and the space they waste\n";
+    std::cout << "  file [path...]     - Show the MIME type of each file, detected from its contents\n";
+    std::cout << "  find [path] [--name GLOB] [--type MIME] [--grep REGEX] - Search a tree; MIME may be\n";
+    std::cout << "                       image/png, image/* (or image), or text for any text file\n";
+    std::cout << "  throttle [RATE [OPS]] [--idle] - Limit copies, moves and scans to RATE bytes/s\n";
+    std::cout << "                       (e.g. 20M) and OPS operations/s; --idle uses idle I/O priority;\n";
+    std::cout << "                       'throttle off' removes limits, no arguments shows them\n";
+    std::cout << "  tree [path] [-L n] - Show directory tree (n levels deep)\n";
+    std::cout << "  watch [path] [ms]  - Watch directory for changes (Enter stops)\n";
+    std::cout << "  hidden             - Toggle hidden files display\n";
+    std::cout << "  help, ?            - Show this help message\n";
+    std::cout << "  exit, quit         - Exit file explorer\n";
+    std::cout << "\nPaths containing spaces can be quoted: cd \"My Documents\"\n";
+}
+
+void FileExplorer::registerCommands() {
+    // Commands taking a single path accept it unquoted too, as before
+    auto joinArgs = [](const std::vector<std::string>& args, size_t first) {
+        std::string joined;
+        for (size_t i = first; i < args.size(); i++) {
+            if (i > first) joined += ' ';
+            joined += args[i];
+        }
+        return joined;
+    };
+    auto status = [](bool success) { return success ? STATUS_OK : STATUS_FAILED; };
+
+    CommandHandler quit = [this](const std::vector<std::string>&) {
+        std::cout << "Exiting File Explorer...\n";
+        exit_requested = true;
+        return STATUS_OK;
+    };
+    commands["exit"] = quit;
+    commands["quit"] = quit;
+
+    CommandHandler help = [this](const std::vector<std::string>&) {
+        printHelp();
+        return STATUS_OK;
+    };
+    commands["help"] = help;
+    commands["?"] = help;
+
+    CommandHandler list = [this](const std::vector<std::string>& args) {
+        if (args.size() > 2 || (args.size() == 2 && args[1] != "--mime")) {
+            std::cout << "Usage: ls [--mime]\n";
+            return STATUS_USAGE;
+        }
+        auto files = listDirectory();
+        displayDirectory(files, args.size() == 2);
+        return files.empty() ? STATUS_FAILED : STATUS_OK;
+    };
+    commands["ls"] = list;
+    commands["list"] = list;
+
+    commands["cd"] = [this, joinArgs](const std::vector<std::string>& args) {
+        std::string path = args.size() > 1 ? joinArgs(args, 1) : "~";
+        if (!changeDirectory(path)) {
+            return STATUS_FAILED;
+        }
+        printCurrentDirectory();
+        return STATUS_OK;
+    };
+
+    commands["pwd"] = [this](const std::vector<std::string>&) {
+        printCurrentDirectory();
+        return STATUS_OK;
+    };
+
+    commands["back"] = [this](const std::vector<std::string>&) {
+        if (!goBack()) {
+            return STATUS_FAILED;
+        }
+        printCurrentDirectory();
+        return STATUS_OK;
+    };
+
+    commands["forward"] = [this](const std::vector<std::string>&) {
+        if (!goForward()) {
+            return STATUS_FAILED;
+        }
+        printCurrentDirectory();
+        return STATUS_OK;
+    };
+
+    commands["bookmark"] = [this, joinArgs, status](const std::vector<std::string>& args) {
+        if (args.size() < 2) {
+            std::cout << "Usage: bookmark [name]\n";
+            return STATUS_USAGE;
+        }
+        return status(addBookmark(joinArgs(args, 1), getCurrentPath(), "User bookmark"));
+    };
+
+    commands["goto"] = [this, joinArgs](const std::vector<std::string>& args) {
+        if (args.size() < 2) {
+            std::cout << "Usage: goto [bookmark_name]\n";
+            return STATUS_USAGE;
+        }
+        if (!goToBookmark(joinArgs(args, 1))) {
+            return STATUS_FAILED;
+        }
+        printCurrentDirectory();
+        return STATUS_OK;
+    };
+
+    commands["unmark"] = [this, joinArgs, status](const std::vector<std::string>& args) {
+        if (args.size() < 2) {
+            std::cout << "Usage: unmark [bookmark_name]\n";
+            return STATUS_USAGE;
+        }
+        return status(removeBookmark(joinArgs(args, 1)));
+    };
+
+    commands["bookmarks"] = [this](const std::vector<std::string>&) {
+        showBookmarks();
+        return STATUS_OK;
+    };
+
+    commands["history"] = [this](const std::vector<std::string>&) {
+        showHistory();
+        return STATUS_OK;
+    };
+
+    commands["cp"] = [this, status](const std::vector<std::string>& args) {
+        bool verify = false;
+        bool follow_links = false;
+        CacheMode cache_mode = CacheMode::Normal;
+        std::vector<std::string> paths;
+        for (size_t i = 1; i < args.size(); i++) {
+            if (args[i] == "--verify") {
+                verify = true;
+            } else if (args[i] == "-L") {
+                follow_links = true;
+            } else if (args[i] == "--nocache") {
+                cache_mode = CacheMode::DropBehind;
+            } else if (args[i] == "--direct") {
+                cache_mode = CacheMode::Direct;
             } else {
-                std::cout << "Usage: goto [bookmark_name]" << std::endl;
+                paths.push_back(args[i]);
             }
-        } else if (command.substr(0, 6) == "unmark") {
-            size_t space_pos = command.find(' ');
-            if (space_pos != std::string::npos) {
-                std::string name = command.substr(space_pos + 1);
-                removeBookmark(name);
+        }
+        if (paths.size() < 2) {
+            std::cout << "Usage: cp [-L] [--verify] [--nocache | --direct] [source...] [destination]\n";
+            return STATUS_USAGE;
+        }
+
+        // The cache mode applies to this command only
+        CopyEngine& engine = file_ops->getCopyEngine();
+        CacheMode previous_mode = engine.getCacheMode();
+        engine.setCacheMode(cache_mode);
+        bool success;
+        if (paths.size() > 2) {
+            std::vector<std::string> sources(paths.begin(), paths.end() - 1);
+            success = reportBatch("Copied", file_ops->copyMultiple(sources, paths.back(), true, verify, follow_links));
+        } else {
+            success = copyFile(paths[0], paths[1], verify, follow_links);
+        }
+        engine.setCacheMode(previous_mode);
+        return status(success);
+    };
+
+    commands["hash"] = [this, status](const std::vector<std::string>& args) {
+        ChecksumAlgorithm algorithm = ChecksumAlgorithm::XXH64;
+        std::vector<std::string> paths;
+        for (size_t i = 1; i < args.size(); i++) {
+            if (args[i] == "--sha256") {
+                algorithm = ChecksumAlgorithm::SHA256;
+            } else if (args[i] == "--xxh64") {
+                algorithm = ChecksumAlgorithm::XXH64;
             } else {
-                std::cout << "Usage: unmark [bookmark_name]" << std::endl;
+                paths.push_back(args[i]);
             }
-        } else if (command == "bookmarks") {
-            showBookmarks();
-        } else if (command == "history") {
-            showHistory();
-        } else if (command.substr(0, 2) == "cp") {
-            size_t first_space = command.find(' ');
-            if (first_space != std::string::npos) {
-                size_t second_space = command.find(' ', first_space + 1);
-                if (second_space != std::string::npos) {
-                    std::string source = command.substr(first_space + 1, second_space - first_space - 1);
-                    std::string destination = command.substr(second_space + 1);
-                    copyFile(source, destination);
+        }
+        if (paths.empty()) {
+            std::cout << "Usage: hash [--sha256] [file...]\n";
+            return STATUS_USAGE;
+        }
+        return status(checksumFiles(paths, algorithm));
+    };
+
+    commands["cmp"] = [this, status](const std::vector<std::string>& args) {
+        if (args.size() != 3) {
+            std::cout << "Usage: cmp [file1] [file2]\n";
+            return STATUS_USAGE;
+        }
+        return status(compareFiles(args[1], args[2]));
+    };
+
+    commands["diff"] = [this, status](const std::vector<std::string>& args) {
+        if (args.size() != 3) {
+            std::cout << "Usage: diff [dir1] [dir2]\n";
+            return STATUS_USAGE;
+        }
+        return status(compareDirectories(args[1], args[2]));
+    };
+
+    commands["mv"] = [this, status](const std::vector<std::string>& args) {
+        if (args.size() < 3) {
+            std::cout << "Usage: mv [source...] [destination]\n";
+            return STATUS_USAGE;
+        }
+        if (args.size() > 3) {
+            std::vector<std::string> sources(args.begin() + 1, args.end() - 1);
+            return status(reportBatch("Moved", file_ops->moveMultiple(sources, args.back())));
+        }
+        return status(moveFile(args[1], args[2]));
+    };
+
+    commands["ln"] = [this, status](const std::vector<std::string>& args) {
+        if (args.size() != 4 || args[1] != "-s") {
+            std::cout << "Usage: ln -s [target] [link]\n";
+            return STATUS_USAGE;
+        }
+        return status(createLink(args[2], args[3]));
+    };
+
+    commands["mvbatch"] = [this, status](const std::vector<std::string>& args) {
+        if (args.size() == 3 && args[1] == "--undo") {
+            OperationResult result = file_ops->undoBatchMove(args[2]);
+            std::cout << (result.success ? "" : "Error: ") << result.message << "\n";
+            printResultDetails(result);
+            return status(result.success);
+        }
+        if (args.size() == 2) {
+            return status(movePlan(args[1], ""));
+        }
+        if (args.size() == 4 && args[1] == "--log") {
+            return status(movePlan(args[3], args[2]));
+        }
+        std::cout << "Usage: mvbatch [--log FILE] [plan] | mvbatch --undo FILE\n";
+        return STATUS_USAGE;
+    };
+
+    commands["rm"] = [this, status](const std::vector<std::string>& args) {
+        bool force = false;
+        bool background = false;
+        size_t first = 1;
+        for (; first < args.size() && args[first].size() > 1 && args[first][0] == '-'; first++) {
+            for (size_t i = 1; i < args[first].size(); i++) {
+                if (args[first][i] == 'f') {
+                    force = true;
+                } else if (args[first][i] == 'b') {
+                    background = true;
                 } else {
-                    std::cout << "Usage: cp [source] [destination]" << std::endl;
+                    first = args.size();
+                    break;
+                }
+            }
+        }
+        if (args.size() <= first) {
+            std::cout << "Usage: rm [-f] [-b] [path...]\n";
+            return STATUS_USAGE;
+        }
+        if (!force && !interactive) {
+            std::cerr << "Error: rm needs -f in batch mode (no confirmation possible)\n";
+            return STATUS_FAILED;
+        }
+        if (args.size() - first == 1) {
+            return status(deleteFile(args[first], !force, background));
+        }
+
+        std::vector<std::string> paths(args.begin() + first, args.end());
+        if (!force) {
+            std::cout << "Are you sure you want to delete " << paths.size() << " items? (y/N): ";
+            std::string confirmation;
+            std::getline(std::cin, confirmation);
+            if (confirmation != "y" && confirmation != "Y") {
+                std::cout << "Delete operation cancelled.\n";
+                return STATUS_FAILED;
+            }
+        }
+        if (background) {
+            bool all_ok = true;
+            for (const auto& path : paths) {
+                all_ok = deleteFile(path, false, true) && all_ok;
+            }
+            return status(all_ok);
+        }
+        return status(reportBatch("Deleted", file_ops->removeMultiple(paths, true, false)));
+    };
+
+    commands["shred"] = [this, status](const std::vector<std::string>& args) {
+        bool force = false;
+        long passes = 3;
+        std::vector<std::string> paths;
+        for (size_t i = 1; i < args.size(); i++) {
+            if (args[i] == "-f") {
+                force = true;
+            } else if (args[i] == "-n" && i + 1 < args.size()) {
+                char* end = nullptr;
+                passes = strtol(args[++i].c_str(), &end, 10);
+                if (passes < 1 || *end != '\0') {
+                    std::cout << "Error: -n needs a positive number of passes\n";
+                    return STATUS_USAGE;
                 }
             } else {
-                std::cout << "Usage: cp [source] [destination]" << std::endl;
+                paths.push_back(args[i]);
             }
-        } else if (command.substr(0, 2) == "mv") {
-            size_t first_space = command.find(' ');
-            if (first_space != std::string::npos) {
-                size_t second_space = command.find(' ', first_space + 1);
-                if (second_space != std::string::npos) {
-                    std::string source = command.substr(first_space + 1, second_space - first_space - 1);
-                    std::string destination = command.substr(second_space + 1);
-                    moveFile(source, destination);
-                } else {
-                    std::cout << "Usage: mv [source] [destination]" << std::endl;
+        }
+        if (paths.empty()) {
+            std::cout << "Usage: shred [-f] [-n PASSES] [path...]\n";
+            return STATUS_USAGE;
+        }
+        if (!force && !interactive) {
+            std::cerr << "Error: shred needs -f in batch mode (no confirmation possible)\n";
+            return STATUS_FAILED;
+        }
+        bool all_ok = true;
+        for (const auto& path : paths) {
+            all_ok = shredFile(path, static_cast<int>(passes), !force) && all_ok;
+        }
+        return status(all_ok);
+    };
+
+    commands["mkdir"] = [this, joinArgs, status](const std::vector<std::string>& args) {
+        if (args.size() < 2) {
+            std::cout << "Usage: mkdir [path]\n";
+            return STATUS_USAGE;
+        }
+        return status(createDirectory(joinArgs(args, 1)));
+    };
+
+    commands["touch"] = [this, joinArgs, status](const std::vector<std::string>& args) {
+        if (args.size() < 2) {
+            std::cout << "Usage: touch [file]\n";
+            return STATUS_USAGE;
+        }
+        return status(createFile(joinArgs(args, 1)));
+    };
+
+    commands["du"] = [this, joinArgs, status](const std::vector<std::string>& args) {
+        bool fresh = false;
+        long top = 0;
+        std::vector<std::string> rest(1, args[0]);
+        for (size_t i = 1; i < args.size(); i++) {
+            if (args[i] == "--fresh") {
+                fresh = true;
+            } else if (args[i] == "--top") {
+                char* end = nullptr;
+                top = (i + 1 < args.size()) ? strtol(args[++i].c_str(), &end, 10) : 0;
+                if (top < 1 || (end && *end != '\0')) {
+                    std::cout << "Usage: du [--fresh] [--top N] [path]\n";
+                    return STATUS_USAGE;
                 }
             } else {
-                std::cout << "Usage: mv [source] [destination]" << std::endl;
+                rest.push_back(args[i]);
             }
-        } else if (command.substr(0, 2) == "rm") {
-            size_t space_pos = command.find(' ');
-            if (space_pos != std::string::npos) {
-                std::string path = command.substr(space_pos + 1);
-                deleteFile(path);
+        }
+        if (top > 0) {
+            return status(showLargest(joinArgs(rest, 1), static_cast<size_t>(top)));
+        }
+        return status(showDiskUsage(joinArgs(rest, 1), !fresh));
+    };
+
+    commands["biggest"] = [this, joinArgs, status](const std::vector<std::string>& args) {
+        size_t first = 1;
+        long limit = 10;
+        if (args.size() > 1 && !args[1].empty() &&
+            std::all_of(args[1].begin(), args[1].end(), [](char c) { return c >= '0' && c <= '9'; })) {
+            limit = strtol(args[1].c_str(), nullptr, 10);
+            first = 2;
+        }
+        if (limit < 1) {
+            std::cout << "Usage: biggest [N] [path]\n";
+            return STATUS_USAGE;
+        }
+        return status(showLargest(joinArgs(args, first), static_cast<size_t>(limit)));
+    };
+
+    commands["dupes"] = [this, joinArgs, status](const std::vector<std::string>& args) {
+        return status(showDuplicates(joinArgs(args, 1)));
+    };
+
+    commands["file"] = [this, status](const std::vector<std::string>& args) {
+        if (args.size() < 2) {
+            std::cout << "Usage: file [path...]\n";
+            return STATUS_USAGE;
+        }
+        return status(showMimeTypes(std::vector<std::string>(args.begin() + 1, args.end())));
+    };
+
+    commands["find"] = [this, status](const std::vector<std::string>& args) {
+        SearchCriteria criteria;
+        criteria.include_hidden = show_hidden_files;
+        std::string path;
+        for (size_t i = 1; i < args.size(); i++) {
+            bool has_value = i + 1 < args.size();
+            if (args[i] == "--name" && has_value) {
+                criteria.name_pattern = args[++i];
+            } else if (args[i] == "--type" && has_value) {
+                criteria.mime_type = args[++i];
+            } else if (args[i] == "--grep" && has_value) {
+                criteria.content_pattern = args[++i];
+                criteria.search_content = true;
+                criteria.use_regex = true;
+            } else if (path.empty() && args[i].compare(0, 2, "--") != 0) {
+                path = args[i];
             } else {
-                std::cout << "Usage: rm [path]" << std::endl;
+                std::cout << "Usage: find [path] [--name GLOB] [--type MIME] [--grep REGEX]\n";
+                return STATUS_USAGE;
             }
-        } else if (command.substr(0, 5) == "mkdir") {
-            size_t space_pos = command.find(' ');
-            if (space_pos != std::string::npos) {
-                std::string path = command.substr(space_pos + 1);
-                createDirectory(path);
+        }
+        return status(findFiles(path, criteria));
+    };
+
+    commands["throttle"] = [this, status](const std::vector<std::string>& args) {
+        if (args.size() == 1) {
+            showThrottle();
+            return STATUS_OK;
+        }
+        if (args.size() == 2 && args[1] == "off") {
+            return status(setThrottle(0, 0, false));
+        }
+
+        // Counts with an optional binary K/M/G/T suffix
+        auto parseCount = [](const std::string& text, size_t& value) {
+            char* end = nullptr;
+            double number = strtod(text.c_str(), &end);
+            if (end == text.c_str() || number < 0) return false;
+            const char* suffixes = "KMGT";
+            const char* suffix = *end ? strchr(suffixes, toupper(static_cast<unsigned char>(*end))) : nullptr;
+            if (*end && (!suffix || end[1] != '\0')) return false;
+            if (suffix) number *= static_cast<double>(1ULL << (10 * (suffix - suffixes + 1)));
+            value = static_cast<size_t>(number);
+            return true;
+        };
+
+        bool idle = false;
+        std::vector<size_t> limits;
+        for (size_t i = 1; i < args.size(); i++) {
+            size_t value = 0;
+            if (args[i] == "--idle") {
+                idle = true;
+            } else if (limits.size() < 2 && parseCount(args[i], value)) {
+                limits.push_back(value);
             } else {
-                std::cout << "Usage: mkdir [path]" << std::endl;
+                std::cout << "Usage: throttle [off | RATE [OPS] [--idle]]\n";
+                return STATUS_USAGE;
             }
-        } else if (command.substr(0, 5) == "touch") {
-            size_t space_pos = command.find(' ');
-            if (space_pos != std::string::npos) {
-                std::string path = command.substr(space_pos + 1);
-                createFile(path);
+        }
+        limits.resize(2, 0);
+        return status(setThrottle(limits[0], limits[1], idle));
+    };
+
+    commands["tree"] = [this, status](const std::vector<std::string>& args) {
+        std::string path;
+        int max_depth = -1;
+        for (size_t i = 1; i < args.size(); i++) {
+            if (args[i] == "-L") {
+                char* end = nullptr;
+                max_depth = (i + 1 < args.size()) ? static_cast<int>(strtol(args[++i].c_str(), &end, 10)) : 0;
+                if (max_depth < 1 || (end && *end != '\0')) {
+                    std::cout << "Usage: tree [path] [-L depth]\n";
+                    return STATUS_USAGE;
+                }
             } else {
-                std::cout << "Usage: touch [file]" << std::endl;
+                path = args[i];
             }
-        } else if (command.substr(0, 2) == "du") {
-            size_t space_pos = command.find(' ');
-            if (space_pos != std::string::npos) {
-                std::string path = command.substr(space_pos + 1);
-                showDiskUsage(path);
+        }
+        return status(showTree(path, max_depth));
+    };
+
+    commands["watch"] = [this, status](const std::vector<std::string>& args) {
+        if (!interactive) {
+            std::cerr << "Error: watch is only available in interactive mode\n";
+            return STATUS_FAILED;
+        }
+        std::string path = args.size() > 1 ? args[1] : "";
+        int refresh_ms = args.size() > 2 ? atoi(args[2].c_str()) : 500;
+        if (refresh_ms <= 0) {
+            refresh_ms = 500;
+        }
+        return status(watchDirectory(path, refresh_ms));
+    };
+
+    commands["hidden"] = [this](const std::vector<std::string>&) {
+        show_hidden_files = !show_hidden_files;
+        std::cout << "Hidden files " << (show_hidden_files ? "shown" : "hidden") << "\n";
+        return STATUS_OK;
+    };
+}
+
+bool FileExplorer::tokenize(const std::string& line, std::vector<std::string>& tokens, std::string& error) {
+    tokens.clear();
+    std::string current;
+    bool in_token = false;
+    char quote = '\0';
+
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+
+        if (quote != '\0') {
+            if (c == quote) {
+                quote = '\0';
+            } else if (c == '\\' && quote == '"' && i + 1 < line.size() &&
+                       (line[i + 1] == '"' || line[i + 1] == '\\')) {
+                current += line[++i];
             } else {
-                showDiskUsage();
+                current += c;
+            }
+        } else if (c == '"' || c == '\'') {
+            quote = c;
+            in_token = true;
+        } else if (c == '\\' && i + 1 < line.size()) {
+            current += line[++i];
+            in_token = true;
+        } else if (c == ' ' || c == '\t' || c == '\r') {
+            if (in_token) {
+                tokens.push_back(std::move(current));
+                current.clear();
+                in_token = false;
             }
-        } else if (command == "hidden") {
-            show_hidden_files = !show_hidden_files;
-            std::cout << "Hidden files " << (show_hidden_files ? "shown" : "hidden") << std::endl;
         } else {
-            std::cout << "Unknown command: " << command << std::endl;
-            std::cout << "Type 'help' for available commands." << std::endl;
+            current += c;
+            in_token = true;
         }
     }
+
+    if (quote != '\0') {
+        error = std::string("unterminated ") + quote + " quote";
+        return false;
+    }
+    if (in_token) {
+        tokens.push_back(std::move(current));
+    }
+    return true;
+}
+
+int FileExplorer::executeCommand(const std::string& line) {
+    std::vector<std::string> tokens;
+    std::string error;
+
+    if (!tokenize(line, tokens, error)) {
+        std::cerr << "Error: " << error << "\n";
+        return STATUS_USAGE;
+    }
+    if (tokens.empty() || tokens[0][0] == '#') {
+        return STATUS_OK;
+    }
+
+    auto it = commands.find(tokens[0]);
+    if (it == commands.end()) {
+        std::cout << "Unknown command: " << tokens[0] << "\n";
+        std::cout << "Type 'help' for available commands.\n";
+        return STATUS_UNKNOWN_COMMAND;
+    }
+
+    return it->second(tokens);
+}
+
+void FileExplorer::run() {
+    std::string command;
+
+    interactive = true;
+    exit_requested = false;
+    printCurrentDirectory();
+
+    while (!exit_requested) {
+        std::cout << "\nFile Explorer> ";
+        if (!std::getline(std::cin, command)) {
+            std::cout << std::endl;
+            break;
+        }
+
+        executeCommand(command);
+    }
+}
+
+int FileExplorer::runBatch(std::istream& input, const std::string& source_name) {
+    std::string line;
+    size_t line_number = 0;
+    size_t executed = 0;
+    size_t failed = 0;
+
+    interactive = false;
+    exit_requested = false;
+    auto start = std::chrono::steady_clock::now();
+
+    while (!exit_requested && std::getline(input, line)) {
+        line_number++;
+
+        int result = executeCommand(line);
+        executed++;
+        if (result != STATUS_OK) {
+            failed++;
+            std::cout.flush();
+            std::cerr << source_name << ":" << line_number << ": exit " << result << ": " << line << "\n";
+        }
+    }
+
+    std::cout.flush();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << "Batch complete: " << executed << " commands, " << failed << " failed, "
+              << std::fixed << std::setprecision(3) << elapsed << "s";
+    if (elapsed > 0) {
+        std::cerr << " (" << std::setprecision(0) << executed / elapsed << " commands/sec)";
+    }
+    std::cerr << std::endl;
+
+    return failed == 0 ? STATUS_OK : STATUS_FAILED;
 }
 
 bool FileExplorer::directoryExists(const std::string& path) {
@@ -431,7 +1370,7 @@ bool FileExplorer::goToBookmark(const std::string& name) {
 void FileExplorer::showBookmarks() {
     auto bookmarks = navigator->getBookmarks();
     if (bookmarks.empty()) {
-        std::cout << "No bookmarks saved." << std::endl;
+        std::cout << "No bookmarks saved.\n";
         return;
     }
 
@@ -468,17 +1407,70 @@ void FileExplorer::showHistory() {
     }
 
     if (back_history.empty() && forward_history.empty()) {
-        std::cout << "No navigation history available." << std::endl;
+        std::cout << "No navigation history available.\n";
+    }
+}
+
+void FileExplorer::printResultDetails(const OperationResult& result, size_t indent) {
+    const size_t max_shown = 20;
+    size_t shown = 0;
+
+    for (const auto& item : result.details) {
+        if (item.success) continue;
+        if (shown++ == max_shown) {
+            std::cout << std::string(indent, ' ') << "...\n";
+            break;
+        }
+        std::cout << std::string(indent, ' ') << item.path << ": " << item.message << "\n";
+        printResultDetails(item, indent + 2);
+    }
+}
+
+bool FileExplorer::reportBatch(const std::string& verb, const OperationResult& result) {
+    if (result.details.empty()) {
+        std::cout << "Error: " << result.message << "\n";
+        return false;
+    }
+
+    for (const auto& item : result.details) {
+        if (item.success) {
+            std::cout << verb << " '" << item.path << "'\n";
+        }
+    }
+    if (!result.success) {
+        std::cout << "Error: " << result.message << "\n";
+        printResultDetails(result);
+    }
+    return result.success;
+}
+
+bool FileExplorer::copyFile(const std::string& source, const std::string& destination, bool verify,
+                            bool follow_links) {
+    OperationResult result = file_ops->copy(source, destination, true, true, verify, follow_links);
+    if (result.success) {
+        // A tree of only directories has no copy methods to name
+        CacheMode cache_mode = file_ops->getCopyEngine().getCacheMode();
+        std::string via = file_ops->describeLastCopy();
+        if (!via.empty() && cache_mode != CacheMode::Normal) {
+            via += std::string(", ") + cacheModeName(cache_mode);
+        }
+        std::cout << "Copied '" << source << "' to '" << destination << "'" << (via.empty() ? "" : " via " + via)
+                  << "\n";
+        return true;
+    } else {
+        std::cout << "Error: " << result.message << "\n";
+        printResultDetails(result);
+        return false;
     }
 }
 
-bool FileExplorer::copyFile(const std::string& source, const std::string& destination) {
-    OperationResult result = file_ops->copy(source, destination, true, true);
+bool FileExplorer::createLink(const std::string& target, const std::string& link_path) {
+    OperationResult result = file_ops->createSymbolicLink(target, link_path);
     if (result.success) {
-        std::cout << "Copied '" << source << "' to '" << destination << "'" << std::endl;
+        std::cout << "Linked '" << link_path << "' -> '" << target << "'\n";
         return true;
     } else {
-        std::cout << "Error: " << result.message << std::endl;
+        std::cout << "Error: " << result.message << "\n";
         return false;
     }
 }
@@ -486,30 +1478,123 @@ bool FileExplorer::copyFile(const std::string& source, const std::string& destin
 bool FileExplorer::moveFile(const std::string& source, const std::string& destination) {
     OperationResult result = file_ops->move(source, destination);
     if (result.success) {
-        std::cout << "Moved '" << source << "' to '" << destination << "'" << std::endl;
+        std::cout << "Moved '" << source << "' to '" << destination << "'\n";
         return true;
     } else {
-        std::cout << "Error: " << result.message << std::endl;
+        std::cout << "Error: " << result.message << "\n";
+        printResultDetails(result);
         return false;
     }
 }
 
-bool FileExplorer::deleteFile(const std::string& path) {
-    std::cout << "Are you sure you want to delete '" << path << "'? (y/N): ";
-    std::string confirmation;
-    std::getline(std::cin, confirmation);
+bool FileExplorer::movePlan(const std::string& plan_path, const std::string& log_path) {
+    std::ifstream plan(plan_path);
+    if (!plan) {
+        std::cout << "Error: cannot read plan '" << plan_path << "'\n";
+        return false;
+    }
 
-    if (confirmation == "y" || confirmation == "Y") {
-        OperationResult result = file_ops->remove(path, true, false);
-        if (result.success) {
-            std::cout << "Deleted '" << path << "'" << std::endl;
-            return true;
-        } else {
-            std::cout << "Error: " << result.message << std::endl;
+    std::vector<std::pair<std::string, std::string>> pairs;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(plan, line)) {
+        line_number++;
+        if (line.empty()) continue;
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos || line.find('\t', tab + 1) != std::string::npos) {
+            std::cout << "Error: " << plan_path << ":" << line_number << ": expected source<TAB>destination\n";
             return false;
         }
+        pairs.emplace_back(line.substr(0, tab), line.substr(tab + 1));
+    }
+
+    OperationResult result = file_ops->batchMove(pairs, log_path);
+    std::cout << (result.success ? "" : "Error: ") << result.message << "\n";
+    printResultDetails(result);
+    return result.success;
+}
+
+bool FileExplorer::compareFiles(const std::string& file1, const std::string& file2) {
+    OperationResult result = file_ops->compareFiles(file1, file2);
+    if (result.success) {
+        std::cout << result.message << "\n";
+        return true;
+    }
+    if (result.error_code != 0) {
+        std::cout << "Error: " << result.message << "\n";
     } else {
-        std::cout << "Delete operation cancelled." << std::endl;
+        std::cout << "'" << file1 << "' and '" << file2 << "': " << result.message << "\n";
+    }
+    return false;
+}
+
+bool FileExplorer::compareDirectories(const std::string& dir1, const std::string& dir2) {
+    OperationResult result = file_ops->compareDirectories(dir1, dir2);
+    if (result.success) {
+        std::cout << result.message << "\n";
+        return true;
+    }
+    if (result.details.empty()) {
+        std::cout << "Error: " << result.message << "\n";
+        return false;
+    }
+
+    OutputRenderer out;
+    for (const auto& change : result.details) {
+        char marker = change.message == "added" ? '+' : change.message == "removed" ? '-' :
+                      change.message == "changed" ? '~' : '?';
+        out.append(marker);
+        out.append(' ');
+        out.append(change.path);
+        out.endRow();
+    }
+    out.flush();
+    std::cout << result.message << "\n";
+    return false;
+}
+
+bool FileExplorer::deleteFile(const std::string& path, bool confirm, bool background) {
+    if (confirm) {
+        std::cout << "Are you sure you want to delete '" << path << "'? (y/N): ";
+        std::string confirmation;
+        std::getline(std::cin, confirmation);
+
+        if (confirmation != "y" && confirmation != "Y") {
+            std::cout << "Delete operation cancelled.\n";
+            return false;
+        }
+    }
+
+    OperationResult result = background ? file_ops->removeInBackground(path) : file_ops->remove(path, true, false);
+    if (result.success) {
+        std::cout << (background ? "Deleting '" : "Deleted '") << path << (background ? "' in the background\n" : "'\n");
+        return true;
+    } else {
+        std::cout << "Error: " << result.message << "\n";
+        printResultDetails(result);
+        return false;
+    }
+}
+
+bool FileExplorer::shredFile(const std::string& path, int passes, bool confirm) {
+    if (confirm) {
+        std::cout << "Overwrite and delete '" << path << "'? It cannot be recovered. (y/N): ";
+        std::string confirmation;
+        std::getline(std::cin, confirmation);
+
+        if (confirmation != "y" && confirmation != "Y") {
+            std::cout << "Shred cancelled.\n";
+            return false;
+        }
+    }
+
+    OperationResult result = file_ops->secureDelete(path, passes);
+    if (result.success) {
+        std::cout << "Shredded '" << path << "': " << result.message << "\n";
+        return true;
+    } else {
+        std::cout << "Error: " << result.message << "\n";
+        printResultDetails(result);
         return false;
     }
 }
@@ -517,10 +1602,10 @@ bool FileExplorer::deleteFile(const std::string& path) {
 bool FileExplorer::createDirectory(const std::string& path) {
     OperationResult result = file_ops->createDirectory(path, true);
     if (result.success) {
-        std::cout << "Created directory '" << path << "'" << std::endl;
+        std::cout << "Created directory '" << path << "'\n";
         return true;
     } else {
-        std::cout << "Error: " << result.message << std::endl;
+        std::cout << "Error: " << result.message << "\n";
         return false;
     }
 }
@@ -528,22 +1613,263 @@ bool FileExplorer::createDirectory(const std::string& path) {
 bool FileExplorer::createFile(const std::string& path) {
     OperationResult result = file_ops->createFile(path);
     if (result.success) {
-        std::cout << "Created file '" << path << "'" << std::endl;
+        std::cout << "Created file '" << path << "'\n";
         return true;
     } else {
-        std::cout << "Error: " << result.message << std::endl;
+        std::cout << "Error: " << result.message << "\n";
         return false;
     }
 }
 
-void FileExplorer::showDiskUsage(const std::string& path) {
+bool FileExplorer::showDiskUsage(const std::string& path, bool use_cache) {
     std::string target_path = path.empty() ? getCurrentPath() : path;
-    size_t total_size = 0;
+    UsageTotals totals;
 
-    OperationResult result = file_ops->calculateSize(target_path, true, total_size);
-    if (result.success) {
-        std::cout << "Disk usage for '" << target_path << "': " << file_ops->formatFileSize(total_size) << std::endl;
+    OperationResult result = file_ops->calculateUsage(target_path, totals, use_cache);
+    if (!result.success) {
+        std::cout << "Error: " << result.message << "\n";
+        return false;
+    }
+
+    std::cout << "Disk usage for '" << target_path << "': " << formatFileSize(totals.allocated_bytes)
+              << " on disk, " << formatFileSize(totals.apparent_bytes) << " apparent\n";
+    std::cout << "  " << totals.files << " files, " << totals.directories << " directories";
+    if (totals.cached_directories > 0) {
+        std::cout << " (" << totals.cached_directories << " unchanged since last scan)";
+    }
+    std::cout << "\n";
+    if (totals.errors > 0) {
+        std::cout << "  " << totals.errors << " entries could not be read\n";
+    }
+    return true;
+}
+
+bool FileExplorer::showLargest(const std::string& path, size_t limit) {
+    std::string target_path = path.empty() ? getCurrentPath() : path;
+
+    auto sizeColumn = [this](size_t bytes) {
+        std::ostringstream column;
+        column << std::right << std::setw(10) << formatFileSize(bytes);
+        return column.str();
+    };
+    auto printBreakdown = [&](const UsageItem& item) {
+        for (const auto& child : item.largest_children) {
+            std::cout << "            " << sizeColumn(child.second) << "  " << child.first << "\n";
+        }
+        if (item.direct_bytes > 0) {
+            std::cout << "            " << sizeColumn(item.direct_bytes) << "  (all files directly inside)\n";
+        }
+    };
+
+    // Long scans show the leaders found so far; batch output stays final-only
+    TopProgress progress;
+    if (interactive) {
+        progress = [&](const TopReport& partial) {
+            std::cout << "... " << partial.totals.files << " files, "
+                      << formatFileSize(partial.totals.allocated_bytes) << " scanned so far\n";
+            for (const auto& item : partial.directories) {
+                std::cout << "  " << sizeColumn(item.bytes) << "  " << item.path << "/\n";
+            }
+            for (const auto& item : partial.files) {
+                std::cout << "  " << sizeColumn(item.bytes) << "  " << item.path << "\n";
+            }
+            std::cout.flush();
+        };
+    }
+
+    TopReport report;
+    OperationResult result = file_ops->findLargest(target_path, limit, report, progress);
+    if (!result.success) {
+        std::cout << "Error: " << result.message << "\n";
+        return false;
+    }
+
+    std::cout << "Disk usage for '" << target_path << "': " << formatFileSize(report.root.bytes) << " on disk, "
+              << report.totals.files << " files, " << report.totals.directories << " directories\n";
+    printBreakdown(report.root);
+
+    if (!report.directories.empty()) {
+        std::cout << "\nLargest directories:\n";
+        for (const auto& item : report.directories) {
+            std::cout << "  " << sizeColumn(item.bytes) << "  " << item.path << "/\n";
+            printBreakdown(item);
+        }
+    }
+
+    if (!report.files.empty()) {
+        std::cout << "\nLargest files:\n";
+        for (const auto& item : report.files) {
+            std::cout << "  " << sizeColumn(item.bytes) << "  " << item.path << "\n";
+        }
+    }
+
+    if (report.totals.errors > 0) {
+        std::cout << "\n" << report.totals.errors << " entries could not be read\n";
+    }
+    return true;
+}
+
+bool FileExplorer::showMimeTypes(const std::vector<std::string>& paths) {
+    bool all_ok = true;
+    OutputRenderer out;
+    for (const auto& path : paths) {
+        struct stat st;
+        if (lstat(path.c_str(), &st) != 0) {
+            out.flush();
+            std::cout << "Error: Cannot stat '" << path << "': " << strerror(errno) << "\n";
+            all_ok = false;
+            continue;
+        }
+        out.append(path);
+        out.append(": ");
+        out.append(file_ops->getMimeType(path));
+        out.endRow();
+    }
+    out.flush();
+    return all_ok;
+}
+
+bool FileExplorer::findFiles(const std::string& path, const SearchCriteria& criteria) {
+    std::string target_path = path.empty() ? getCurrentPath() : path;
+    SearchEngine search;
+    std::vector<SearchResult> results = search.findFiles(target_path, criteria);
+    if (criteria.search_content) {
+        // Only the files whose contents matched
+        results.erase(std::remove_if(results.begin(), results.end(), [](const SearchResult& result) {
+            return result.content_matches.empty();
+        }), results.end());
+    }
+    search.displayResults(results);
+    return !results.empty();
+}
+
+bool FileExplorer::showDuplicates(const std::string& path) {
+    std::string target_path = path.empty() ? getCurrentPath() : path;
+
+    DuplicateReport report;
+    OperationResult result = file_ops->findDuplicates(target_path, report);
+    if (!result.success) {
+        std::cout << "Error: " << result.message << "\n";
+        return false;
+    }
+
+    OutputRenderer out;
+    for (const auto& group : report.groups) {
+        std::ostringstream header;
+        header << group.copies.size() << " copies of " << formatFileSize(group.size) << ", "
+               << formatFileSize(group.reclaimable_bytes) << " reclaimable:";
+        out.append(header.str());
+        out.endRow();
+        for (const auto& links : group.copies) {
+            out.append("  ");
+            out.append(links.front());
+            out.endRow();
+            // Further names of the same inode share its data, so they are not copies
+            for (size_t i = 1; i < links.size(); i++) {
+                out.append("    = ");
+                out.append(links[i]);
+                out.endRow();
+            }
+        }
+    }
+    out.flush();
+
+    if (report.groups.empty()) {
+        std::cout << "No duplicate files under '" << target_path << "' (" << result.message << ")\n";
+    } else {
+        std::cout << report.groups.size() << " group(s), " << report.duplicate_files << " redundant file(s), "
+                  << formatFileSize(report.reclaimable_bytes) << " reclaimable (" << result.message << ")\n";
+    }
+    return true;
+}
+
+bool FileExplorer::setThrottle(size_t bytes_per_second, size_t ops_per_second, bool idle_priority) {
+    Throttle& throttle = file_ops->getThrottle();
+    throttle.setLimits(bytes_per_second, ops_per_second);
+
+    bool success = true;
+    if (idle_priority != throttle.stats().idle_priority && !throttle.setIdlePriority(idle_priority)) {
+        std::cout << "Error: cannot change I/O priority: " << strerror(errno) << "\n";
+        success = false;
+    }
+
+    // Progress is only worth printing while something holds operations back
+    if (throttle.isLimited()) {
+        file_ops->setProgressCallback([this](const ProgressSnapshot& snapshot) { reportThrottledProgress(snapshot); });
     } else {
-        std::cout << "Error: " << result.message << std::endl;
+        file_ops->setProgressCallback(nullptr);
     }
-}
\ No newline at end of file
+    showThrottle();
+    return success;
+}
+
+void FileExplorer::showThrottle() {
+    ThrottleStats stats = file_ops->getThrottle().stats();
+    std::cout << "Throttle: ";
+    if (stats.bytes_limit == 0 && stats.ops_limit == 0) {
+        std::cout << "off";
+    } else {
+        std::cout << (stats.bytes_limit ? formatFileSize(stats.bytes_limit) + "/s" : "unlimited bytes") << ", "
+                  << (stats.ops_limit ? std::to_string(stats.ops_limit) + " ops/s" : "unlimited ops");
+    }
+    std::cout << (stats.idle_priority ? ", idle I/O priority" : "") << "\n";
+    std::ostringstream waited;
+    waited << std::fixed << std::setprecision(1) << stats.waited_seconds;
+    std::cout << "Charged so far: " << formatFileSize(stats.bytes_total) << ", " << stats.ops_total << " ops, "
+              << waited.str() << "s waited (summed over threads)\n";
+}
+
+// Called on the operation's reporter thread, about 10 times a second; one
+// line a second is plenty on a terminal, plus the final one
+void FileExplorer::reportThrottledProgress(const ProgressSnapshot& snapshot) {
+    auto now = std::chrono::steady_clock::now();
+    if (!snapshot.finished && now - last_progress_report < std::chrono::seconds(1)) {
+        return;
+    }
+    last_progress_report = now;
+
+    ThrottleStats stats = file_ops->getThrottle().stats();
+    std::ostringstream line;
+    line << "  " << formatFileSize(snapshot.bytes_done) << " of " << formatFileSize(snapshot.bytes_total) << ", "
+         << snapshot.files_done << "/" << snapshot.files_total << " files, "
+         << formatFileSize(static_cast<size_t>(snapshot.bytes_per_second)) << "/s";
+    if (stats.bytes_limit > 0) line << " (limit " << formatFileSize(stats.bytes_limit) << "/s)";
+    line << ", " << static_cast<size_t>(stats.ops_rate) << " ops/s";
+    if (stats.ops_limit > 0) line << " (limit " << stats.ops_limit << ")";
+    if (snapshot.finished) {
+        line << ", done in " << std::fixed << std::setprecision(1) << snapshot.elapsed_seconds << "s";
+    } else if (snapshot.eta_seconds >= 0) {
+        line << ", " << static_cast<size_t>(snapshot.eta_seconds + 0.5) << "s left";
+    }
+    std::cerr << line.str() << "\n";
+}
+
+bool FileExplorer::checksumFiles(const std::vector<std::string>& paths, ChecksumAlgorithm algorithm) {
+    bool all_ok = true;
+    size_t total_bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    // Same layout as sha256sum, so the output can be checked with it
+    for (const auto& path : paths) {
+        std::string digest;
+        size_t bytes = 0;
+        OperationResult result = file_ops->checksumFile(path, algorithm, digest, &bytes);
+        if (!result.success) {
+            std::cout << "Error: " << result.message << " (" << strerror(result.error_code) << ")\n";
+            all_ok = false;
+            continue;
+        }
+        std::cout << digest << "  " << path << "\n";
+        total_bytes += bytes;
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout.flush();
+    std::cerr << checksumAlgorithmName(algorithm) << ": " << formatFileSize(total_bytes) << " in "
+              << std::fixed << std::setprecision(3) << elapsed << "s";
+    if (elapsed > 0) {
+        std::cerr << " (" << std::setprecision(2) << total_bytes / elapsed / 1e9 << " GB/s)";
+    }
+    std::cerr << std::endl;
+    return all_ok;
+}
@@ -1,19 +1,50 @@
 #include "FileOperations.h"
+#include "ThreadPool.h"
+#include "JobScheduler.h"
+#include "TreeRemover.h"
+#include "TreeMover.h"
+#include "SecureEraser.h"
+#include "BatchRenamer.h"
+#include "MimeDetector.h"
+#include "DigestCache.h"
+#include "MerkleTree.h"
+#include "OutputRenderer.h"
+#include "BufferPool.h"
+#include "ProgressTracker.h"
+#include "FileId.h"
 #include <iostream>
 #include <fstream>
 #include <filesystem>
 #include <algorithm>
 #include <cstring>
+#include <cstdlib>
 #include <dirent.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sstream>
 #include <iomanip>
-
-FileOperations::FileOperations(bool verbose) : verbose_output(verbose) {
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+
+FileOperations::FileOperations(bool verbose)
+    : verbose_output(verbose), progress(nullptr), tree_remover(new TreeRemover()), worker_count(0),
+      device_concurrency(2) {
+    for (auto& count : copy_method_counts) count = 0;
+    copy_engine.setThrottle(&throttle);
+    disk_usage.setThrottle(&throttle);
+    copy_hole_bytes = 0;
+    copy_verified_files = 0;
+    copy_symlinks = 0;
+    copy_hard_links = 0;
+    verify_copies = false;
+    follow_copy_links = false;
 }
 
+// Waits for background deletes to finish
 FileOperations::~FileOperations() {
 }
 
@@ -25,71 +56,323 @@ void FileOperations::setProgressCallback(ProgressCallback callback) {
     progress_callback = callback;
 }
 
-bool FileOperations::copyFile(const std::string& source, const std::string& destination, bool preserve_attributes) {
-    std::ifstream src(source, std::ios::binary);
-    if (!src) {
+// Gives an operation a tracker for the callback unless it is part of a larger
+// one that already has a tracker, and clears it again when the operation ends
+class ProgressScope {
+private:
+    ProgressTracker*& slot;
+    std::unique_ptr<ProgressTracker> owned;
+
+public:
+    ProgressScope(ProgressTracker*& current, const ProgressCallback& callback) : slot(current) {
+        if (!slot && callback) {
+            owned.reset(new ProgressTracker(callback));
+            slot = owned.get();
+        }
+    }
+    ~ProgressScope() {
+        if (owned) {
+            owned->finish();
+            slot = nullptr;
+        }
+    }
+    bool owns() const { return owned != nullptr; }
+};
+
+CopyEngine& FileOperations::getCopyEngine() {
+    return copy_engine;
+}
+
+Throttle& FileOperations::getThrottle() {
+    return throttle;
+}
+
+void FileOperations::setWorkerCount(size_t count) {
+    worker_count = count;
+    disk_usage.setWorkerCount(count);
+    tree_remover->setWorkerCount(count);
+}
+
+void FileOperations::setDeviceConcurrency(size_t limit) {
+    device_concurrency = limit;
+}
+
+std::string FileOperations::describeLastCopy() const {
+    std::string description;
+    for (int i = static_cast<int>(CopyMethod::Reflink); i <= static_cast<int>(CopyMethod::ReadWrite); i++) {
+        if (copy_method_counts[i] == 0) continue;
+        if (!description.empty()) description += ", ";
+        description += std::to_string(copy_method_counts[i]) + " " + copyMethodName(static_cast<CopyMethod>(i));
+    }
+    if (copy_hole_bytes > 0) {
+        char size[OutputRenderer::FILE_SIZE_CHARS];
+        if (!description.empty()) description += ", ";
+        description += std::string(size, OutputRenderer::formatFileSize(size, copy_hole_bytes)) + " of holes skipped";
+    }
+    if (copy_verified_files > 0) {
+        description += ", " + std::to_string(copy_verified_files) + " verified by xxh64";
+    }
+    if (copy_symlinks > 0) {
+        if (!description.empty()) description += ", ";
+        description += std::to_string(copy_symlinks) + " symlink(s)";
+    }
+    if (copy_hard_links > 0) {
+        if (!description.empty()) description += ", ";
+        description += std::to_string(copy_hard_links) + " hard link(s)";
+    }
+    return description;
+}
+
+CopyMethod FileOperations::copyFileWith(CopyEngine& engine, const std::string& source, const std::string& destination,
+                                        bool preserve_attributes, const CopyEngine::ProgressFn& progress) {
+    int src_fd = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (src_fd < 0) {
         if (verbose_output) std::cerr << "Error: Cannot open source file: " << source << std::endl;
-        return false;
+        return CopyMethod::None;
     }
 
-    std::ofstream dest(destination, std::ios::binary);
-    if (!dest) {
+    struct stat file_stat;
+    if (fstat(src_fd, &file_stat) != 0) {
+        int saved_errno = errno;
+        close(src_fd);
+        errno = saved_errno;
+        return CopyMethod::None;
+    }
+
+    // Verification reads the destination back through the same descriptor
+    int dst_fd = open(destination.c_str(), (verify_copies ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (dst_fd < 0) {
+        int saved_errno = errno;
         if (verbose_output) std::cerr << "Error: Cannot create destination file: " << destination << std::endl;
-        return false;
+        close(src_fd);
+        errno = saved_errno;
+        return CopyMethod::None;
     }
 
-    // Get file size for progress tracking
-    src.seekg(0, std::ios::end);
-    size_t file_size = src.tellg();
-    src.seekg(0, std::ios::beg);
+    XXHash64 checksum;
+    engine.setChecksum(verify_copies ? &checksum : nullptr);
+    CopyMethod method = engine.copy(src_fd, dst_fd, file_stat.st_size, progress);
+    int saved_errno = errno;
+    engine.setChecksum(nullptr);
+
+    // The copy's own length: a source with a placeholder size is read to EOF
+    struct stat dst_stat;
+    if (method != CopyMethod::None && verify_copies && fstat(dst_fd, &dst_stat) != 0) {
+        saved_errno = errno;
+        method = CopyMethod::None;
+    }
+    if (method != CopyMethod::None && verify_copies) {
+        if (verifyCopy(dst_fd, dst_stat.st_size, checksum.digest())) {
+            copy_verified_files++;
+        } else {
+            saved_errno = errno;
+            method = CopyMethod::None;
+            if (verbose_output && saved_errno == EIO) {
+                std::cerr << "Error: '" << destination << "' does not match '" << source << "' after copying" << std::endl;
+            }
+        }
+    }
 
-    char buffer[BUFFER_SIZE];
-    size_t total_copied = 0;
+    if (method != CopyMethod::None && preserve_attributes) {
+        fchmod(dst_fd, file_stat.st_mode & 07777);
+    }
 
-    while (src.read(buffer, BUFFER_SIZE)) {
-        dest.write(buffer, src.gcount());
-        total_copied += src.gcount();
-        updateProgress(total_copied, file_size);
+    close(src_fd);
+    if (close(dst_fd) != 0 && method != CopyMethod::None) {
+        saved_errno = errno;
+        method = CopyMethod::None;
     }
 
-    // Write remaining bytes
-    if (src.gcount() > 0) {
-        dest.write(buffer, src.gcount());
-        total_copied += src.gcount();
-        updateProgress(total_copied, file_size);
+    if (method == CopyMethod::None) {
+        if (verbose_output) std::cerr << "Error: Failed to copy '" << source << "': " << strerror(saved_errno) << std::endl;
+        errno = saved_errno;
+        return CopyMethod::None;
     }
 
-    src.close();
-    dest.close();
+    copy_method_counts[static_cast<int>(method)]++;
+    copy_hole_bytes += engine.lastHoleBytes();
+    return method;
+}
 
-    if (preserve_attributes) {
-        struct stat file_stat;
-        if (stat(source.c_str(), &file_stat) == 0) {
-            chmod(destination.c_str(), file_stat.st_mode);
+// Copies a batch of files with one engine batch, so files that end up on the
+// io_uring method share its queue instead of running one at a time. errors[i]
+// receives 0 or the errno of jobs[i]; progress gets (job index, bytes added).
+void FileOperations::copyFilesWith(CopyEngine& engine, const std::vector<const CopyJob*>& jobs, bool preserve_attributes,
+                                   const std::function<void(size_t, size_t)>& progress, std::vector<int>& errors) {
+    struct OpenFile {
+        int src_fd = -1;
+        int dst_fd = -1;
+        mode_t mode = 0;
+        CopyMethod method = CopyMethod::None;
+        size_t hole_bytes = 0;
+        size_t reported = 0;
+        CopyEngine::ProgressFn on_progress;
+    };
+    std::vector<OpenFile> files(jobs.size());
+    std::vector<size_t> copied;  // file index of each engine copy() in the ring batch
+    std::vector<bool> retry(jobs.size(), false);
+    errors.assign(jobs.size(), 0);
+
+    // The ring holds both descriptors of every queued file until it is
+    // drained, so it is drained every RING_BATCH_FILES files; a file that
+    // still finds the descriptor table full is retried once they are closed
+    for (size_t first = 0; first < jobs.size(); first += RING_BATCH_FILES) {
+        size_t last = std::min(jobs.size(), first + RING_BATCH_FILES);
+        copied.clear();
+
+        engine.beginBatch();
+        for (size_t i = first; i < last; i++) {
+            OpenFile& file = files[i];
+            file.on_progress = [&progress, &file, i](size_t current, size_t) {
+                if (current > file.reported) {
+                    progress(i, current - file.reported);
+                    file.reported = current;
+                }
+            };
+            struct stat st;
+            file.src_fd = open(jobs[i]->source.c_str(), O_RDONLY | O_CLOEXEC);
+            if (file.src_fd < 0 || fstat(file.src_fd, &st) != 0) {
+                errors[i] = errno;
+                retry[i] = errno == EMFILE || errno == ENFILE;
+                continue;
+            }
+            file.mode = st.st_mode;
+            file.dst_fd = open(jobs[i]->destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (file.dst_fd < 0) {
+                errors[i] = errno;
+                retry[i] = errno == EMFILE || errno == ENFILE;
+                continue;
+            }
+
+            copied.push_back(i);
+            file.method = engine.copy(file.src_fd, file.dst_fd, st.st_size, file.on_progress);
+            file.hole_bytes = engine.lastHoleBytes();
+            if (file.method == CopyMethod::None) {
+                errors[i] = errno;
+            }
+        }
+
+        std::vector<std::pair<size_t, int>> failures;
+        engine.finishBatch(failures);
+        for (const auto& failure : failures) {
+            retry[copied[failure.first]] = true;
+        }
+
+        for (size_t i = first; i < last; i++) {
+            OpenFile& file = files[i];
+            if (file.method != CopyMethod::None && !retry[i] && preserve_attributes) {
+                fchmod(file.dst_fd, file.mode & 07777);
+            }
+            if (file.src_fd >= 0) close(file.src_fd);
+            if (file.dst_fd >= 0 && close(file.dst_fd) != 0 && file.method != CopyMethod::None && !retry[i]) {
+                errors[i] = errno;
+                file.method = CopyMethod::None;
+            }
+            if (errors[i] == 0 && !retry[i]) {
+                copy_method_counts[static_cast<int>(file.method)]++;
+                copy_hole_bytes += file.hole_bytes;
+            }
         }
     }
 
+    // Whatever the ring could not copy, or could not open for lack of
+    // descriptors, gets one more try through the synchronous methods before
+    // it counts as an error
+    CopyEngine fallback(engine);
+    fallback.setMethodEnabled(CopyMethod::IoUring, false);
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (!retry[i]) continue;
+        CopyMethod method = copyFileWith(fallback, jobs[i]->source, jobs[i]->destination, preserve_attributes,
+                                         files[i].on_progress);
+        errors[i] = method == CopyMethod::None ? errno : 0;
+    }
+}
+
+bool FileOperations::verifyCopy(int dst_fd, size_t size, uint64_t expected) {
+    // Flushed pages are clean and can be dropped, so the read-back comes from
+    // the device rather than from what was just written to the cache
+    if (fdatasync(dst_fd) != 0) {
+        return false;
+    }
+    posix_fadvise(dst_fd, 0, 0, POSIX_FADV_DONTNEED);
+
+    BufferPool::Buffer buffer = BufferPool::shared().acquire(BufferPool::adaptiveSize(size, 0));
+    if (!buffer) {
+        errno = ENOMEM;
+        return false;
+    }
+    XXHash64 hasher;
+    size_t offset = 0;
+    while (offset < size) {
+        ssize_t n = pread(dst_fd, buffer.data(), std::min(buffer.size(), size - offset), offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        if (n == 0) break;
+        hasher.update(buffer.data(), n);
+        offset += n;
+    }
+
+    if (offset != size || hasher.digest() != expected) {
+        errno = EIO;
+        return false;
+    }
     return true;
 }
 
-bool FileOperations::copyDirectory(const std::string& source, const std::string& destination, bool preserve_attributes) {
+bool FileOperations::copyFile(const std::string& source, const std::string& destination, bool preserve_attributes) {
+    CopyEngine engine(copy_engine);
+    ProgressTracker* tracker = progress;
+    size_t reported = 0;
+    CopyEngine::ProgressFn on_progress;
+    if (tracker) {
+        on_progress = [tracker, &reported](size_t current, size_t) {
+            // A method that fails part way may restart from an earlier offset
+            if (current > reported) {
+                tracker->addBytes(current - reported);
+                reported = current;
+            }
+        };
+    }
+    bool success = copyFileWith(engine, source, destination, preserve_attributes, on_progress) != CopyMethod::None;
+    if (success && tracker) tracker->addFiles();
+    return success;
+}
+
+struct FileOperations::CopyScan {
+    std::vector<CopyJob> files;
+    std::vector<CopyJob> directories;
+    // Further names of a file already in files (by index), linked to its copy
+    std::vector<std::pair<size_t, CopyJob>> hard_links;
+    std::unordered_map<FileId, size_t, FileIdHash> linked_files;
+    // Directories from the root down to the one being scanned
+    std::vector<FileId> ancestors;
+};
+
+void FileOperations::scanCopyTree(const std::string& source, const std::string& destination, bool preserve_attributes,
+                                  CopyScan& scan, std::vector<OperationResult>& errors) {
     DIR* dir = opendir(source.c_str());
     if (!dir) {
-        if (verbose_output) std::cerr << "Error: Cannot open source directory: " << source << std::endl;
-        return false;
+        errors.emplace_back(false, std::string("Cannot open source directory: ") + strerror(errno), errno);
+        errors.back().path = source;
+        return;
     }
 
-    // Create destination directory
-    if (mkdir(destination.c_str(), 0755) != 0 && errno != EEXIST) {
-        if (verbose_output) std::cerr << "Error: Cannot create destination directory: " << destination << std::endl;
+    struct stat dir_stat;
+    fstat(dirfd(dir), &dir_stat);
+
+    // Owner-writable until the contents are in place; final modes are applied afterwards
+    mode_t create_mode = preserve_attributes ? S_IRWXU : 0755;
+    if (mkdir(destination.c_str(), create_mode) != 0 && errno != EEXIST) {
+        errors.emplace_back(false, std::string("Cannot create destination directory: ") + strerror(errno), errno);
+        errors.back().path = destination;
         closedir(dir);
-        return false;
+        return;
     }
+    scan.directories.push_back({source, destination, 0, dir_stat.st_mode});
+    scan.ancestors.push_back(FileId(dir_stat));
 
     struct dirent* entry;
-    bool success = true;
-
-    while ((entry = readdir(dir)) != nullptr && success) {
+    while ((entry = readdir(dir)) != nullptr) {
         std::string name = entry->d_name;
 
         // Skip . and ..
@@ -101,48 +384,285 @@ bool FileOperations::copyDirectory(const std::string& source, const std::string&
         std::string dest_path = destination + "/" + name;
 
         struct stat file_stat;
-        if (stat(source_path.c_str(), &file_stat) == 0) {
-            if (S_ISDIR(file_stat.st_mode)) {
-                success = copyDirectory(source_path, dest_path, preserve_attributes);
+        if (fstatat(dirfd(dir), entry->d_name, &file_stat, follow_copy_links ? 0 : AT_SYMLINK_NOFOLLOW) != 0) {
+            errors.emplace_back(false, strerror(errno), errno);
+            errors.back().path = source_path;
+        } else if (S_ISDIR(file_stat.st_mode)) {
+            // Only a followed symlink can lead back up; the chain is as short as the tree is deep
+            if (std::find(scan.ancestors.begin(), scan.ancestors.end(), FileId(file_stat)) != scan.ancestors.end()) {
+                errors.emplace_back(false, "Symlink loop not followed", ELOOP);
+                errors.back().path = source_path;
+            } else {
+                scanCopyTree(source_path, dest_path, preserve_attributes, scan, errors);
+            }
+        } else if (S_ISLNK(file_stat.st_mode)) {
+            std::vector<char> target(file_stat.st_size > 0 ? file_stat.st_size + 1 : 4096);
+            ssize_t length = readlinkat(dirfd(dir), entry->d_name, target.data(), target.size());
+            // A full buffer may be a truncated target (st_size is 0 on some filesystems)
+            while (length == static_cast<ssize_t>(target.size())) {
+                target.resize(target.size() * 2);
+                length = readlinkat(dirfd(dir), entry->d_name, target.data(), target.size());
+            }
+            if (length < 0) {
+                errors.emplace_back(false, std::string("Cannot read symlink: ") + strerror(errno), errno);
+                errors.back().path = source_path;
+                continue;
+            }
+            if (unlink(dest_path.c_str()) != 0 && errno != ENOENT) {
+                errors.emplace_back(false, std::string("Cannot replace destination: ") + strerror(errno), errno);
+                errors.back().path = dest_path;
+                continue;
+            }
+            OperationResult result = createSymbolicLink(std::string(target.data(), length), dest_path);
+            if (result.success) {
+                copy_symlinks++;
             } else {
-                success = copyFile(source_path, dest_path, preserve_attributes);
+                result.path = dest_path;
+                errors.push_back(std::move(result));
             }
+        } else if (S_ISREG(file_stat.st_mode)) {
+            CopyJob job{source_path, dest_path, static_cast<size_t>(file_stat.st_size), file_stat.st_mode};
+            if (file_stat.st_nlink > 1) {
+                auto first = scan.linked_files.emplace(FileId(file_stat), scan.files.size());
+                if (!first.second) {
+                    scan.hard_links.emplace_back(first.first->second, std::move(job));
+                    continue;
+                }
+            }
+            scan.files.push_back(std::move(job));
         } else {
-            success = false;
+            errors.emplace_back(false, "Skipped special file", ENOTSUP);
+            errors.back().path = source_path;
         }
     }
 
+    scan.ancestors.pop_back();
     closedir(dir);
+}
+
+bool FileOperations::copyDirectory(const std::string& source, const std::string& destination, bool preserve_attributes,
+                                   std::vector<OperationResult>& errors) {
+    // Phase 1: build the directory skeleton, recreate symlinks and collect
+    // the files to copy
+    CopyScan scan;
+    scanCopyTree(source, destination, preserve_attributes, scan, errors);
+    const std::vector<CopyJob>& files = scan.files;
+
+    size_t total_bytes = 0;
+    for (const auto& job : files) {
+        total_bytes += job.size;
+    }
+    ProgressTracker* tracker = progress;
+    if (tracker) tracker->addTotals(total_bytes, files.size() + scan.hard_links.size());
+
+    // Phase 2: fan file copies out to the workers. Small files are batched so a
+    // task amortizes its scheduling cost; large files are split into ranges.
+    std::mutex state_mutex;
+    auto recordError = [&](const std::string& path, int err) {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        errors.emplace_back(false, strerror(err), err);
+        errors.back().path = path;
+    };
+    auto addProgress = [tracker](size_t delta) {
+        if (tracker) tracker->addBytes(delta);
+    };
+    auto copyOne = [&](CopyEngine& engine, const CopyJob& job) {
+        size_t reported = 0;
+        CopyMethod method = copyFileWith(engine, job.source, job.destination, preserve_attributes,
+            [&](size_t current, size_t) {
+                if (current > reported) { addProgress(current - reported); reported = current; }
+            });
+        if (method == CopyMethod::None) {
+            recordError(job.source, errno);
+        } else if (tracker) {
+            tracker->addFiles();
+        }
+    };
+
+    ThreadPool pool(worker_count);
+    std::vector<const CopyJob*> batch;
+    size_t batch_bytes = 0;
+    auto submitBatch = [&]() {
+        if (batch.empty()) return;
+        pool.submit([&, jobs = std::move(batch)]() {
+            CopyEngine engine(copy_engine);
+            if (verify_copies || !engine.isMethodEnabled(CopyMethod::IoUring)) {
+                for (const CopyJob* job : jobs) {
+                    copyOne(engine, *job);
+                }
+                return;
+            }
+            std::vector<int> job_errors;
+            copyFilesWith(engine, jobs, preserve_attributes,
+                [&](size_t, size_t bytes) { addProgress(bytes); }, job_errors);
+            size_t copied = 0;
+            for (size_t i = 0; i < jobs.size(); i++) {
+                if (job_errors[i] != 0) recordError(jobs[i]->source, job_errors[i]);
+                else copied++;
+            }
+            if (tracker) tracker->addFiles(copied);
+        });
+        batch.clear();
+        batch_bytes = 0;
+    };
+
+    for (const auto& job : files) {
+        if (job.size < SMALL_FILE_SIZE) {
+            batch.push_back(&job);
+            batch_bytes += job.size;
+            if (batch.size() >= SMALL_BATCH_FILES || batch_bytes >= SMALL_BATCH_BYTES) {
+                submitBatch();
+            }
+            continue;
+        }
+
+        // A checksum is taken in file order, so verified files are never split
+        if (job.size < LARGE_FILE_SIZE || pool.size() < 2 || verify_copies) {
+            pool.submit([&]() {
+                CopyEngine engine(copy_engine);
+                copyOne(engine, job);
+            });
+            continue;
+        }
+
+        // A clone shares every extent in one call, so it is tried before splitting
+        int src_fd = open(job.source.c_str(), O_RDONLY | O_CLOEXEC);
+        int dst_fd = open(job.destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (src_fd >= 0 && dst_fd >= 0 && CopyEngine(copy_engine).reflink(src_fd, dst_fd)) {
+            close(src_fd);
+            close(dst_fd);
+            copy_method_counts[static_cast<int>(CopyMethod::Reflink)]++;
+            if (preserve_attributes) chmod(job.destination.c_str(), job.mode & 07777);
+            addProgress(job.size);
+            if (tracker) tracker->addFiles();
+            continue;
+        }
+        if (src_fd >= 0) close(src_fd);
+
+        // Size the destination up front so every range can be written independently
+        if (dst_fd < 0 || ftruncate(dst_fd, job.size) != 0) {
+            recordError(job.destination, errno);
+            if (dst_fd >= 0) close(dst_fd);
+            continue;
+        }
+        close(dst_fd);
+
+        size_t ranges = (job.size + RANGE_SIZE - 1) / RANGE_SIZE;
+        auto remaining = std::make_shared<std::atomic<size_t>>(ranges);
+        auto failed = std::make_shared<std::atomic<bool>>(false);
+
+        for (size_t i = 0; i < ranges; i++) {
+            size_t offset = i * RANGE_SIZE;
+            size_t length = std::min(RANGE_SIZE, job.size - offset);
+            pool.submit([&, offset, length, remaining, failed]() {
+                CopyEngine engine(copy_engine);
+                int src = open(job.source.c_str(), O_RDONLY | O_CLOEXEC);
+                int dst = open(job.destination.c_str(), O_WRONLY | O_CLOEXEC);
+                CopyMethod method = CopyMethod::None;
+                if (src >= 0 && dst >= 0) {
+                    size_t reported = 0;
+                    method = engine.copyRange(src, dst, offset, length,
+                        [&](size_t current, size_t) {
+                            if (current > reported) { addProgress(current - reported); reported = current; }
+                        });
+                }
+                int err = errno;
+                if (src >= 0) close(src);
+                if (dst >= 0) close(dst);
+
+                if (method == CopyMethod::None) {
+                    if (!failed->exchange(true)) recordError(job.source, err);
+                } else {
+                    // A range that was entirely hole transferred nothing worth counting
+                    if (engine.lastHoleBytes() < length) copy_method_counts[static_cast<int>(method)]++;
+                    copy_hole_bytes += engine.lastHoleBytes();
+                }
+                if (remaining->fetch_sub(1) == 1 && !failed->load()) {
+                    if (preserve_attributes) chmod(job.destination.c_str(), job.mode & 07777);
+                    if (tracker) tracker->addFiles();
+                }
+            });
+        }
+    }
+    submitBatch();
+    pool.wait();
+
+    // Phase 3: further names of a file become hard links to its copy. A
+    // filesystem that cannot link gets a separate copy instead.
+    if (!scan.hard_links.empty()) {
+        std::unordered_set<std::string> failed;
+        for (const auto& error : errors) {
+            failed.insert(error.path);
+        }
+        for (const auto& link : scan.hard_links) {
+            const CopyJob& first = files[link.first];
+            const CopyJob& job = link.second;
+            if (failed.count(first.source) || failed.count(first.destination)) {
+                errors.emplace_back(false, "Not linked: " + first.source + " failed to copy", EIO);
+                errors.back().path = job.source;
+                continue;
+            }
+            if (unlink(job.destination.c_str()) != 0 && errno != ENOENT) {
+                recordError(job.destination, errno);
+                continue;
+            }
+            if (linkat(AT_FDCWD, first.destination.c_str(), AT_FDCWD, job.destination.c_str(), 0) == 0) {
+                copy_hard_links++;
+                if (tracker) tracker->addFiles();
+            } else if (errno == EPERM || errno == EMLINK || errno == ENOTSUP) {
+                // Only the link was counted in the totals; the copy adds its bytes
+                if (tracker) tracker->addTotals(job.size, 0);
+                CopyEngine engine(copy_engine);
+                copyOne(engine, job);
+            } else {
+                recordError(job.destination, errno);
+            }
+        }
+    }
 
-    if (preserve_attributes && success) {
-        struct stat source_stat;
-        if (stat(source.c_str(), &source_stat) == 0) {
-            chmod(destination.c_str(), source_stat.st_mode);
+    // Phase 4: directory modes last, children before parents, so a read-only
+    // source directory does not block copying its own contents
+    if (preserve_attributes) {
+        for (auto it = scan.directories.rbegin(); it != scan.directories.rend(); ++it) {
+            chmod(it->destination.c_str(), it->mode & 07777);
         }
     }
 
-    return success;
+    return errors.empty();
 }
 
-OperationResult FileOperations::copy(const std::string& source, const std::string& destination, bool recursive, bool preserve_attributes) {
+OperationResult FileOperations::copy(const std::string& source, const std::string& destination, bool recursive,
+                                     bool preserve_attributes, bool verify, bool follow_links) {
     if (!exists(source)) {
         return OperationResult(false, "Source does not exist: " + source, ENOENT);
     }
 
+    for (auto& count : copy_method_counts) count = 0;
+    copy_hole_bytes = 0;
+    copy_verified_files = 0;
+    copy_symlinks = 0;
+    copy_hard_links = 0;
+    verify_copies = verify;
+    follow_copy_links = follow_links;
+    ProgressScope scope(progress, progress_callback);
+
     if (isDirectory(source)) {
         if (!recursive) {
             return OperationResult(false, "Source is a directory but recursive copy not specified", EISDIR);
         }
-        bool success = copyDirectory(source, destination, preserve_attributes);
-        if (success) {
+        std::vector<OperationResult> errors;
+        if (copyDirectory(source, destination, preserve_attributes, errors)) {
             return OperationResult(true, "Directory copied successfully");
-        } else {
-            return OperationResult(false, "Failed to copy directory", errno);
         }
+        OperationResult result(false, "Directory copied with " + std::to_string(errors.size()) + " error(s)",
+                               errors.front().error_code);
+        result.details = std::move(errors);
+        return result;
     } else {
+        if (progress) progress->addTotals(getFileSize(source), 1);
         bool success = copyFile(source, destination, preserve_attributes);
         if (success) {
-            return OperationResult(true, "File copied successfully");
+            return OperationResult(true, "File copied successfully (" + describeLastCopy() + ")");
         } else {
             return OperationResult(false, "Failed to copy file", errno);
         }
@@ -155,40 +675,55 @@ OperationResult FileOperations::move(const std::string& source, const std::strin
     }
 
     // Try rename first (fast path)
-    if (rename(source.c_str(), destination.c_str()) == 0) {
+    if (::rename(source.c_str(), destination.c_str()) == 0) {
         return OperationResult(true, "File/directory moved successfully");
     }
 
-    // If rename fails (different filesystem), fall back to copy+delete
+    // Different filesystem: copy and delete file by file, resumably
     if (errno == EXDEV) {
-        OperationResult copy_result = copy(source, destination, true, true);
-        if (copy_result.success) {
-            OperationResult delete_result = remove(source, true, true);
-            if (delete_result.success) {
-                return OperationResult(true, "File/directory moved successfully (copy+delete)");
-            } else {
-                return OperationResult(false, "Moved but failed to delete source", delete_result.error_code);
-            }
-        } else {
-            return copy_result;
+        ProgressScope scope(progress, progress_callback);
+        TreeMover mover(copy_engine, worker_count);
+        std::vector<OperationResult> errors;
+        bool success = mover.move(source, destination, errors, progress);
+        std::string counts = std::to_string(mover.movedFiles()) + " file(s)";
+        if (mover.resumedFiles() > 0) {
+            counts += ", " + std::to_string(mover.resumedFiles()) + " resumed";
         }
+        if (success) {
+            return OperationResult(true, "File/directory moved successfully (copy+delete, " + counts + ")");
+        }
+        OperationResult result(false, "Move incomplete (" + counts + "), " + std::to_string(errors.size()) +
+                               " error(s); run it again to resume", errors.front().error_code);
+        result.details = std::move(errors);
+        return result;
     }
 
     return OperationResult(false, "Failed to move file/directory", errno);
 }
 
 OperationResult FileOperations::remove(const std::string& path, bool recursive, bool force) {
-    if (!exists(path)) {
+    // lstat: a symlink to a directory is removed itself, never its target's contents
+    struct stat path_stat;
+    if (lstat(path.c_str(), &path_stat) != 0) {
         return force ? OperationResult(true, "Path does not exist (forced)") :
                        OperationResult(false, "Path does not exist: " + path, ENOENT);
     }
 
-    if (isDirectory(path)) {
+    if (S_ISDIR(path_stat.st_mode)) {
         if (!recursive) {
             return OperationResult(false, "Path is a directory but recursive delete not specified", EISDIR);
         }
-        return removeDirectory(path) ? OperationResult(true, "Directory removed successfully") :
-                                      OperationResult(false, "Failed to remove directory", errno);
+        std::vector<OperationResult> errors;
+        if (tree_remover->removeTree(path, errors)) {
+            return OperationResult(true, "Directory removed successfully");
+        }
+        if (errors.empty()) {
+            return OperationResult(false, "Failed to remove directory", EIO);
+        }
+        OperationResult result(false, "Directory partly removed, " + std::to_string(errors.size()) + " error(s)",
+                               errors.front().error_code);
+        result.details = std::move(errors);
+        return result;
     } else {
         if (unlink(path.c_str()) == 0) {
             return OperationResult(true, "File removed successfully");
@@ -198,46 +733,6 @@ OperationResult FileOperations::remove(const std::string& path, bool recursive,
     }
 }
 
-bool FileOperations::removeDirectory(const std::string& path) {
-    DIR* dir = opendir(path.c_str());
-    if (!dir) {
-        return false;
-    }
-
-    struct dirent* entry;
-    bool success = true;
-
-    while ((entry = readdir(dir)) != nullptr && success) {
-        std::string name = entry->d_name;
-
-        // Skip . and ..
-        if (name == "." || name == "..") {
-            continue;
-        }
-
-        std::string full_path = path + "/" + name;
-
-        struct stat file_stat;
-        if (stat(full_path.c_str(), &file_stat) == 0) {
-            if (S_ISDIR(file_stat.st_mode)) {
-                success = removeDirectory(full_path);
-            } else {
-                success = (unlink(full_path.c_str()) == 0);
-            }
-        } else {
-            success = false;
-        }
-    }
-
-    closedir(dir);
-
-    if (success) {
-        success = (rmdir(path.c_str()) == 0);
-    }
-
-    return success;
-}
-
 OperationResult FileOperations::createDirectory(const std::string& path, bool create_parents) {
     if (create_parents) {
         std::filesystem::path fs_path(path);
@@ -273,50 +768,47 @@ OperationResult FileOperations::createFile(const std::string& path, const std::s
 OperationResult FileOperations::calculateSize(const std::string& path, bool recursive, size_t& size_out) {
     size_out = 0;
 
-    if (!exists(path)) {
-        return OperationResult(false, "Path does not exist", ENOENT);
+    struct stat path_stat;
+    if (stat(path.c_str(), &path_stat) != 0) {
+        return OperationResult(false, "Path does not exist", errno);
     }
 
-    if (isFile(path)) {
-        struct stat file_stat;
-        if (stat(path.c_str(), &file_stat) == 0) {
-            size_out = file_stat.st_size;
-            return OperationResult(true, "File size calculated");
-        }
-        return OperationResult(false, "Failed to get file size", errno);
+    if (S_ISDIR(path_stat.st_mode) && !recursive) {
+        return OperationResult(true, "Size calculated successfully");
     }
 
-    if (isDirectory(path) && recursive) {
-        DIR* dir = opendir(path.c_str());
-        if (!dir) {
-            return OperationResult(false, "Cannot open directory", errno);
-        }
+    UsageTotals totals;
+    OperationResult result = calculateUsage(path, totals);
+    size_out = totals.apparent_bytes;
+    return result;
+}
 
-        struct dirent* entry;
-        while ((entry = readdir(dir)) != nullptr) {
-            std::string name = entry->d_name;
-            if (name == "." || name == "..") continue;
+OperationResult FileOperations::calculateUsage(const std::string& path, UsageTotals& totals, bool use_cache) {
+    if (!disk_usage.scan(path, totals, use_cache)) {
+        return OperationResult(false, "Path does not exist", errno);
+    }
 
-            std::string full_path = path + "/" + name;
-            size_t item_size;
-            OperationResult result = calculateSize(full_path, recursive, item_size);
-            if (!result.success) {
-                closedir(dir);
-                return result;
-            }
-            size_out += item_size;
+    if (totals.errors > 0) {
+        if (verbose_output) {
+            std::cerr << "Skipped " << totals.errors << " unreadable entries under " << path << std::endl;
         }
-
-        closedir(dir);
+        OperationResult result(true, "Size calculated with " + std::to_string(totals.errors) + " unreadable entries");
+        result.path = path;
+        return result;
     }
-
     return OperationResult(true, "Size calculated successfully");
 }
 
-void FileOperations::updateProgress(size_t current, size_t total) {
-    if (progress_callback) {
-        progress_callback(current, total);
+OperationResult FileOperations::findLargest(const std::string& path, size_t limit, TopReport& report,
+                                            const TopProgress& progress) {
+    if (!disk_usage.scanTop(path, limit, report, progress)) {
+        return OperationResult(false, "Path does not exist", errno);
+    }
+
+    if (report.totals.errors > 0) {
+        return OperationResult(true, "Scanned with " + std::to_string(report.totals.errors) + " unreadable entries");
     }
+    return OperationResult(true, "Scan complete");
 }
 
 bool FileOperations::exists(const std::string& path) {
@@ -362,47 +854,519 @@ std::string FileOperations::formatFileSize(size_t size) {
     return ss.str();
 }
 
-// Stub implementations for remaining methods
-OperationResult FileOperations::copyMultiple(const std::vector<std::string>& sources, const std::string& destination, bool recursive) {
-    return OperationResult(false, "Not implemented yet", ENOSYS);
+static std::string baseName(const std::string& path) {
+    size_t end = path.find_last_not_of('/');
+    if (end == std::string::npos) {
+        return "/";
+    }
+    size_t start = path.find_last_of('/', end);
+    return path.substr(start == std::string::npos ? 0 : start + 1, end - (start == std::string::npos ? 0 : start + 1) + 1);
 }
 
-OperationResult FileOperations::moveMultiple(const std::vector<std::string>& sources, const std::string& destination) {
-    return OperationResult(false, "Not implemented yet", ENOSYS);
+static dev_t deviceOf(const std::string& path, bool use_parent) {
+    std::string target = path;
+    if (use_parent) {
+        size_t slash = path.find_last_of('/', path.find_last_not_of('/'));
+        target = (slash == std::string::npos) ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    }
+    struct stat st;
+    return lstat(target.c_str(), &st) == 0 ? st.st_dev : 0;
 }
 
-OperationResult FileOperations::rename(const std::string& old_name, const std::string& new_name) {
-    return OperationResult(false, "Not implemented yet", ENOSYS);
+OperationResult FileOperations::runBatch(const std::vector<BatchItem>& items) {
+    // Pre-scan sizes so progress is reported against the whole batch
+    ProgressScope scope(progress, progress_callback);
+    std::vector<UsageTotals> item_totals(items.size());
+    if (progress) {
+        size_t total_bytes = 0;
+        size_t total_files = 0;
+        for (size_t i = 0; i < items.size(); i++) {
+            calculateUsage(items[i].source, item_totals[i]);
+            total_bytes += item_totals[i].apparent_bytes;
+            total_files += item_totals[i].files;
+        }
+        progress->setTotals(total_bytes, total_files);
+    }
+
+    JobScheduler scheduler(worker_count, device_concurrency);
+    for (size_t i = 0; i < items.size(); i++) {
+        std::vector<dev_t> devices = {deviceOf(items[i].source, false)};
+        if (items[i].op != BatchOp::Remove) {
+            devices.push_back(deviceOf(items[i].destination, true));
+        }
+
+        scheduler.add(devices, [this, &items, &item_totals, i]() {
+            const BatchItem& item = items[i];
+
+            // Each job gets its own instance so engines and callbacks are not shared
+            FileOperations worker(verbose_output);
+            worker.copy_engine = copy_engine;  // keeps charging our throttle
+            worker.disk_usage.setThrottle(&throttle);
+            worker.worker_count = items.size() > 1 ? 1 : worker_count;
+            ProgressTracker item_progress(progress);
+            if (progress) worker.progress = &item_progress;
+
+            OperationResult result;
+            switch (item.op) {
+                case BatchOp::Copy:
+                    result = worker.copy(item.source, item.destination, item.recursive, true, item.verify,
+                                         item.follow_links);
+                    break;
+                case BatchOp::Move:
+                    result = worker.move(item.source, item.destination);
+                    break;
+                case BatchOp::Remove:
+                    result = worker.remove(item.source, item.recursive, item.force);
+                    break;
+            }
+            result.path = item.source;
+
+            // Renames and removes report nothing along the way; count them whole
+            if (progress) {
+                const UsageTotals& totals = item_totals[i];
+                if (totals.apparent_bytes > item_progress.bytesDone()) {
+                    progress->addBytes(totals.apparent_bytes - item_progress.bytesDone());
+                }
+                if (totals.files > item_progress.filesDone()) {
+                    progress->addFiles(totals.files - item_progress.filesDone());
+                }
+            }
+            return result;
+        });
+    }
+
+    std::vector<OperationResult> results = scheduler.run();
+
+    size_t failed = 0;
+    int first_error = 0;
+    for (const auto& result : results) {
+        if (!result.success) {
+            if (failed++ == 0) first_error = result.error_code;
+        }
+    }
+
+    OperationResult summary(failed == 0,
+        std::to_string(results.size() - failed) + " of " + std::to_string(results.size()) + " items succeeded",
+        first_error);
+    summary.details = std::move(results);
+    return summary;
+}
+
+OperationResult FileOperations::copyMultiple(const std::vector<std::string>& sources, const std::string& destination,
+                                             bool recursive, bool verify, bool follow_links) {
+    if (!isDirectory(destination)) {
+        return OperationResult(false, "Destination is not a directory: " + destination, ENOTDIR);
+    }
+
+    std::vector<BatchItem> items;
+    for (const auto& source : sources) {
+        items.push_back({BatchOp::Copy, source, destination + "/" + baseName(source), recursive, false, verify,
+                         follow_links});
+    }
+    return runBatch(items);
+}
+
+OperationResult FileOperations::moveMultiple(const std::vector<std::string>& sources, const std::string& destination) {
+    if (!isDirectory(destination)) {
+        return OperationResult(false, "Destination is not a directory: " + destination, ENOTDIR);
+    }
+
+    std::vector<BatchItem> items;
+    for (const auto& source : sources) {
+        items.push_back({BatchOp::Move, source, destination + "/" + baseName(source), true, false});
+    }
+    return runBatch(items);
 }
 
 OperationResult FileOperations::removeMultiple(const std::vector<std::string>& paths, bool recursive, bool force) {
+    std::vector<BatchItem> items;
+    for (const auto& path : paths) {
+        items.push_back({BatchOp::Remove, path, "", recursive, force});
+    }
+    return runBatch(items);
+}
+
+OperationResult FileOperations::batchCopy(const std::vector<std::pair<std::string, std::string>>& copy_pairs) {
+    std::vector<BatchItem> items;
+    for (const auto& pair : copy_pairs) {
+        items.push_back({BatchOp::Copy, pair.first, pair.second, true, false});
+    }
+    return runBatch(items);
+}
+
+OperationResult FileOperations::batchMove(const std::vector<std::pair<std::string, std::string>>& move_pairs,
+                                          const std::string& log_path) {
+    BatchRenamer renamer;
+    std::vector<OperationResult> errors;
+    if (!renamer.plan(move_pairs, errors)) {
+        OperationResult result(false, "Nothing moved: " + std::to_string(errors.size()) + " problem(s) in the plan",
+                               errors.front().error_code);
+        result.details = std::move(errors);
+        return result;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    if (!renamer.execute(errors, log_path)) {
+        // The failure itself comes first; anything after it could not be undone
+        std::string message = "Batch move failed and was rolled back";
+        if (errors.size() > 1) {
+            message = "Batch move failed and could not be fully rolled back";
+            if (!log_path.empty()) message += "; the undo log is kept at " + log_path;
+        }
+        OperationResult result(false, message, errors.front().error_code);
+        result.details = std::move(errors);
+        return result;
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::ostringstream message;
+    message << "Moved " << renamer.renamedCount() + renamer.exchangedCount() << " item(s)";
+    if (renamer.exchangedCount() > 0) {
+        message << " (" << renamer.exchangedCount() << " by exchange)";
+    }
+    if (renamer.skippedCount() > 0) {
+        message << ", " << renamer.skippedCount() << " already in place";
+    }
+    message << " in " << std::fixed << std::setprecision(3) << elapsed << "s";
+    return OperationResult(true, message.str());
+}
+
+OperationResult FileOperations::undoBatchMove(const std::string& log_path) {
+    std::vector<OperationResult> errors;
+    size_t undone = 0;
+    if (!BatchRenamer::undo(log_path, errors, undone)) {
+        OperationResult result(false, "Undo stopped after " + std::to_string(undone) + " step(s)",
+                               errors.front().error_code);
+        result.details = std::move(errors);
+        return result;
+    }
+    return OperationResult(true, "Undid " + std::to_string(undone) + " step(s)");
+}
+
+OperationResult FileOperations::removeInBackground(const std::string& path) {
+    struct stat path_stat;
+    if (lstat(path.c_str(), &path_stat) != 0) {
+        return OperationResult(false, "Path does not exist: " + path, ENOENT);
+    }
+
+    std::string trash = tree_remover->removeLater(path);
+    if (trash.empty()) {
+        return OperationResult(false, "Failed to move aside for deletion", errno);
+    }
+    if (verbose_output) {
+        std::cerr << "Deleting " << trash << " in the background" << std::endl;
+    }
+    return OperationResult(true, "Removal continues in the background");
+}
+
+size_t FileOperations::pendingBackgroundRemovals() {
+    return tree_remover->pendingCount();
+}
+
+OperationResult FileOperations::rename(const std::string& old_name, const std::string& new_name) {
     return OperationResult(false, "Not implemented yet", ENOSYS);
 }
 
 OperationResult FileOperations::secureDelete(const std::string& path, int passes) {
-    return OperationResult(false, "Not implemented yet", ENOSYS);
+    if (passes < 1) {
+        return OperationResult(false, "At least one overwrite pass is needed", EINVAL);
+    }
+    struct stat path_stat;
+    if (lstat(path.c_str(), &path_stat) != 0) {
+        return OperationResult(false, "Path does not exist: " + path, ENOENT);
+    }
+    if (!S_ISREG(path_stat.st_mode) && !S_ISDIR(path_stat.st_mode)) {
+        return OperationResult(false, "Only regular files and directories can be securely deleted", EINVAL);
+    }
+
+    ProgressScope scope(progress, progress_callback);
+    auto start = std::chrono::steady_clock::now();
+    SecureEraser eraser(worker_count, &throttle);
+    std::vector<OperationResult> errors;
+    bool success = eraser.erase(path, passes, errors, progress);
+    // Directories and anything that held no data go once every file is gone
+    if (success && S_ISDIR(path_stat.st_mode)) {
+        success = tree_remover->removeTree(path, errors);
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::ostringstream summary;
+    summary << eraser.erasedFiles() << " file(s), " << formatFileSize(eraser.dataBytes()) << " overwritten "
+            << passes << "x";
+    if (eraser.holeBytes() > 0) {
+        summary << ", " << formatFileSize(eraser.holeBytes()) << " of holes skipped";
+    }
+    if (elapsed > 0) {
+        summary << ", " << formatFileSize(static_cast<size_t>(eraser.dataBytes() * passes / elapsed)) << "/s";
+    }
+    if (success) {
+        return OperationResult(true, "Securely deleted (" + summary.str() + ")");
+    }
+    OperationResult result(false, "Secure delete incomplete (" + summary.str() + "), " +
+                           std::to_string(errors.size()) + " error(s)", errors.front().error_code);
+    result.details = std::move(errors);
+    return result;
 }
 
 OperationResult FileOperations::createSymbolicLink(const std::string& target, const std::string& link_path) {
-    return OperationResult(false, "Not implemented yet", ENOSYS);
+    if (target.empty()) {
+        return OperationResult(false, "Symbolic link target is empty", ENOENT);
+    }
+    if (symlink(target.c_str(), link_path.c_str()) != 0) {
+        int err = errno;
+        return OperationResult(false, std::string("Failed to create symbolic link: ") + strerror(err), err);
+    }
+    return OperationResult(true, "Symbolic link created successfully");
 }
 
-OperationResult FileOperations::compareFiles(const std::string& file1, const std::string& file2) {
-    return OperationResult(false, "Not implemented yet", ENOSYS);
+// pread() until length bytes or end of file; returns bytes read or -1
+static ssize_t readFully(int fd, char* buffer, size_t length, size_t offset) {
+    size_t total = 0;
+    while (total < length) {
+        ssize_t n = pread(fd, buffer + total, length - total, offset + total);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        total += n;
+    }
+    return static_cast<ssize_t>(total);
+}
+
+OperationResult FileOperations::compareFiles(const std::string& file1, const std::string& file2,
+                                             size_t* first_difference) {
+    int fd1 = open(file1.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd1 < 0) {
+        return OperationResult(false, "Cannot open file: " + file1, errno);
+    }
+    int fd2 = open(file2.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd2 < 0) {
+        int saved_errno = errno;
+        close(fd1);
+        return OperationResult(false, "Cannot open file: " + file2, saved_errno);
+    }
+
+    auto finish = [fd1, fd2](OperationResult result) {
+        close(fd1);
+        close(fd2);
+        return result;
+    };
+
+    struct stat stat1, stat2;
+    if (fstat(fd1, &stat1) != 0 || fstat(fd2, &stat2) != 0) {
+        return finish(OperationResult(false, "Cannot stat file", errno));
+    }
+    if (!S_ISREG(stat1.st_mode) || !S_ISREG(stat2.st_mode)) {
+        return finish(OperationResult(false, "Only regular files can be compared", EINVAL));
+    }
+
+    // Cheap answers first: the same inode, or different lengths
+    if (stat1.st_dev == stat2.st_dev && stat1.st_ino == stat2.st_ino) {
+        return finish(OperationResult(true, "Files are identical (same inode)"));
+    }
+    if (stat1.st_size != stat2.st_size) {
+        return finish(OperationResult(false, "Files differ in size (" + std::to_string(stat1.st_size) + " vs " +
+                                      std::to_string(stat2.st_size) + " bytes)"));
+    }
+
+    size_t size = stat1.st_size;
+    posix_fadvise(fd1, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd2, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    BufferPool::Buffer buffer1 = BufferPool::shared().acquire(COMPARE_CHUNK_SIZE);
+    BufferPool::Buffer buffer2 = BufferPool::shared().acquire(COMPARE_CHUNK_SIZE);
+    if (!buffer1 || !buffer2) {
+        return finish(OperationResult(false, "Out of memory", ENOMEM));
+    }
+
+    // Two devices can stream at once, so the second file is read on its own thread
+    std::unique_ptr<ThreadPool> reader;
+    if (stat1.st_dev != stat2.st_dev) {
+        reader.reset(new ThreadPool(1));
+    }
+
+    ProgressScope scope(progress, progress_callback);
+    if (progress) progress->addTotals(size, 1);
+
+    for (size_t offset = 0; offset < size; offset += COMPARE_CHUNK_SIZE) {
+        size_t length = std::min(COMPARE_CHUNK_SIZE, size - offset);
+
+        // Bytes read, or -errno: errno is per thread, so it travels with the result
+        auto read2Chunk = [&, length, offset]() -> ssize_t {
+            ssize_t n = readFully(fd2, buffer2.data(), length, offset);
+            return n < 0 ? -errno : n;
+        };
+        std::future<ssize_t> pending;
+        if (reader) {
+            pending = reader->submit(read2Chunk);
+        }
+        ssize_t read1 = readFully(fd1, buffer1.data(), length, offset);
+        int saved_errno = errno;
+        ssize_t read2 = reader ? pending.get() : read2Chunk();
+        if (read1 < 0 || read2 < 0) {
+            return finish(OperationResult(false, "Read error while comparing",
+                                          read1 < 0 ? saved_errno : static_cast<int>(-read2)));
+        }
+
+        size_t common = std::min(read1, read2);
+        if (memcmp(buffer1.data(), buffer2.data(), common) != 0) {
+            size_t index = std::mismatch(buffer1.data(), buffer1.data() + common, buffer2.data()).first - buffer1.data();
+            if (first_difference) *first_difference = offset + index;
+            return finish(OperationResult(false, "Files differ at offset " + std::to_string(offset + index)));
+        }
+        if (read1 != read2 || common < length) {
+            if (first_difference) *first_difference = offset + common;
+            return finish(OperationResult(false, "A file changed size during comparison"));
+        }
+
+        if (progress) progress->addBytes(length);
+    }
+    if (progress) progress->addFiles();
+
+    return finish(OperationResult(true, "Files are identical"));
+}
+
+DigestCache& FileOperations::getDigestCache() {
+    if (!digest_cache) {
+        digest_cache.reset(new DigestCache());
+    }
+    return *digest_cache;
 }
 
 OperationResult FileOperations::compareDirectories(const std::string& dir1, const std::string& dir2) {
-    return OperationResult(false, "Not implemented yet", ENOSYS);
+    DigestCache& cache = getDigestCache();
+    MerkleTree left(cache, worker_count);
+    MerkleTree right(cache, worker_count);
+
+    // The two trees usually live on different devices, so build them side by side
+    bool left_ok = false;
+    int left_errno = 0;
+    std::thread left_builder([&]() {
+        left_ok = left.build(dir1);
+        left_errno = errno;
+    });
+    bool right_ok = right.build(dir2);
+    int right_errno = errno;
+    left_builder.join();
+
+    if (!cache.save() && verbose_output) {
+        std::cerr << "Warning: could not save digest cache: " << strerror(errno) << std::endl;
+    }
+
+    if (!left_ok) {
+        return OperationResult(false, "Cannot read directory: " + dir1, left_errno);
+    }
+    if (!right_ok) {
+        return OperationResult(false, "Cannot read directory: " + dir2, right_errno);
+    }
+
+    const MerkleStats& a = left.stats();
+    const MerkleStats& b = right.stats();
+    std::string scanned = std::to_string(a.files + b.files) + " files scanned, " +
+                          std::to_string(a.hashed_files + b.hashed_files) + " hashed (" +
+                          formatFileSize(a.hashed_bytes + b.hashed_bytes) + "), " +
+                          std::to_string(a.cached_files + b.cached_files) + " from cache";
+
+    if (left.root().hash == right.root().hash) {
+        return OperationResult(true, "Directories are identical; " + scanned);
+    }
+
+    OperationResult result(false, "");
+    MerkleTree::diff(left.root(), right.root(), "", result.details);
+    size_t added = 0, removed = 0, changed = 0;
+    for (const auto& change : result.details) {
+        if (change.message == "added") added++;
+        else if (change.message == "removed") removed++;
+        else changed++;
+    }
+    result.message = std::to_string(result.details.size()) + " difference(s): " + std::to_string(added) +
+                     " added, " + std::to_string(removed) + " removed, " + std::to_string(changed) +
+                     " changed; " + scanned;
+    return result;
 }
 
-OperationResult FileOperations::batchCopy(const std::vector<std::pair<std::string, std::string>>& copy_pairs) {
-    return OperationResult(false, "Not implemented yet", ENOSYS);
+OperationResult FileOperations::checksumFile(const std::string& path, ChecksumAlgorithm algorithm,
+                                             std::string& digest_out, size_t* bytes_read) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        int err = errno;
+        if (fd >= 0) close(fd);
+        return OperationResult(false, "Cannot open file: " + path, err);
+    }
+    if (S_ISDIR(st.st_mode)) {
+        close(fd);
+        return OperationResult(false, "Is a directory: " + path, EISDIR);
+    }
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    BufferPool::Buffer buffer = BufferPool::shared().acquire(BufferPool::adaptiveSize(st.st_size, st.st_blksize));
+    if (!buffer) {
+        close(fd);
+        return OperationResult(false, "Out of memory", ENOMEM);
+    }
+    XXHash64 xxh64;
+    Sha256 sha256;
+    size_t total = 0;
+    while (true) {
+        ssize_t n = read(fd, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            int err = errno;
+            close(fd);
+            return OperationResult(false, "Read error: " + path, err);
+        }
+        if (n == 0) break;
+        if (algorithm == ChecksumAlgorithm::SHA256) {
+            sha256.update(buffer.data(), n);
+        } else {
+            xxh64.update(buffer.data(), n);
+        }
+        total += n;
+    }
+    close(fd);
+
+    if (algorithm == ChecksumAlgorithm::SHA256) {
+        unsigned char digest[Sha256::DIGEST_SIZE];
+        sha256.digest(digest);
+        digest_out = digestToHex(digest, sizeof(digest));
+    } else {
+        digest_out = digestToHex(xxh64.digest());
+    }
+    if (bytes_read) *bytes_read = total;
+    return OperationResult(true, "Checksum computed");
 }
 
-OperationResult FileOperations::batchMove(const std::vector<std::pair<std::string, std::string>>& move_pairs) {
-    return OperationResult(false, "Not implemented yet", ENOSYS);
+OperationResult FileOperations::findDuplicates(const std::string& path, DuplicateReport& report) {
+    DigestCache& cache = getDigestCache();
+    DuplicateFinder finder(disk_usage, cache, worker_count);
+    if (!finder.find(path, report)) {
+        return OperationResult(false, "Cannot read directory: " + path, errno);
+    }
+
+    if (!cache.save() && verbose_output) {
+        std::cerr << "Warning: could not save digest cache: " << strerror(errno) << std::endl;
+    }
+
+    const DuplicateStats& stats = report.stats;
+    if (verbose_output) {
+        std::cerr << stats.files << " files, " << stats.same_size << " sharing a size, "
+                  << stats.partial_hashed << " partially hashed, " << stats.full_hashed << " fully hashed, "
+                  << stats.cached_files << " from cache" << std::endl;
+    }
+    std::string scanned = std::to_string(stats.files) + " files scanned, " +
+                          formatFileSize(stats.hashed_bytes) + " read";
+    if (stats.errors > 0) {
+        scanned += ", " + std::to_string(stats.errors) + " unreadable";
+    }
+    return OperationResult(true, scanned);
 }
 
 std::string FileOperations::getMimeType(const std::string& path) {
-    return "application/octet-stream";
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0) {
+        return "application/octet-stream";
+    }
+    return MimeDetector::shared().detect(path, st);
 }
\ No newline at end of file
@@ -0,0 +1,153 @@
+#include "IdNameCache.h"
+#include <algorithm>
+#include <cerrno>
+#include <unistd.h>
+#include <pwd.h>
+#include <grp.h>
+
+IdNameCache::IdNameCache()
+    : positive_ttl(600), negative_ttl(60), nss_lookups(0) {
+}
+
+IdNameCache& IdNameCache::instance() {
+    static IdNameCache cache;
+    return cache;
+}
+
+void IdNameCache::setTTL(std::chrono::seconds positive, std::chrono::seconds negative) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    positive_ttl = positive;
+    negative_ttl = negative;
+}
+
+void IdNameCache::clear() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    users.clear();
+    groups.clear();
+}
+
+bool IdNameCache::isFresh(const Entry& entry, Clock::time_point now) const {
+    return now < entry.expires;
+}
+
+IdNameCache::Entry IdNameCache::lookupUser(uid_t uid) {
+    long size_hint = sysconf(_SC_GETPW_R_SIZE_MAX);
+    std::vector<char> buf(size_hint > 0 ? size_hint : 1024);
+    struct passwd pwd;
+    struct passwd* result = nullptr;
+    int rc;
+
+    while ((rc = getpwuid_r(uid, &pwd, buf.data(), buf.size(), &result)) == ERANGE) {
+        buf.resize(buf.size() * 2);
+    }
+
+    Entry entry;
+    entry.resolved = (rc == 0 && result != nullptr);
+    entry.name = entry.resolved ? std::string(result->pw_name) : std::to_string(uid);
+    return entry;
+}
+
+IdNameCache::Entry IdNameCache::lookupGroup(gid_t gid) {
+    long size_hint = sysconf(_SC_GETGR_R_SIZE_MAX);
+    std::vector<char> buf(size_hint > 0 ? size_hint : 1024);
+    struct group grp;
+    struct group* result = nullptr;
+    int rc;
+
+    while ((rc = getgrgid_r(gid, &grp, buf.data(), buf.size(), &result)) == ERANGE) {
+        buf.resize(buf.size() * 2);
+    }
+
+    Entry entry;
+    entry.resolved = (rc == 0 && result != nullptr);
+    entry.name = entry.resolved ? std::string(result->gr_name) : std::to_string(gid);
+    return entry;
+}
+
+void IdNameCache::prefetch(const std::vector<uid_t>& uids, const std::vector<gid_t>& gids) {
+    std::vector<uid_t> missing_users;
+    std::vector<gid_t> missing_groups;
+    Clock::time_point now = Clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        for (uid_t uid : uids) {
+            auto it = users.find(uid);
+            if (it == users.end() || !isFresh(it->second, now)) {
+                missing_users.push_back(uid);
+            }
+        }
+        for (gid_t gid : gids) {
+            auto it = groups.find(gid);
+            if (it == groups.end() || !isFresh(it->second, now)) {
+                missing_groups.push_back(gid);
+            }
+        }
+    }
+
+    std::sort(missing_users.begin(), missing_users.end());
+    missing_users.erase(std::unique(missing_users.begin(), missing_users.end()), missing_users.end());
+    std::sort(missing_groups.begin(), missing_groups.end());
+    missing_groups.erase(std::unique(missing_groups.begin(), missing_groups.end()), missing_groups.end());
+
+    if (missing_users.empty() && missing_groups.empty()) {
+        return;
+    }
+
+    // NSS queries may block on the network; keep the lock released meanwhile
+    std::vector<std::pair<uid_t, Entry>> resolved_users;
+    std::vector<std::pair<gid_t, Entry>> resolved_groups;
+    for (uid_t uid : missing_users) {
+        resolved_users.emplace_back(uid, lookupUser(uid));
+    }
+    for (gid_t gid : missing_groups) {
+        resolved_groups.emplace_back(gid, lookupGroup(gid));
+    }
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    now = Clock::now();
+    for (auto& item : resolved_users) {
+        item.second.expires = now + (item.second.resolved ? positive_ttl : negative_ttl);
+        users[item.first] = std::move(item.second);
+    }
+    for (auto& item : resolved_groups) {
+        item.second.expires = now + (item.second.resolved ? positive_ttl : negative_ttl);
+        groups[item.first] = std::move(item.second);
+    }
+    nss_lookups += resolved_users.size() + resolved_groups.size();
+}
+
+std::string IdNameCache::userName(uid_t uid) {
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = users.find(uid);
+        if (it != users.end() && isFresh(it->second, Clock::now())) {
+            return it->second.name;
+        }
+    }
+
+    prefetch({uid}, {});
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return users[uid].name;
+}
+
+std::string IdNameCache::groupName(gid_t gid) {
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = groups.find(gid);
+        if (it != groups.end() && isFresh(it->second, Clock::now())) {
+            return it->second.name;
+        }
+    }
+
+    prefetch({}, {gid});
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return groups[gid].name;
+}
+
+size_t IdNameCache::getLookupCount() const {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return nss_lookups;
+}
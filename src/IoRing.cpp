@@ -0,0 +1,353 @@
+#include "IoRing.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static int ioUringSetup(unsigned entries, struct io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int ioUringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int ioUringRegister(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+IoRing::IoRing()
+    : ring_fd(-1), sq_ring(MAP_FAILED), cq_ring(MAP_FAILED), sq_ring_size(0), cq_ring_size(0),
+      sqes(static_cast<struct io_uring_sqe*>(MAP_FAILED)), sqes_size(0), sq_entries(0), unsubmitted(0) {
+}
+
+IoRing::~IoRing() {
+    release();
+}
+
+void IoRing::release() {
+    if (sqes != MAP_FAILED) munmap(sqes, sqes_size);
+    if (cq_ring != MAP_FAILED && cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+    if (sq_ring != MAP_FAILED) munmap(sq_ring, sq_ring_size);
+    if (ring_fd >= 0) close(ring_fd);
+    ring_fd = -1;
+    sq_ring = cq_ring = MAP_FAILED;
+    sqes = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+}
+
+bool IoRing::init(unsigned entries) {
+    release();
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd = ioUringSetup(entries, &params);
+    if (ring_fd < 0) {
+        return false;
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        int err = errno;
+        release();
+        errno = err;
+        return false;
+    }
+    cq_ring = single_mmap ? sq_ring
+                          : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                                 IORING_OFF_CQ_RING);
+    sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = static_cast<struct io_uring_sqe*>(
+        mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+    if (cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+        int err = errno;
+        release();
+        errno = err;
+        return false;
+    }
+
+    char* sq = static_cast<char*>(sq_ring);
+    char* cq = static_cast<char*>(cq_ring);
+    sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    sq_entries = params.sq_entries;
+    unsubmitted = 0;
+    return true;
+}
+
+bool IoRing::isOpen() const {
+    return ring_fd >= 0;
+}
+
+bool IoRing::registerBuffers(const struct iovec* buffers, unsigned count) {
+    return ioUringRegister(ring_fd, IORING_REGISTER_BUFFERS, buffers, count) == 0;
+}
+
+struct io_uring_sqe* IoRing::nextSqe() {
+    // Only this thread moves the tail; the kernel moves the head
+    unsigned tail = *sq_tail;
+    if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+        return nullptr;
+    }
+    unsigned index = tail & *sq_mask;
+    struct io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    unsubmitted++;
+    return sqe;
+}
+
+bool IoRing::submit(unsigned wait_for) {
+    while (true) {
+        int submitted = ioUringEnter(ring_fd, unsubmitted, wait_for, wait_for > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (submitted >= 0) {
+            unsubmitted -= std::min<unsigned>(unsubmitted, submitted);
+            return true;
+        }
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+bool IoRing::popCompletion(uint64_t& user_data, int& result) {
+    unsigned head = *cq_head;
+    if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    const struct io_uring_cqe& cqe = cqes[head & *cq_mask];
+    user_data = cqe.user_data;
+    result = cqe.res;
+    __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool IoRing::isSupported() {
+    static const bool supported = []() {
+        IoRing probe;
+        return probe.init(2);
+    }();
+    return supported;
+}
+
+RingCopier::RingCopier(size_t queue_depth, size_t chunk)
+    : chunk_size(chunk), buffers(nullptr), fixed_buffers(false), broken(false) {
+    queue_depth = std::max<size_t>(queue_depth, 1);
+    if (!IoRing::isSupported() || !ring.init(static_cast<unsigned>(queue_depth))) {
+        return;
+    }
+
+    void* memory = nullptr;
+    if (posix_memalign(&memory, 4096, queue_depth * chunk_size) != 0) {
+        return;
+    }
+    buffers = static_cast<char*>(memory);
+
+    // Registered buffers are pinned once instead of on every operation. The
+    // pinned memory counts against RLIMIT_MEMLOCK; without it plain reads and
+    // writes into the same pool still work.
+    std::vector<struct iovec> iovecs(queue_depth);
+    for (size_t i = 0; i < queue_depth; i++) {
+        iovecs[i].iov_base = buffers + i * chunk_size;
+        iovecs[i].iov_len = chunk_size;
+    }
+    fixed_buffers = ring.registerBuffers(iovecs.data(), static_cast<unsigned>(iovecs.size()));
+    slots.assign(queue_depth, Slot{0, 0, 0, 0, false, false});
+}
+
+RingCopier::~RingCopier() {
+    // A broken ring may still have operations on the buffers; they are left
+    // allocated rather than risk the kernel writing into freed memory
+    if (!broken) free(buffers);
+}
+
+bool RingCopier::isReady() const {
+    return ring.isOpen() && buffers != nullptr && !broken;
+}
+
+size_t RingCopier::queueDepth() const {
+    return slots.size();
+}
+
+size_t RingCopier::add(int src_fd, int dst_fd, size_t offset, size_t length, const ProgressFn& progress) {
+    jobs.push_back(Job{src_fd, dst_fd, offset, offset + length, offset, 0, progress, 0});
+    return jobs.size() - 1;
+}
+
+size_t RingCopier::jobCount() const {
+    return jobs.size();
+}
+
+int RingCopier::jobError(size_t job) const {
+    return jobs[job].error;
+}
+
+void RingCopier::clear() {
+    jobs.clear();
+    retries.clear();
+    for (auto& slot : slots) {
+        slot.busy = false;
+    }
+}
+
+// Collects every operation still in flight without issuing new ones, so their
+// buffers are free again; a ring that cannot even wait is never used again
+void RingCopier::drain(size_t in_flight) {
+    uint64_t user_data;
+    int result;
+    while (in_flight > 0) {
+        while (in_flight > 0 && ring.popCompletion(user_data, result)) {
+            slots[static_cast<size_t>(user_data)].busy = false;
+            in_flight--;
+        }
+        if (in_flight > 0 && !ring.submit(1)) {
+            broken = true;
+            return;
+        }
+    }
+}
+
+// Short-read remainders first, then the next unassigned range in queue order,
+// so small files overlap with each other instead of running one by one
+bool RingCopier::nextChunk(size_t& first_job, Chunk& chunk) {
+    while (!retries.empty()) {
+        chunk = retries.front();
+        retries.pop_front();
+        if (jobs[chunk.job].error == 0) return true;
+    }
+    for (; first_job < jobs.size(); first_job++) {
+        Job& job = jobs[first_job];
+        if (job.error == 0 && job.next < job.end) {
+            chunk = Chunk{first_job, job.next, std::min(chunk_size, job.end - job.next)};
+            job.next += chunk.length;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RingCopier::issue(size_t index) {
+    struct io_uring_sqe* sqe = ring.nextSqe();
+    if (!sqe) {
+        return false;
+    }
+    Slot& slot = slots[index];
+    const Job& job = jobs[slot.job];
+    char* buffer = buffers + index * chunk_size;
+
+    if (slot.writing) {
+        sqe->opcode = fixed_buffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe->fd = job.dst_fd;
+        sqe->off = slot.offset + slot.written;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer + slot.written);
+        sqe->len = static_cast<uint32_t>(slot.length - slot.written);
+    } else {
+        sqe->opcode = fixed_buffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->fd = job.src_fd;
+        sqe->off = slot.offset;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer);
+        sqe->len = static_cast<uint32_t>(slot.length);
+    }
+    sqe->buf_index = static_cast<uint16_t>(index);
+    sqe->user_data = index;
+    return true;
+}
+
+void RingCopier::complete(size_t index, int result, size_t& in_flight) {
+    Slot& slot = slots[index];
+    Job& job = jobs[slot.job];
+
+    if (result == -EINTR || result == -EAGAIN) {
+        issue(index);  // same operation again
+        return;
+    }
+    if (result < 0) {
+        if (job.error == 0) job.error = -result;
+        slot.busy = false;
+        in_flight--;
+        return;
+    }
+
+    if (!slot.writing) {
+        if (result == 0) {
+            // Source shrank underneath us: stop where it ends, as the sync path does
+            job.next = job.end;
+            slot.busy = false;
+            in_flight--;
+            return;
+        }
+        if (static_cast<size_t>(result) < slot.length) {
+            retries.push_back(Chunk{slot.job, slot.offset + result, slot.length - result});
+            slot.length = result;
+        }
+        slot.writing = true;
+        slot.written = 0;
+        issue(index);
+        return;
+    }
+
+    slot.written += result;
+    if (slot.written < slot.length) {
+        issue(index);
+        return;
+    }
+    job.done += slot.length;
+    if (job.progress) job.progress(job.start + job.done, job.end);
+    slot.busy = false;
+    in_flight--;
+}
+
+bool RingCopier::run() {
+    size_t first_job = 0;
+    size_t in_flight = 0;
+
+    while (true) {
+        for (size_t i = 0; i < slots.size(); i++) {
+            Chunk chunk;
+            if (slots[i].busy || !nextChunk(first_job, chunk)) continue;
+            slots[i] = Slot{chunk.job, chunk.offset, chunk.length, 0, true, false};
+            issue(i);
+            in_flight++;
+        }
+        if (in_flight == 0) {
+            break;
+        }
+
+        if (!ring.submit(1)) {
+            // The ring itself failed; nothing in flight can be trusted
+            int err = errno;
+            for (auto& job : jobs) {
+                if (job.error == 0 && job.done < job.end - job.start) job.error = err;
+            }
+            drain(in_flight);
+            break;
+        }
+        uint64_t user_data;
+        int result;
+        while (ring.popCompletion(user_data, result)) {
+            complete(static_cast<size_t>(user_data), result, in_flight);
+        }
+    }
+
+    bool all_ok = true;
+    for (const auto& job : jobs) {
+        if (job.error != 0) all_ok = false;
+    }
+    return all_ok;
+}
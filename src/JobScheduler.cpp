@@ -0,0 +1,76 @@
+#include "JobScheduler.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+
+JobScheduler::JobScheduler(size_t workers, size_t device_limit)
+    : worker_count(workers), per_device_limit(std::max<size_t>(device_limit, 1)) {
+}
+
+void JobScheduler::add(const std::vector<dev_t>& devices, Job job) {
+    PendingJob pending;
+    pending.devices = devices;
+    std::sort(pending.devices.begin(), pending.devices.end());
+    pending.devices.erase(std::unique(pending.devices.begin(), pending.devices.end()), pending.devices.end());
+    pending.job = std::move(job);
+    jobs.push_back(std::move(pending));
+}
+
+size_t JobScheduler::size() const {
+    return jobs.size();
+}
+
+std::vector<OperationResult> JobScheduler::run() {
+    std::vector<OperationResult> results(jobs.size());
+    if (jobs.empty()) {
+        return results;
+    }
+
+    std::mutex state_mutex;
+    std::condition_variable job_finished;
+    std::map<dev_t, size_t> in_flight;
+    std::vector<bool> started(jobs.size(), false);
+    size_t running = 0;
+    size_t next_unstarted = 0;
+    size_t finished = 0;
+
+    // Declared after the state it uses so workers are joined before it goes away
+    ThreadPool pool(worker_count);
+    std::unique_lock<std::mutex> lock(state_mutex);
+    while (finished < jobs.size()) {
+        // Start, in order, every job whose devices all have spare capacity
+        for (size_t i = next_unstarted; i < jobs.size() && running < pool.size(); i++) {
+            if (started[i]) continue;
+
+            const PendingJob& pending = jobs[i];
+            bool eligible = std::all_of(pending.devices.begin(), pending.devices.end(),
+                [&](dev_t dev) { return in_flight[dev] < per_device_limit; });
+            if (!eligible) continue;
+
+            started[i] = true;
+            running++;
+            for (dev_t dev : pending.devices) in_flight[dev]++;
+
+            pool.submit([&, i]() {
+                OperationResult result = jobs[i].job();
+
+                std::lock_guard<std::mutex> done_lock(state_mutex);
+                results[i] = std::move(result);
+                for (dev_t dev : jobs[i].devices) in_flight[dev]--;
+                running--;
+                finished++;
+                job_finished.notify_one();
+            });
+        }
+        while (next_unstarted < jobs.size() && started[next_unstarted]) {
+            next_unstarted++;
+        }
+
+        size_t finished_before = finished;
+        job_finished.wait(lock, [&]() { return finished != finished_before; });
+    }
+
+    return results;
+}
@@ -0,0 +1,257 @@
+#include "MerkleTree.h"
+#include "Checksum.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+struct MerkleTree::BuildState {
+    ThreadPool* pool;
+    std::atomic<size_t> files{0};
+    std::atomic<size_t> directories{0};
+    std::atomic<size_t> hashed_files{0};
+    std::atomic<size_t> hashed_bytes{0};
+    std::atomic<size_t> cached_files{0};
+    std::atomic<size_t> errors{0};
+};
+
+// A directory whose hash waits on its listing, its large-file hash tasks and
+// its subdirectories
+struct MerkleTree::BuildNode {
+    BuildNode* parent;
+    Directory* directory;
+    std::string path;
+    std::atomic<size_t> pending{1};
+};
+
+MerkleTree::MerkleTree(DigestCache& cache, size_t workers) : digest_cache(cache), worker_count(workers) {
+}
+
+const MerkleTree::Directory& MerkleTree::root() const {
+    return root_directory;
+}
+
+const MerkleStats& MerkleTree::stats() const {
+    return build_stats;
+}
+
+// Content digest of a regular file the cache had no answer for. The digest
+// is stored under the opened file's own stat, not the listing's.
+void MerkleTree::hashEntry(BuildState& state, int dir_fd, Entry& entry) {
+    int fd = openat(dir_fd, entry.name.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        entry.type = EntryType::Unreadable;
+        state.errors++;
+        return;
+    }
+
+    static thread_local std::vector<char> buffer(1024 * 1024);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    XXHash64 hasher;
+    size_t total = 0;
+    while (true) {
+        ssize_t n = read(fd, buffer.data(), buffer.size());
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            close(fd);
+            entry.type = EntryType::Unreadable;
+            state.errors++;
+            return;
+        }
+        if (n == 0) break;
+        hasher.update(buffer.data(), n);
+        total += n;
+    }
+    close(fd);
+
+    entry.hash = hasher.digest();
+    digest_cache.store(st, entry.hash);
+    state.hashed_files++;
+    state.hashed_bytes += total;
+}
+
+void MerkleTree::scanDirectory(BuildState& state, BuildNode* node) {
+    state.directories++;
+
+    // The root may be reached through a symlink; nothing below it is
+    int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC | (node->parent ? O_NOFOLLOW : 0);
+    int fd = open(node->path.c_str(), flags);
+    DIR* dir = fd >= 0 ? fdopendir(fd) : nullptr;
+    if (!dir) {
+        if (fd >= 0) close(fd);
+        state.errors++;
+        // An unreadable directory hashes differently from any readable one
+        node->directory->entries.push_back(Entry{"", EntryType::Unreadable, 0, nullptr});
+        finishNode(node);
+        return;
+    }
+
+    std::vector<Entry>& entries = node->directory->entries;
+    std::vector<size_t> large_files;
+    std::vector<size_t> subdirectories;
+    int dir_fd = dirfd(dir);
+
+    struct dirent* dent;
+    while ((dent = readdir(dir)) != nullptr) {
+        const char* name = dent->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+
+        struct stat st;
+        if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            entries.push_back(Entry{name, EntryType::Unreadable, 0, nullptr});
+            state.errors++;
+            continue;
+        }
+
+        Entry entry{name, EntryType::Other, 0, nullptr};
+        if (S_ISDIR(st.st_mode)) {
+            entry.type = EntryType::Directory;
+            entry.directory.reset(new Directory());
+            subdirectories.push_back(entries.size());
+        } else if (S_ISLNK(st.st_mode)) {
+            entry.type = EntryType::Symlink;
+            std::vector<char> target(st.st_size > 0 ? st.st_size + 1 : 4096);
+            ssize_t length = readlinkat(dir_fd, name, target.data(), target.size());
+            if (length < 0) {
+                entry.type = EntryType::Unreadable;
+                state.errors++;
+            } else {
+                entry.hash = XXHash64::hash(target.data(), length);
+            }
+        } else if (S_ISREG(st.st_mode)) {
+            entry.type = EntryType::File;
+            state.files++;
+            // The listing's stat is enough to consult the cache; only a miss opens the file
+            if (digest_cache.lookup(st, entry.hash)) {
+                state.cached_files++;
+            } else if (static_cast<size_t>(st.st_size) >= LARGE_FILE_SIZE) {
+                large_files.push_back(entries.size());
+            } else {
+                hashEntry(state, dir_fd, entry);
+            }
+        }
+        entries.push_back(std::move(entry));
+    }
+
+    // The entry list is final now, so tasks may fill in entries by index
+    node->pending += large_files.size() + subdirectories.size();
+
+    for (size_t index : subdirectories) {
+        BuildNode* child = new BuildNode();
+        child->parent = node;
+        child->directory = entries[index].directory.get();
+        child->path = node->path + "/" + entries[index].name;
+        state.pool->submit([this, &state, child]() { scanDirectory(state, child); });
+    }
+
+    // Large-file tasks share the directory handle, which stays open until they finish
+    auto handle = std::shared_ptr<DIR>(dir, closedir);
+    for (size_t index : large_files) {
+        state.pool->submit([this, &state, node, handle, index]() {
+            hashEntry(state, dirfd(handle.get()), node->directory->entries[index]);
+            finishNode(node);
+        });
+    }
+    handle.reset();
+
+    finishNode(node);
+}
+
+void MerkleTree::finishNode(BuildNode* node) {
+    while (node && node->pending.fetch_sub(1) == 1) {
+        Directory* directory = node->directory;
+        std::sort(directory->entries.begin(), directory->entries.end(),
+            [](const Entry& a, const Entry& b) { return a.name < b.name; });
+
+        XXHash64 hasher;
+        for (auto& entry : directory->entries) {
+            if (entry.type == EntryType::Directory) {
+                entry.hash = entry.directory->hash;
+            }
+            unsigned char type = static_cast<unsigned char>(entry.type);
+            hasher.update(entry.name.c_str(), entry.name.size() + 1);
+            hasher.update(&type, 1);
+            hasher.update(&entry.hash, sizeof(entry.hash));
+        }
+        directory->hash = hasher.digest();
+
+        BuildNode* parent = node->parent;
+        delete node;
+        node = parent;
+    }
+}
+
+bool MerkleTree::build(const std::string& path) {
+    root_directory = Directory();
+    build_stats = MerkleStats();
+
+    struct stat root_stat;
+    if (stat(path.c_str(), &root_stat) != 0) {
+        return false;
+    }
+    if (!S_ISDIR(root_stat.st_mode)) {
+        errno = ENOTDIR;
+        return false;
+    }
+
+    BuildState state;
+    {
+        ThreadPool pool(worker_count);
+        state.pool = &pool;
+
+        BuildNode* root = new BuildNode();
+        root->parent = nullptr;
+        root->directory = &root_directory;
+        root->path = path;
+        pool.submit([this, &state, root]() { scanDirectory(state, root); });
+        pool.wait();
+    }
+
+    build_stats.files = state.files;
+    build_stats.directories = state.directories;
+    build_stats.hashed_files = state.hashed_files;
+    build_stats.hashed_bytes = state.hashed_bytes;
+    build_stats.cached_files = state.cached_files;
+    build_stats.errors = state.errors;
+    return true;
+}
+
+void MerkleTree::diff(const Directory& left, const Directory& right, const std::string& prefix,
+                      std::vector<OperationResult>& changes) {
+    if (left.hash == right.hash) {
+        return;  // identical subtree: nothing below needs looking at
+    }
+
+    auto record = [&](const Entry& entry, const char* what) {
+        OperationResult change(false, what);
+        change.path = prefix + entry.name + (entry.type == EntryType::Directory ? "/" : "");
+        changes.push_back(std::move(change));
+    };
+
+    // Both entry lists are sorted by name, so one merge pass pairs them up
+    size_t i = 0, j = 0;
+    while (i < left.entries.size() || j < right.entries.size()) {
+        if (j == right.entries.size() || (i < left.entries.size() && left.entries[i].name < right.entries[j].name)) {
+            record(left.entries[i++], "removed");
+        } else if (i == left.entries.size() || right.entries[j].name < left.entries[i].name) {
+            record(right.entries[j++], "added");
+        } else {
+            const Entry& a = left.entries[i++];
+            const Entry& b = right.entries[j++];
+            if (a.type == EntryType::Unreadable || b.type == EntryType::Unreadable) {
+                record(a.type == EntryType::Unreadable ? a : b, "unreadable");
+            } else if (a.type == EntryType::Directory && b.type == EntryType::Directory) {
+                diff(*a.directory, *b.directory, prefix + a.name + "/", changes);
+            } else if (a.type != b.type || a.hash != b.hash) {
+                record(b, "changed");
+            }
+        }
+    }
+}
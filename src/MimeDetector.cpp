@@ -0,0 +1,384 @@
+#include "MimeDetector.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+// A signature is bytes at an offset, optionally followed by more bytes at a
+// second offset (RIFF....WAVE); the gap between them matches anything
+struct Signature {
+    size_t offset;
+    const char* bytes;
+    size_t length;
+    size_t offset2;
+    const char* bytes2;
+    size_t length2;
+    const char* mime;
+
+    template <size_t N>
+    Signature(size_t at, const char (&data)[N], const char* type)
+        : offset(at), bytes(data), length(N - 1), offset2(0), bytes2(nullptr), length2(0), mime(type) {}
+    template <size_t N, size_t M>
+    Signature(size_t at, const char (&data)[N], size_t at2, const char (&data2)[M], const char* type)
+        : offset(at), bytes(data), length(N - 1), offset2(at2), bytes2(data2), length2(M - 1), mime(type) {}
+};
+
+const Signature SIGNATURES[] = {
+    // Images
+    {0, "\x89PNG\r\n\x1a\n", "image/png"},
+    {0, "\xff\xd8\xff", "image/jpeg"},
+    {0, "GIF87a", "image/gif"},
+    {0, "GIF89a", "image/gif"},
+    {0, "RIFF", 8, "WEBP", "image/webp"},
+    {0, "BM", 6, "\0\0\0\0", "image/bmp"},
+    {0, "II*\0", "image/tiff"},
+    {0, "MM\0*", "image/tiff"},
+    {0, "\0\0\1\0", "image/vnd.microsoft.icon"},
+    {0, "8BPS", "image/vnd.adobe.photoshop"},
+    {4, "ftypheic", "image/heic"},
+    {4, "ftypavif", "image/avif"},
+    {0, "<svg", "image/svg+xml"},
+    // Audio and video
+    {0, "ID3", "audio/mpeg"},
+    {0, "fLaC", "audio/flac"},
+    {0, "OggS", "audio/ogg"},
+    {0, "MThd", "audio/midi"},
+    {0, "RIFF", 8, "WAVE", "audio/wav"},
+    {0, "RIFF", 8, "AVI ", "video/x-msvideo"},
+    {4, "ftyp", "video/mp4"},
+    {4, "ftypqt", "video/quicktime"},
+    {4, "ftypM4A", "audio/mp4"},
+    {0, "\x1a\x45\xdf\xa3", "video/x-matroska"},
+    {0, "FLV\x01", "video/x-flv"},
+    // Archives and compression
+    {0, "PK\x03\x04", "application/zip"},
+    {0, "PK\x05\x06", "application/zip"},
+    {0, "\x1f\x8b", "application/gzip"},
+    {0, "BZh", "application/x-bzip2"},
+    {0, "\xfd" "7zXZ\0", "application/x-xz"},
+    {0, "\x28\xb5\x2f\xfd", "application/zstd"},
+    {0, "7z\xbc\xaf\x27\x1c", "application/x-7z-compressed"},
+    {0, "Rar!\x1a\x07", "application/vnd.rar"},
+    {257, "ustar", "application/x-tar"},
+    {0, "!<arch>\n", "application/x-archive"},
+    {0, "!<arch>\ndebian", "application/vnd.debian.binary-package"},
+    {0, "\xed\xab\xee\xdb", "application/x-rpm"},
+    // Documents
+    {0, "%PDF-", "application/pdf"},
+    {0, "%!PS", "application/postscript"},
+    {0, "{\\rtf", "application/rtf"},
+    {0, "<?xml", "application/xml"},
+    {0, "<!DOCTYPE html", "text/html"},
+    {0, "<!doctype html", "text/html"},
+    {0, "<html", "text/html"},
+    {0, "<HTML", "text/html"},
+    {0, "SQLite format 3\0", "application/vnd.sqlite3"},
+    // Executables and fonts
+    {0, "\x7f" "ELF", "application/x-executable"},
+    {0, "MZ", "application/vnd.microsoft.portable-executable"},
+    {0, "\xca\xfe\xba\xbe", "application/java-vm"},
+    {0, "\0asm", "application/wasm"},
+    {0, "wOFF", "font/woff"},
+    {0, "wOF2", "font/woff2"},
+    {0, "OTTO", "font/otf"},
+    {0, "\0\1\0\0\0", "font/ttf"},
+    // Byte order marks
+    {0, "\xef\xbb\xbf", "text/plain"},
+    {0, "\xff\xfe", "text/plain"},
+    {0, "\xfe\xff", "text/plain"},
+};
+
+// Formats without a magic number, recognised by name alone
+const std::pair<const char*, const char*> TRUSTED_EXTENSIONS[] = {
+    {"txt", "text/plain"}, {"log", "text/plain"}, {"md", "text/markdown"},
+    {"c", "text/x-c"}, {"h", "text/x-c"}, {"cpp", "text/x-c++"}, {"cc", "text/x-c++"},
+    {"cxx", "text/x-c++"}, {"hpp", "text/x-c++"}, {"py", "text/x-python"}, {"sh", "text/x-shellscript"},
+    {"java", "text/x-java"}, {"go", "text/x-go"}, {"rs", "text/x-rust"}, {"rb", "text/x-ruby"},
+    {"pl", "text/x-perl"}, {"js", "application/javascript"}, {"json", "application/json"},
+    {"csv", "text/csv"}, {"tsv", "text/tab-separated-values"}, {"css", "text/css"},
+    {"htm", "text/html"}, {"html", "text/html"}, {"xml", "application/xml"}, {"svg", "image/svg+xml"},
+    {"yaml", "application/yaml"}, {"yml", "application/yaml"}, {"toml", "application/toml"},
+    {"sql", "application/sql"},
+};
+
+// Interpreters named on a #! line
+const std::pair<const char*, const char*> INTERPRETERS[] = {
+    {"sh", "text/x-shellscript"}, {"bash", "text/x-shellscript"}, {"dash", "text/x-shellscript"},
+    {"zsh", "text/x-shellscript"}, {"ksh", "text/x-shellscript"}, {"python", "text/x-python"},
+    {"perl", "text/x-perl"}, {"ruby", "text/x-ruby"}, {"node", "application/javascript"},
+};
+
+const char* const TEXT_APPLICATION_TYPES[] = {
+    "application/json", "application/xml", "application/javascript", "application/yaml",
+    "application/toml", "application/sql", "application/rtf", "image/svg+xml",
+};
+
+// UTF-8 without NULs or control characters other than the usual whitespace;
+// a sequence cut off by the end of the buffer is fine
+bool looksLikeText(const unsigned char* data, size_t length) {
+    for (size_t i = 0; i < length;) {
+        unsigned char c = data[i];
+        if (c < 0x80) {
+            if (c < 0x20 && c != '\t' && c != '\n' && c != '\r' && c != '\f' && c != '\b' && c != 0x1b) {
+                return false;
+            }
+            i++;
+            continue;
+        }
+        size_t extra = (c & 0xe0) == 0xc0 ? 1 : (c & 0xf0) == 0xe0 ? 2 : (c & 0xf8) == 0xf0 ? 3 : 0;
+        if (extra == 0) {
+            return false;
+        }
+        for (size_t k = 1; k <= extra && i + k < length; k++) {
+            if ((data[i + k] & 0xc0) != 0x80) return false;
+        }
+        i += extra + 1;
+    }
+    return true;
+}
+
+const char* scriptType(const unsigned char* data, size_t length) {
+    if (length < 2 || data[0] != '#' || data[1] != '!') {
+        return "text/plain";
+    }
+    std::string line(reinterpret_cast<const char*>(data) + 2,
+                     std::find(data + 2, data + length, '\n') - (data + 2));
+    std::vector<std::string> words;
+    for (size_t start = 0; start < line.size();) {
+        size_t end = line.find_first_of(" \t", start);
+        if (end == std::string::npos) end = line.size();
+        if (end > start) words.push_back(line.substr(start, end - start));
+        start = end + 1;
+    }
+    if (words.empty()) return "text/plain";
+
+    std::string program = words[0].substr(words[0].rfind('/') + 1);
+    if (program == "env" && words.size() > 1) program = words[1];
+    for (const auto& interpreter : INTERPRETERS) {
+        // python3, perl5.36 and the like
+        if (program.compare(0, strlen(interpreter.first), interpreter.first) == 0) return interpreter.second;
+    }
+    return "text/plain";
+}
+
+} // namespace
+
+MimeDetector::MimeDetector() {
+    for (const auto& signature : SIGNATURES) {
+        addSignature(signature.offset, signature.bytes, signature.length, signature.offset2, signature.bytes2,
+                     signature.length2, signature.mime);
+    }
+    // Nearly every signature starts at 0, so its first byte is a table lookup
+    std::fill(std::begin(first_byte), std::end(first_byte), 0);
+    for (const auto& edge : trie[root(0)].edges) {
+        first_byte[edge.first] = edge.second;
+    }
+    for (const auto& extension : TRUSTED_EXTENSIONS) {
+        trusted_extensions.emplace(extension.first, extension.second);
+    }
+}
+
+MimeDetector& MimeDetector::shared() {
+    static MimeDetector detector;
+    return detector;
+}
+
+// The root for signatures starting at offset, added if it is not there yet
+uint32_t MimeDetector::root(size_t offset) {
+    auto it = std::lower_bound(roots.begin(), roots.end(), offset,
+                               [](const Root& r, size_t value) { return r.offset < value; });
+    if (it != roots.end() && it->offset == offset) return it->node;
+    uint32_t node = trie.size();
+    trie.emplace_back();
+    roots.insert(it, {offset, node});
+    return node;
+}
+
+// The child of node for byte, added if it is not there yet
+uint32_t MimeDetector::child(uint32_t node, unsigned char byte) {
+    for (const auto& edge : trie[node].edges) {
+        if (edge.first == byte) return edge.second;
+    }
+    uint32_t next = trie.size();
+    trie.emplace_back();
+    trie[node].edges.emplace_back(byte, next);
+    return next;
+}
+
+void MimeDetector::addSignature(size_t offset, const char* bytes, size_t length, size_t offset2,
+                                const char* bytes2, size_t length2, const char* mime) {
+    uint32_t node = root(offset);
+    size_t position = offset;
+    auto skipTo = [&](size_t target) {
+        for (; position < target; position++) {
+            if (trie[node].any == 0) {
+                uint32_t next = trie.size();
+                trie.emplace_back();
+                trie[node].any = next;
+            }
+            node = trie[node].any;
+        }
+    };
+    auto append = [&](const char* data, size_t count) {
+        for (size_t i = 0; i < count; i++, position++) {
+            node = child(node, static_cast<unsigned char>(data[i]));
+        }
+    };
+
+    append(bytes, length);
+    if (bytes2) {
+        skipTo(offset2);
+        append(bytes2, length2);
+    }
+    trie[node].mime = mime;
+}
+
+// The longest signature matching data from node on; depth receives where it ends
+const char* MimeDetector::matchTrie(uint32_t node, const unsigned char* data, size_t length, size_t position,
+                                    size_t& depth) const {
+    const char* best = trie[node].mime;
+    depth = best ? position : 0;
+    if (position >= length) {
+        return best;
+    }
+
+    auto descend = [&](uint32_t next) {
+        size_t next_depth;
+        const char* found = matchTrie(next, data, length, position + 1, next_depth);
+        if (found && next_depth > depth) {
+            best = found;
+            depth = next_depth;
+        }
+    };
+    for (const auto& edge : trie[node].edges) {
+        if (edge.first == data[position]) {
+            descend(edge.second);
+            break;
+        }
+    }
+    if (trie[node].any) {
+        descend(trie[node].any);
+    }
+    return best;
+}
+
+const char* MimeDetector::sniff(const char* data, size_t length) const {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    const char* mime = nullptr;
+    size_t depth = 0;
+    for (const auto& r : roots) {
+        if (r.offset >= length) break;
+        uint32_t node = r.node;
+        size_t position = r.offset;
+        if (position == 0) {
+            node = first_byte[bytes[0]];
+            position = 1;
+            if (node == 0) continue;
+        }
+        size_t found_depth;
+        const char* found = matchTrie(node, bytes, length, position, found_depth);
+        if (found && found_depth > depth) {
+            mime = found;
+            depth = found_depth;
+        }
+    }
+    if (mime) {
+        return mime;
+    }
+    return looksLikeText(bytes, length) ? scriptType(bytes, length) : "application/octet-stream";
+}
+
+const char* MimeDetector::detect(const std::string& path, const struct stat& st, std::string* header) {
+    if (S_ISDIR(st.st_mode)) return "inode/directory";
+    if (S_ISLNK(st.st_mode)) return "inode/symlink";
+    if (S_ISCHR(st.st_mode)) return "inode/chardevice";
+    if (S_ISBLK(st.st_mode)) return "inode/blockdevice";
+    if (S_ISFIFO(st.st_mode)) return "inode/fifo";
+    if (S_ISSOCK(st.st_mode)) return "inode/socket";
+    if (st.st_size == 0) return "inode/x-empty";
+
+    size_t slash = path.rfind('/');
+    size_t dot = path.rfind('.');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash + 1)) {
+        std::string extension = path.substr(dot + 1);
+        for (char& c : extension) c = tolower(static_cast<unsigned char>(c));
+        auto trusted = trusted_extensions.find(extension);
+        if (trusted != trusted_extensions.end()) {
+            return trusted->second;
+        }
+    }
+
+    FileId id(st);
+    int64_t mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto cached = cache.find(id);
+        if (cached != cache.end() && cached->second.mtime_ns == mtime_ns) {
+            return cached->second.mime;
+        }
+    }
+
+    std::string local;
+    std::string& bytes = header ? *header : local;
+    if (bytes.empty()) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return "application/octet-stream";
+        }
+        bytes.resize(std::min<size_t>(HEADER_SIZE, st.st_size));
+        size_t filled = 0;
+        while (filled < bytes.size()) {
+            ssize_t n = pread(fd, &bytes[filled], bytes.size() - filled, filled);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            filled += n;
+        }
+        close(fd);
+        bytes.resize(filled);
+    }
+
+    const char* mime = sniff(bytes.data(), bytes.size());
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (cache.size() >= MAX_CACHED) {
+        cache.clear();
+    }
+    cache[id] = {mtime_ns, mime};
+    return mime;
+}
+
+bool MimeDetector::isTextType(const std::string& mime) {
+    if (mime.compare(0, 5, "text/") == 0) {
+        return true;
+    }
+    for (const char* type : TEXT_APPLICATION_TYPES) {
+        if (mime == type) return true;
+    }
+    return false;
+}
+
+bool MimeDetector::matches(const std::string& mime, const std::string& filter) {
+    if (filter.empty()) {
+        return true;
+    }
+    if (filter == "text") {
+        return isTextType(mime);
+    }
+    size_t slash = filter.find('/');
+    if (slash == std::string::npos) {
+        return mime.size() > filter.size() && mime.compare(0, filter.size(), filter) == 0 &&
+               mime[filter.size()] == '/';
+    }
+    if (filter.compare(slash + 1, std::string::npos, "*") == 0) {
+        return mime.compare(0, slash + 1, filter, 0, slash + 1) == 0;
+    }
+    return mime == filter;
+}
+
+void MimeDetector::clearCache() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache.clear();
+}
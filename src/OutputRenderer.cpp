@@ -0,0 +1,138 @@
+#include "OutputRenderer.h"
+#include <iostream>
+#include <charconv>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+OutputRenderer::OutputRenderer(int fd, size_t threshold)
+    : output_fd(fd), flush_threshold(threshold), used(0), rows_rendered(0) {
+    buffer.resize(flush_threshold + 4096);
+}
+
+OutputRenderer::~OutputRenderer() {
+    flush();
+}
+
+void OutputRenderer::reserve(size_t extra) {
+    if (used + extra > buffer.size()) {
+        buffer.resize(std::max(buffer.size() * 2, used + extra));
+    }
+}
+
+void OutputRenderer::append(const char* data, size_t length) {
+    reserve(length);
+    memcpy(buffer.data() + used, data, length);
+    used += length;
+}
+
+void OutputRenderer::append(const std::string& text) {
+    append(text.data(), text.size());
+}
+
+void OutputRenderer::appendRows(const char* data, size_t length) {
+    rows_rendered += std::count(data, data + length, '\n');
+    while (length > 0) {
+        size_t piece = std::min(length, flush_threshold);
+        append(data, piece);
+        data += piece;
+        length -= piece;
+        if (used >= flush_threshold) {
+            flush();
+        }
+    }
+}
+
+void OutputRenderer::append(char c) {
+    reserve(1);
+    buffer[used++] = c;
+}
+
+void OutputRenderer::appendRepeated(char c, size_t count) {
+    reserve(count);
+    memset(buffer.data() + used, c, count);
+    used += count;
+}
+
+void OutputRenderer::appendPadded(const char* data, size_t length, size_t width) {
+    append(data, length);
+    if (length < width) {
+        appendRepeated(' ', width - length);
+    }
+}
+
+void OutputRenderer::appendPadded(const std::string& text, size_t width) {
+    appendPadded(text.data(), text.size(), width);
+}
+
+void OutputRenderer::appendNumber(unsigned long long value) {
+    reserve(24);
+    auto result = std::to_chars(buffer.data() + used, buffer.data() + used + 24, value);
+    used = result.ptr - buffer.data();
+}
+
+void OutputRenderer::appendFileSize(size_t size) {
+    reserve(FILE_SIZE_CHARS);
+    used += formatFileSize(buffer.data() + used, size);
+}
+
+void OutputRenderer::endRow() {
+    append('\n');
+    rows_rendered++;
+    if (used >= flush_threshold) {
+        flush();
+    }
+}
+
+void OutputRenderer::flush() {
+    if (used == 0) {
+        return;
+    }
+
+    // Anything already queued in std::cout must reach the fd first
+    std::cout.flush();
+
+    size_t written = 0;
+    while (written < used) {
+        ssize_t n = ::write(output_fd, buffer.data() + written, used - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        written += static_cast<size_t>(n);
+    }
+    used = 0;
+}
+
+size_t OutputRenderer::getRowsRendered() const {
+    return rows_rendered;
+}
+
+size_t OutputRenderer::formatFileSize(char* out, size_t size) {
+    static const char* units[] = {"B", "KB", "MB", "GB", "TB"};
+    int unit = 0;
+    size_t divisor = 1;
+
+    while (unit < 4 && size / divisor >= 1024) {
+        divisor *= 1024;
+        unit++;
+    }
+
+    // Fixed point with one decimal, rounded like std::setprecision(1)
+    size_t whole = size / divisor;
+    size_t tenths = ((size % divisor) * 10 + divisor / 2) / divisor;
+    if (tenths == 10) {
+        whole++;
+        tenths = 0;
+    }
+
+    char* end = out + FILE_SIZE_CHARS;
+    char* p = std::to_chars(out, end, whole).ptr;
+    *p++ = '.';
+    *p++ = static_cast<char>('0' + tenths);
+    *p++ = ' ';
+    size_t unit_len = strlen(units[unit]);
+    memcpy(p, units[unit], unit_len);
+    p += unit_len;
+    return p - out;
+}
@@ -0,0 +1,87 @@
+#include "ProgressTracker.h"
+#include <cmath>
+
+ProgressTracker::ProgressTracker(ProgressCallback report, std::chrono::milliseconds every)
+    : bytes_done(0), files_done(0), bytes_total(0), files_total(0), totals_fixed(false), parent(nullptr),
+      callback(std::move(report)), interval(every), start_time(std::chrono::steady_clock::now()),
+      last_sample(start_time), last_bytes(0), average_rate(0), stopping(false) {
+    if (callback) {
+        reporter = std::thread(&ProgressTracker::run, this);
+    }
+}
+
+ProgressTracker::ProgressTracker(ProgressTracker* up)
+    : bytes_done(0), files_done(0), bytes_total(0), files_total(0), totals_fixed(false), parent(up),
+      interval(DEFAULT_INTERVAL), start_time(std::chrono::steady_clock::now()), last_sample(start_time),
+      last_bytes(0), average_rate(0), stopping(false) {
+}
+
+ProgressTracker::~ProgressTracker() {
+    finish();
+}
+
+void ProgressTracker::addTotals(size_t bytes, size_t files) {
+    if (!totals_fixed.load(std::memory_order_relaxed)) {
+        bytes_total.fetch_add(bytes, std::memory_order_relaxed);
+        files_total.fetch_add(files, std::memory_order_relaxed);
+    }
+    if (parent) parent->addTotals(bytes, files);
+}
+
+void ProgressTracker::setTotals(size_t bytes, size_t files) {
+    bytes_total = bytes;
+    files_total = files;
+    totals_fixed = true;
+}
+
+// Only the reporter thread (or finish(), once it has stopped) samples
+ProgressSnapshot ProgressTracker::sample(bool finished) {
+    auto now = std::chrono::steady_clock::now();
+    ProgressSnapshot snapshot;
+    snapshot.bytes_done = bytes_done.load(std::memory_order_relaxed);
+    snapshot.files_done = files_done.load(std::memory_order_relaxed);
+    snapshot.bytes_total = bytes_total.load(std::memory_order_relaxed);
+    snapshot.files_total = files_total.load(std::memory_order_relaxed);
+    snapshot.elapsed_seconds = std::chrono::duration<double>(now - start_time).count();
+    snapshot.finished = finished;
+
+    double dt = std::chrono::duration<double>(now - last_sample).count();
+    if (dt > 0) {
+        double rate = (snapshot.bytes_done - last_bytes) / dt;
+        // Weighted by elapsed time, so irregular sample spacing does not skew it
+        double weight = last_bytes == 0 && average_rate == 0 ? 1.0 : 1.0 - std::exp(-dt / AVERAGE_SECONDS);
+        average_rate += weight * (rate - average_rate);
+        last_sample = now;
+        last_bytes = snapshot.bytes_done;
+    }
+    snapshot.bytes_per_second = average_rate;
+
+    if (finished) {
+        snapshot.eta_seconds = 0;
+    } else if (snapshot.bytes_total > snapshot.bytes_done && average_rate > 0) {
+        snapshot.eta_seconds = (snapshot.bytes_total - snapshot.bytes_done) / average_rate;
+    }
+    return snapshot;
+}
+
+void ProgressTracker::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!wake.wait_for(lock, interval, [this]() { return stopping; })) {
+        lock.unlock();
+        callback(sample(false));
+        lock.lock();
+    }
+}
+
+void ProgressTracker::finish() {
+    if (!reporter.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    reporter.join();
+    callback(sample(true));
+}
@@ -1,10 +1,14 @@
 #include "SearchEngine.h"
+#include "OutputRenderer.h"
+#include "MimeDetector.h"
 #include <iostream>
 #include <fstream>
 #include <algorithm>
+#include <cerrno>
 #include <cstring>
 #include <dirent.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sstream>
 #include <iomanip>
 
@@ -67,7 +71,16 @@ void SearchEngine::searchInDirectory(const std::string& dir_path, const SearchCr
         struct stat file_stat;
 
         if (stat(full_path.c_str(), &file_stat) == 0) {
-            if (matchesCriteria(full_path, file_stat, criteria)) {
+            // The start of the file, if the type check had to read it, so the
+            // content search does not read it again
+            std::string head;
+            const char* mime = nullptr;
+            bool matches = matchesCriteria(full_path, file_stat, criteria);
+            if (matches && !criteria.mime_type.empty()) {
+                mime = MimeDetector::shared().detect(full_path, file_stat, &head);
+                matches = MimeDetector::matches(mime, criteria.mime_type);
+            }
+            if (matches) {
                 SearchResult result;
                 result.path = full_path;
                 result.name = name;
@@ -82,10 +95,13 @@ void SearchEngine::searchInDirectory(const std::string& dir_path, const SearchCr
                 } else {
                     result.type = "Other";
                 }
+                if (mime) {
+                    result.mime = mime;
+                }
 
                 // Search content if requested and it's a regular file
                 if (criteria.search_content && S_ISREG(file_stat.st_mode)) {
-                    result.content_matches = searchInFile(full_path, criteria);
+                    result.content_matches = searchInFile(full_path, criteria, head);
                 }
 
                 results.push_back(result);
@@ -153,11 +169,13 @@ bool SearchEngine::matchesNamePattern(const std::string& name, const SearchCrite
     }
 }
 
-std::vector<std::pair<int, std::string>> SearchEngine::searchInFile(const std::string& file_path, const SearchCriteria& criteria) {
+// head holds the first bytes of the file when they were already read
+std::vector<std::pair<int, std::string>> SearchEngine::searchInFile(const std::string& file_path, const SearchCriteria& criteria,
+                                                                  const std::string& head) {
     std::vector<std::pair<int, std::string>> matches;
 
-    std::ifstream file(file_path);
-    if (!file) {
+    int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
         return matches;
     }
 
@@ -169,19 +187,39 @@ std::vector<std::pair<int, std::string>> SearchEngine::searchInFile(const std::s
         if (verbose_output) {
             std::cerr << "Invalid content regex: " << e.what() << std::endl;
         }
+        close(fd);
         return matches;
     }
 
-    std::string line;
     int line_number = 1;
-
-    while (std::getline(file, line)) {
+    auto checkLine = [&](const std::string& line) {
         if (std::regex_search(line, pattern)) {
             matches.emplace_back(line_number, line);
         }
         line_number++;
+    };
+
+    std::string pending = head;
+    off_t offset = head.size();
+    char buffer[65536];
+    while (true) {
+        size_t start = 0;
+        for (size_t newline; (newline = pending.find('\n', start)) != std::string::npos; start = newline + 1) {
+            checkLine(pending.substr(start, newline - start));
+        }
+        pending.erase(0, start);
+
+        ssize_t n = pread(fd, buffer, sizeof(buffer), offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        pending.append(buffer, n);
+        offset += n;
+    }
+    if (!pending.empty()) {
+        checkLine(pending);
     }
 
+    close(fd);
     return matches;
 }
 
@@ -239,44 +277,52 @@ void SearchEngine::displayResults(const std::vector<SearchResult>& results) {
         return;
     }
 
-    std::cout << "\nSearch Results (" << results.size() << " found):\n";
-    std::cout << std::string(80, '=') << "\n";
+    OutputRenderer out;
+    out.append("\nSearch Results (");
+    out.appendNumber(results.size());
+    out.append(" found):");
+    out.endRow();
+    out.appendRepeated('=', 80);
+    out.endRow();
 
     for (const auto& result : results) {
-        std::cout << result.path;
+        out.append(result.path);
         if (result.type == "Directory") {
-            std::cout << "/";
+            out.append('/');
+        }
+        out.append(" [");
+        out.append(result.type);
+        if (!result.mime.empty()) {
+            out.append(", ");
+            out.append(result.mime);
         }
-        std::cout << " [" << result.type << "]";
+        out.append(']');
 
         if (result.type == "File") {
-            const char* units[] = {"B", "KB", "MB", "GB", "TB"};
-            int unit = 0;
-            double size_d = static_cast<double>(result.size);
-
-            while (size_d >= 1024.0 && unit < 4) {
-                size_d /= 1024.0;
-                unit++;
-            }
-
-            std::stringstream ss;
-            ss << std::fixed << std::setprecision(1) << size_d << " " << units[unit];
-            std::cout << " (" << ss.str() << ")";
+            out.append(" (");
+            out.appendFileSize(result.size);
+            out.append(')');
         }
 
-        std::cout << "\n";
+        out.endRow();
 
         // Show content matches if available
         if (!result.content_matches.empty()) {
-            std::cout << "  Content matches:\n";
+            out.append("  Content matches:");
+            out.endRow();
             for (const auto& match : result.content_matches) {
-                std::cout << "    Line " << match.first << ": " << match.second << "\n";
+                out.append("    Line ");
+                out.appendNumber(match.first);
+                out.append(": ");
+                out.append(match.second);
+                out.endRow();
             }
-            std::cout << "\n";
+            out.endRow();
         }
     }
 
-    std::cout << std::string(80, '=') << "\n";
+    out.appendRepeated('=', 80);
+    out.endRow();
 }
 
 std::string SearchEngine::globToRegex(const std::string& glob_pattern) {
@@ -0,0 +1,278 @@
+#include "SecureEraser.h"
+#include "ThreadPool.h"
+#include "BufferPool.h"
+#include "FileId.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+
+// xoshiro256+ run as independent lanes side by side: each lane's step is the
+// same few adds, shifts and xors, so the compiler turns the lane loop into
+// vector instructions and the pattern is generated far faster than any disk
+// can take it. Quality only has to defeat recovery of the old contents, not
+// cryptanalysis, but every pass is seeded afresh from the kernel.
+class PatternGenerator {
+private:
+    static constexpr size_t LANES = 4;
+    uint64_t s0[LANES], s1[LANES], s2[LANES], s3[LANES];
+
+    static uint64_t splitmix(uint64_t& x) {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+public:
+    PatternGenerator() {
+        uint64_t seed;
+        if (getrandom(&seed, sizeof(seed), 0) != sizeof(seed)) {
+            seed = std::chrono::steady_clock::now().time_since_epoch().count() ^ reinterpret_cast<uintptr_t>(this);
+        }
+        for (size_t l = 0; l < LANES; l++) {
+            s0[l] = splitmix(seed);
+            s1[l] = splitmix(seed);
+            s2[l] = splitmix(seed);
+            s3[l] = splitmix(seed);
+        }
+    }
+
+    // Fills length bytes, rounded up to whole 32-byte steps (the buffer is
+    // always a pool buffer, so there is room)
+    void fill(char* buffer, size_t length) {
+        uint64_t* out = reinterpret_cast<uint64_t*>(buffer);
+        size_t words = (length + sizeof(uint64_t) * LANES - 1) / (sizeof(uint64_t) * LANES) * LANES;
+        for (size_t i = 0; i < words; i += LANES) {
+            for (size_t l = 0; l < LANES; l++) {
+                out[i + l] = s0[l] + s3[l];
+                uint64_t t = s1[l] << 17;
+                s2[l] ^= s0[l];
+                s3[l] ^= s1[l];
+                s1[l] ^= s2[l];
+                s0[l] ^= s3[l];
+                s2[l] ^= t;
+                s3[l] = (s3[l] << 45) | (s3[l] >> 19);
+            }
+        }
+    }
+};
+
+struct SecureEraser::EraseState {
+    std::mutex mutex;  // errors
+    std::vector<OperationResult>* errors;
+    ProgressTracker* progress = nullptr;
+
+    void record(const std::string& path, int code, const std::string& message) {
+        OperationResult error(false, message + ": " + strerror(code), code);
+        error.path = path;
+        std::lock_guard<std::mutex> lock(mutex);
+        errors->push_back(std::move(error));
+    }
+};
+
+SecureEraser::SecureEraser(size_t workers, Throttle* limiter)
+    : worker_count(workers), throttle(limiter), erased_files(0), data_bytes(0), hole_bytes(0) {
+}
+
+void SecureEraser::scanTree(EraseState& state, const std::string& path, std::vector<EraseJob>& jobs) {
+    std::unordered_map<FileId, size_t, FileIdHash> seen;
+    std::vector<std::string> pending(1, path);
+    while (!pending.empty()) {
+        std::string directory = std::move(pending.back());
+        pending.pop_back();
+        DIR* dir = opendir(directory.c_str());
+        if (!dir) {
+            state.record(directory, errno, "Cannot open directory");
+            continue;
+        }
+
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            std::string entry_path = directory + "/" + entry->d_name;
+            struct stat st;
+            if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                state.record(entry_path, errno, "Cannot stat");
+            } else if (S_ISDIR(st.st_mode)) {
+                pending.push_back(entry_path);
+            } else if (S_ISREG(st.st_mode)) {
+                auto inserted = seen.emplace(FileId(st), jobs.size());
+                if (inserted.second) {
+                    jobs.push_back({{entry_path}, static_cast<size_t>(st.st_size)});
+                } else {
+                    jobs[inserted.first->second].names.push_back(entry_path);
+                }
+            }
+        }
+        closedir(dir);
+    }
+}
+
+bool SecureEraser::eraseFile(EraseState& state, const EraseJob& job, size_t passes) {
+    const std::string& path = job.names.front();
+    int fd = open(path.c_str(), O_WRONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0 && errno == EACCES) {
+        // Read-only files are still ours to destroy, as with unlink
+        struct stat st;
+        if (lstat(path.c_str(), &st) == 0 && chmod(path.c_str(), (st.st_mode & 07777) | S_IWUSR) == 0) {
+            fd = open(path.c_str(), O_WRONLY | O_NOFOLLOW | O_CLOEXEC);
+        }
+    }
+    if (fd < 0) {
+        state.record(path, errno, "Cannot open for overwriting");
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        state.record(path, errno, "Cannot stat");
+        close(fd);
+        return false;
+    }
+    // Names outside the tree would be left on a destroyed, empty file
+    if (st.st_nlink > job.names.size()) {
+        state.record(path, EMLINK, "Not erased: " + std::to_string(st.st_nlink - job.names.size()) +
+                     " other hard link(s) would be left pointing at it");
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+
+    // Data extents, found once: the passes do not change the layout
+    std::vector<std::pair<size_t, size_t>> extents;
+    size_t position = 0;
+    while (position < size) {
+        off_t data = lseek(fd, position, SEEK_DATA);
+        if (data < 0) {
+            if (errno == ENXIO) break;  // only hole up to EOF
+            extents.emplace_back(position, size - position);  // no hole support: all of it
+            break;
+        }
+        if (static_cast<size_t>(data) >= size) break;
+        off_t hole = lseek(fd, data, SEEK_HOLE);
+        size_t end = hole < 0 ? size : std::min(static_cast<size_t>(hole), size);
+        extents.emplace_back(data, end - data);
+        position = end;
+    }
+    size_t extent_bytes = 0;
+    for (const auto& extent : extents) extent_bytes += extent.second;
+    hole_bytes += size - extent_bytes;
+    if (state.progress) state.progress->addBytes((size - extent_bytes) * passes);
+
+    BufferPool::Buffer buffer = BufferPool::shared().acquire(BufferPool::adaptiveSize(extent_bytes, st.st_blksize));
+    if (!buffer) {
+        state.record(path, ENOMEM, "Cannot allocate overwrite buffer");
+        close(fd);
+        return false;
+    }
+
+    bool ok = true;
+    for (size_t pass = 0; ok && pass < passes; pass++) {
+        PatternGenerator pattern;
+        for (size_t i = 0; ok && i < extents.size(); i++) {
+            size_t end = extents[i].first + extents[i].second;
+            for (size_t offset = extents[i].first; ok && offset < end;) {
+                size_t length = std::min(buffer.size(), end - offset);
+                if (throttle) length = throttle->chunkSize(length);
+                pattern.fill(buffer.data(), length);
+                ssize_t written = pwrite(fd, buffer.data(), length, offset);
+                if (written < 0 && errno == EINTR) continue;
+                if (written <= 0) {
+                    if (written == 0) errno = EIO;
+                    ok = false;
+                    break;
+                }
+                offset += written;
+                if (throttle) throttle->acquire(written);
+                if (state.progress) state.progress->addBytes(written);
+            }
+        }
+        ok = ok && fdatasync(fd) == 0;
+    }
+    if (!ok) {
+        state.record(path, errno, "Overwrite failed; file kept");
+        close(fd);
+        return false;
+    }
+
+    // The blocks now hold only the last pattern; keep it out of the page
+    // cache and leave nothing of the length behind either
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ftruncate(fd, 0);
+    close(fd);
+
+    for (const auto& name : job.names) {
+        if (unlink(name.c_str()) != 0 && errno != ENOENT) {
+            state.record(name, errno, "Overwritten but cannot remove");
+            return false;
+        }
+    }
+    data_bytes += extent_bytes;
+    erased_files++;
+    if (state.progress) state.progress->addFiles();
+    return true;
+}
+
+bool SecureEraser::erase(const std::string& path, size_t passes, std::vector<OperationResult>& errors,
+                         ProgressTracker* progress) {
+    erased_files = 0;
+    data_bytes = 0;
+    hole_bytes = 0;
+
+    EraseState state;
+    state.errors = &errors;
+    state.progress = progress;
+
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0) {
+        state.record(path, errno, "Cannot stat");
+        return false;
+    }
+
+    std::vector<EraseJob> jobs;
+    if (S_ISDIR(st.st_mode)) {
+        scanTree(state, path, jobs);
+    } else if (S_ISREG(st.st_mode)) {
+        jobs.push_back({{path}, static_cast<size_t>(st.st_size)});
+    } else {
+        state.record(path, EINVAL, "Not a regular file or directory");
+        return false;
+    }
+
+    if (progress) {
+        // Apparent sizes; holes count as done once a file finds them
+        size_t total_bytes = 0;
+        for (const auto& job : jobs) total_bytes += job.size;
+        progress->addTotals(total_bytes * passes, jobs.size());
+    }
+
+    ThreadPool pool(worker_count);
+    for (const auto& job : jobs) {
+        pool.submit([this, &state, &job, passes]() { eraseFile(state, job, passes); });
+    }
+    pool.wait();
+
+    return errors.empty();
+}
+
+size_t SecureEraser::erasedFiles() const {
+    return erased_files;
+}
+
+size_t SecureEraser::dataBytes() const {
+    return data_bytes;
+}
+
+size_t SecureEraser::holeBytes() const {
+    return hole_bytes;
+}
@@ -0,0 +1,79 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t thread_count) : active_tasks(0), stopping(false) {
+    if (thread_count == 0) {
+        thread_count = defaultThreadCount();
+    }
+
+    workers.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    task_available.notify_all();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            task_available.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+            active_tasks++;
+        }
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            active_tasks--;
+            if (tasks.empty() && active_tasks == 0) {
+                tasks_finished.notify_all();
+            }
+        }
+    }
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        tasks.push_back(std::move(task));
+    }
+    task_available.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    tasks_finished.wait(lock, [this]() { return tasks.empty() && active_tasks == 0; });
+}
+
+bool ThreadPool::waitFor(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    return tasks_finished.wait_for(lock, timeout, [this]() { return tasks.empty() && active_tasks == 0; });
+}
+
+size_t ThreadPool::size() const {
+    return workers.size();
+}
+
+size_t ThreadPool::defaultThreadCount() {
+    // Pool work is mostly filesystem latency, so keep a few threads even on small machines
+    size_t count = std::thread::hardware_concurrency();
+    return std::max<size_t>(count, 4);
+}
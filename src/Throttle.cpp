@@ -0,0 +1,118 @@
+#include "Throttle.h"
+#include <algorithm>
+#include <thread>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// From linux/ioprio.h, which older kernel headers do not ship
+static const int IOPRIO_WHO_PROCESS = 1;
+static const int IOPRIO_CLASS_SHIFT = 13;
+static const int IOPRIO_CLASS_NONE = 0;
+static const int IOPRIO_CLASS_IDLE = 3;
+
+Throttle::Throttle()
+    : limited(false), chunk_bytes(0), last_refill(Clock::now()), waited(0), idle_priority(false), bytes_total(0),
+      ops_total(0), sample_start(Clock::now()), sample_bytes(0), sample_ops(0), bytes_rate(0), ops_rate(0) {
+}
+
+void Throttle::setLimits(size_t bytes_per_second, size_t ops_per_second) {
+    std::lock_guard<std::mutex> lock(mutex);
+    bytes.limit = bytes_per_second;
+    ops.limit = ops_per_second;
+    // Start from an empty bucket so a new limit applies from the first byte
+    bytes.tokens = 0;
+    ops.tokens = 0;
+    last_refill = Clock::now();
+    // Measure afresh too, so rates reflect the new limit
+    sample_start = last_refill;
+    sample_bytes = bytes_total;
+    sample_ops = ops_total;
+    chunk_bytes = bytes_per_second > 0 ? std::max<size_t>(bytes_per_second / 20, 4096) : 0;
+    limited = bytes_per_second > 0 || ops_per_second > 0;
+}
+
+bool Throttle::isLimited() const {
+    return limited;
+}
+
+size_t Throttle::chunkSize(size_t preferred) const {
+    size_t cap = chunk_bytes;
+    return cap == 0 ? preferred : std::min(preferred, cap);
+}
+
+void Throttle::refill(Bucket& bucket, double elapsed) {
+    if (bucket.limit == 0) {
+        return;
+    }
+    double burst = bucket.limit * BURST_SECONDS;
+    // Debt is paid back at the limit rate; only surplus is capped
+    bucket.tokens = std::min(burst, bucket.tokens + bucket.limit * elapsed);
+}
+
+void Throttle::acquire(size_t byte_count, size_t op_count) {
+    bytes_total.fetch_add(byte_count, std::memory_order_relaxed);
+    ops_total.fetch_add(op_count, std::memory_order_relaxed);
+    if (!limited) {
+        return;
+    }
+
+    double wait = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Clock::time_point now = Clock::now();
+        double elapsed = std::chrono::duration<double>(now - last_refill).count();
+        last_refill = now;
+        refill(bytes, elapsed);
+        refill(ops, elapsed);
+
+        if (bytes.limit > 0) {
+            bytes.tokens -= byte_count;
+            wait = std::max(wait, -bytes.tokens / bytes.limit);
+        }
+        if (ops.limit > 0) {
+            ops.tokens -= op_count;
+            wait = std::max(wait, -ops.tokens / ops.limit);
+        }
+        waited += wait;
+    }
+
+    if (wait > 0) {
+        std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+    }
+}
+
+bool Throttle::setIdlePriority(bool idle) {
+    int ioprio = (idle ? IOPRIO_CLASS_IDLE : IOPRIO_CLASS_NONE) << IOPRIO_CLASS_SHIFT;
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio) != 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    idle_priority = idle;
+    return true;
+}
+
+ThrottleStats Throttle::stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    ThrottleStats result;
+    result.bytes_limit = bytes.limit;
+    result.ops_limit = ops.limit;
+    result.bytes_total = bytes_total;
+    result.ops_total = ops_total;
+    result.waited_seconds = waited;
+    result.idle_priority = idle_priority;
+
+    // Rates come from the last full window, so frequent callers see steady
+    // numbers rather than the burstiness of individual charges
+    Clock::time_point now = Clock::now();
+    double elapsed = std::chrono::duration<double>(now - sample_start).count();
+    if (elapsed >= SAMPLE_SECONDS) {
+        bytes_rate = (result.bytes_total - sample_bytes) / elapsed;
+        ops_rate = (result.ops_total - sample_ops) / elapsed;
+        sample_start = now;
+        sample_bytes = result.bytes_total;
+        sample_ops = result.ops_total;
+    }
+    result.bytes_rate = bytes_rate;
+    result.ops_rate = ops_rate;
+    return result;
+}
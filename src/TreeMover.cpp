@@ -0,0 +1,527 @@
+#include "TreeMover.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const char JOURNAL_MAGIC[8] = {'F', 'E', 'M', 'O', 'V', 'J', '0', '1'};
+
+// Journal records: type, path length, offset, path bytes
+static const char RECORD_DONE = 'F';        // copied and durable; source may be unlinked
+static const char RECORD_CHECKPOINT = 'C';  // durable up to offset
+static const size_t RECORD_HEADER = 1 + sizeof(uint32_t) + sizeof(uint64_t);
+
+struct TreeMover::MoveState {
+    std::string source;
+    std::string destination;
+    std::string journal_path;
+    bool source_is_dir = false;
+    int journal_fd = -1;
+    int sync_fd = -1;  // any descriptor on the destination filesystem, for syncfs()
+
+    // Loaded from the journal before any task starts, read-only afterwards
+    std::unordered_set<std::string> done;
+    std::unordered_map<std::string, uint64_t> checkpoints;
+
+    std::mutex mutex;  // journal appends and errors
+    std::vector<OperationResult>* errors;
+    ProgressTracker* progress = nullptr;
+    std::atomic<size_t> moved{0};
+    std::atomic<size_t> resumed{0};
+
+    std::string sourcePath(const std::string& relative) const {
+        return relative.empty() ? source : source + "/" + relative;
+    }
+    std::string destinationPath(const std::string& relative) const {
+        return relative.empty() ? destination : destination + "/" + relative;
+    }
+
+    void record(const std::string& path, int code, const std::string& message) {
+        OperationResult error(false, message + ": " + strerror(code), code);
+        error.path = path;
+        std::lock_guard<std::mutex> lock(mutex);
+        errors->push_back(std::move(error));
+    }
+
+    void addProgress(size_t bytes, size_t files = 0) {
+        if (!progress) return;
+        progress->addBytes(bytes);
+        if (files > 0) progress->addFiles(files);
+    }
+};
+
+TreeMover::TreeMover(const CopyEngine& engine, size_t workers)
+    : copy_engine(engine), worker_count(workers), resumed_files(0), moved_files(0) {
+}
+
+size_t TreeMover::movedFiles() const {
+    return moved_files;
+}
+
+size_t TreeMover::resumedFiles() const {
+    return resumed_files;
+}
+
+std::string TreeMover::journalPath(const std::string& destination) {
+    std::string trimmed = destination;
+    while (trimmed.size() > 1 && trimmed.back() == '/') trimmed.pop_back();
+    size_t slash = trimmed.rfind('/');
+    std::string parent = slash == std::string::npos ? "." : (slash == 0 ? "/" : trimmed.substr(0, slash));
+    std::string name = slash == std::string::npos ? trimmed : trimmed.substr(slash + 1);
+    return (parent == "/" ? "" : parent) + "/." + name + ".move-journal";
+}
+
+// Whether a fresh move may start: like rename(), a directory only replaces
+// an empty directory and nothing is merged into an existing tree
+static int checkFreshDestination(const std::string& destination, bool source_is_dir) {
+    struct stat st;
+    if (lstat(destination.c_str(), &st) != 0) {
+        return errno == ENOENT ? 0 : errno;
+    }
+    if (!source_is_dir) {
+        return S_ISDIR(st.st_mode) ? EISDIR : 0;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        return ENOTDIR;
+    }
+    DIR* dir = opendir(destination.c_str());
+    if (!dir) {
+        return errno;
+    }
+    int err = 0;
+    struct dirent* entry;
+    while (err == 0 && (entry = readdir(dir)) != nullptr) {
+        const char* name = entry->d_name;
+        if (!(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))) {
+            err = ENOTEMPTY;
+        }
+    }
+    closedir(dir);
+    return err;
+}
+
+// Loads an existing journal for this destination, or starts a new one
+bool TreeMover::openJournal(MoveState& state, std::vector<OperationResult>& errors) {
+    int fd = open(state.journal_path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        int err = checkFreshDestination(state.destination, state.source_is_dir);
+        if (err != 0) {
+            errors.emplace_back(false, std::string("Destination exists: ") + strerror(err), err);
+            errors.back().path = state.destination;
+            return false;
+        }
+        fd = open(state.journal_path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        uint32_t length = state.source.size();
+        std::string header(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+        header.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        header += state.source;
+        if (fd < 0 || write(fd, header.data(), header.size()) != static_cast<ssize_t>(header.size())) {
+            errors.emplace_back(false, std::string("Cannot create move journal: ") + strerror(errno), errno);
+            errors.back().path = state.journal_path;
+            if (fd >= 0) close(fd);
+            return false;
+        }
+        state.journal_fd = fd;
+        return true;
+    }
+
+    std::string contents;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        contents.append(buffer, n);
+    }
+
+    // The journal belongs to this destination; it must also belong to this source
+    uint32_t length = 0;
+    size_t position = sizeof(JOURNAL_MAGIC) + sizeof(length);
+    if (contents.size() >= position) {
+        memcpy(&length, contents.data() + sizeof(JOURNAL_MAGIC), sizeof(length));
+    }
+    if (contents.size() < position + length || memcmp(contents.data(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 ||
+        contents.compare(position, length, state.source) != 0) {
+        std::string other = contents.size() >= position + length ? contents.substr(position, length) : "";
+        errors.emplace_back(false, other.empty() ? "Unreadable move journal; remove it to start over"
+                                                 : "Destination has an unfinished move from " + other, EBUSY);
+        errors.back().path = state.journal_path;
+        close(fd);
+        return false;
+    }
+    position += length;
+
+    while (contents.size() - position >= RECORD_HEADER) {
+        char type = contents[position];
+        uint32_t path_length;
+        uint64_t offset;
+        memcpy(&path_length, contents.data() + position + 1, sizeof(path_length));
+        memcpy(&offset, contents.data() + position + 1 + sizeof(path_length), sizeof(offset));
+        if (contents.size() - position - RECORD_HEADER < path_length) {
+            break;
+        }
+        std::string relative = contents.substr(position + RECORD_HEADER, path_length);
+        if (type == RECORD_DONE) {
+            state.done.insert(relative);
+        } else if (type == RECORD_CHECKPOINT) {
+            state.checkpoints[relative] = offset;
+        }
+        position += RECORD_HEADER + path_length;
+    }
+
+    // Drop a record torn by the interruption so new ones append cleanly
+    if (ftruncate(fd, position) != 0 || lseek(fd, 0, SEEK_END) < 0) {
+        errors.emplace_back(false, std::string("Cannot update move journal: ") + strerror(errno), errno);
+        errors.back().path = state.journal_path;
+        close(fd);
+        return false;
+    }
+    state.journal_fd = fd;
+    return true;
+}
+
+bool TreeMover::appendJournal(MoveState& state, char type, const std::string& relative, uint64_t offset) {
+    uint32_t path_length = relative.size();
+    std::string record(1, type);
+    record.append(reinterpret_cast<const char*>(&path_length), sizeof(path_length));
+    record.append(reinterpret_cast<const char*>(&offset), sizeof(offset));
+    record += relative;
+
+    std::lock_guard<std::mutex> lock(state.mutex);
+    off_t end = lseek(state.journal_fd, 0, SEEK_END);
+    for (size_t written = 0; end >= 0 && written < record.size();) {
+        ssize_t n = write(state.journal_fd, record.data() + written, record.size() - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            // Cut a partial record off so the records after it still parse
+            int err = n < 0 ? errno : ENOSPC;
+            if (ftruncate(state.journal_fd, end) == 0) lseek(state.journal_fd, end, SEEK_SET);
+            errno = err;
+            return false;
+        }
+        written += n;
+    }
+    return end >= 0;
+}
+
+// Creates the destination directories up front and lists the files to move
+void TreeMover::scanTree(MoveState& state, const std::string& relative, std::vector<MoveJob>& files,
+                         std::vector<MoveJob>& directories) {
+    std::string path = state.sourcePath(relative);
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        state.record(path, errno, "Cannot open source directory");
+        return;
+    }
+
+    struct stat dir_stat;
+    fstat(dirfd(dir), &dir_stat);
+    std::string destination = state.destinationPath(relative);
+    if (mkdir(destination.c_str(), S_IRWXU) != 0 && errno != EEXIST) {
+        state.record(destination, errno, "Cannot create destination directory");
+        closedir(dir);
+        return;
+    }
+    directories.push_back({relative, 0, dir_stat.st_mode});
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        const char* name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+
+        std::string child = relative.empty() ? name : relative + "/" + name;
+        struct stat st;
+        if (fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            state.record(state.sourcePath(child), errno, "Cannot stat");
+        } else if (S_ISDIR(st.st_mode)) {
+            scanTree(state, child, files, directories);
+        } else if (S_ISREG(st.st_mode) || S_ISLNK(st.st_mode)) {
+            files.push_back({child, S_ISREG(st.st_mode) ? static_cast<size_t>(st.st_size) : 0, st.st_mode});
+        } else {
+            state.record(state.sourcePath(child), ENOTSUP, "Skipped special file");
+        }
+    }
+    closedir(dir);
+}
+
+// Copies one file or symlink from start to the end; durability is up to the caller
+bool TreeMover::copyEntry(MoveState& state, CopyEngine& engine, const MoveJob& job, size_t start) {
+    std::string source = state.sourcePath(job.relative);
+    std::string destination = state.destinationPath(job.relative);
+
+    if (S_ISLNK(job.mode)) {
+        std::vector<char> target(4096);
+        ssize_t length = readlink(source.c_str(), target.data(), target.size() - 1);
+        if (length < 0) {
+            state.record(source, errno, "Cannot read symlink");
+            return false;
+        }
+        target[length] = '\0';
+        if ((unlink(destination.c_str()) != 0 && errno != ENOENT) || symlink(target.data(), destination.c_str()) != 0) {
+            state.record(destination, errno, "Cannot create symlink");
+            return false;
+        }
+        return true;
+    }
+
+    int src_fd = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (src_fd < 0) {
+        state.record(source, errno, "Cannot open source file");
+        return false;
+    }
+    int dst_fd = open(destination.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (start == 0 ? O_TRUNC : 0), 0600);
+    if (dst_fd < 0) {
+        state.record(destination, errno, "Cannot create destination file");
+        close(src_fd);
+        return false;
+    }
+
+    CopyMethod method = CopyMethod::ReadWrite;
+    if (start == 0) {
+        method = engine.copy(src_fd, dst_fd, job.size);
+    } else if (start < job.size) {
+        method = engine.copyRange(src_fd, dst_fd, start, job.size - start);
+    }
+    int err = errno;
+    bool ok = method != CopyMethod::None && fchmod(dst_fd, job.mode & 07777) == 0;
+    if (!ok && method == CopyMethod::None) errno = err;
+    if (!ok) state.record(source, errno, "Copy failed");
+    close(src_fd);
+    close(dst_fd);
+    return ok;
+}
+
+void TreeMover::moveGroup(MoveState& state, const std::vector<const MoveJob*>& group) {
+    CopyEngine engine(copy_engine);
+    std::vector<const MoveJob*> copied;
+    for (const MoveJob* job : group) {
+        if (state.done.count(job->relative)) {
+            copied.push_back(job);  // durable since an earlier run; only the unlink is left
+            state.resumed++;
+        } else if (copyEntry(state, engine, *job, 0)) {
+            copied.push_back(job);
+        }
+    }
+    if (copied.empty()) {
+        return;
+    }
+
+    // One flush makes the whole group's data and directory entries durable
+    if (syncfs(state.sync_fd) != 0) {
+        int err = errno;
+        for (const MoveJob* job : copied) {
+            state.record(state.destinationPath(job->relative), err, "Cannot flush copy; source kept");
+        }
+        return;
+    }
+
+    size_t bytes = 0;
+    size_t moved = 0;
+    for (const MoveJob* job : copied) {
+        // A lost done record only means the copy is redone if the unlink fails too
+        if (!state.done.count(job->relative)) {
+            appendJournal(state, RECORD_DONE, job->relative, 0);
+        }
+        std::string source = state.sourcePath(job->relative);
+        if (unlink(source.c_str()) != 0 && errno != ENOENT) {
+            state.record(source, errno, "Copied but cannot remove source");
+            continue;
+        }
+        state.moved++;
+        moved++;
+        bytes += job->size;
+    }
+    state.addProgress(bytes, moved);
+}
+
+// Copies a large file in checkpointed steps. Each durable step is given up
+// by the source right away (a hole punched into it), so even a single huge
+// file never needs twice its size, and an interrupted move resumes mid-file.
+void TreeMover::moveLarge(MoveState& state, const MoveJob& job) {
+    std::string source = state.sourcePath(job.relative);
+    std::string destination = state.destinationPath(job.relative);
+    CopyEngine engine(copy_engine);
+
+    if (!state.done.count(job.relative)) {
+        // Past a checkpoint the source no longer holds the bytes before it,
+        // so the partial copy is the only one and must still be there
+        size_t start = 0;
+        auto checkpoint = state.checkpoints.find(job.relative);
+        if (checkpoint != state.checkpoints.end()) {
+            struct stat dst_stat;
+            if (stat(destination.c_str(), &dst_stat) != 0 || static_cast<size_t>(dst_stat.st_size) != job.size) {
+                state.record(destination, ENOENT, "Partial copy missing; source kept, remove the journal to retry");
+                return;
+            }
+            start = std::min<size_t>(checkpoint->second, job.size);
+            state.resumed++;
+            state.addProgress(start);
+        }
+
+        // Punching needs write access; without it the move still works, just
+        // with the whole file as overhead. A file with other hard links is
+        // never punched: those names, possibly outside the tree, keep the data
+        // until the final unlink.
+        int src_fd = open(source.c_str(), O_RDWR | O_CLOEXEC);
+        bool punch = src_fd >= 0;
+        if (src_fd < 0) src_fd = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat src_stat;
+        if (punch && (fstat(src_fd, &src_stat) != 0 || src_stat.st_nlink != 1)) {
+            punch = false;
+        }
+        // Where the source stops holding data: an earlier run may have punched
+        // up to its checkpoint
+        size_t punched_to = start;
+        int dst_fd = open(destination.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (start == 0 ? O_TRUNC : 0), 0600);
+        // Full length up front: later steps write into place and a resumed
+        // run can check it against the source
+        bool ok = src_fd >= 0 && dst_fd >= 0 && (start > 0 || ftruncate(dst_fd, job.size) == 0);
+        for (size_t offset = start; ok && offset < job.size; offset += CHECKPOINT_BYTES) {
+            size_t length = std::min(CHECKPOINT_BYTES, job.size - offset);
+            ok = engine.copyRange(src_fd, dst_fd, offset, length) != CopyMethod::None && fdatasync(dst_fd) == 0;
+            if (ok && offset + length < job.size) {
+                // The copy's directory entry and the checkpoint must both be
+                // on disk before the source drops anything
+                ok = (offset != start || syncfs(state.sync_fd) == 0);
+                // Without its checkpoint a resume would start over from a
+                // punched source, so the file stops being punched instead
+                if (ok && !appendJournal(state, RECORD_CHECKPOINT, job.relative, offset + length) && punch) {
+                    state.record(state.journal_path, errno, "Cannot journal checkpoint of " + source +
+                                 "; no longer punching it");
+                    punch = false;
+                }
+                if (ok && punch && fdatasync(state.journal_fd) == 0) {
+                    punch = fallocate(src_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length) == 0;
+                    if (punch) punched_to = offset + length;
+                }
+            }
+            if (ok) state.addProgress(length);
+        }
+        ok = ok && fchmod(dst_fd, job.mode & 07777) == 0 && syncfs(state.sync_fd) == 0;
+        int err = errno;
+        if (src_fd >= 0) close(src_fd);
+        if (dst_fd >= 0) close(dst_fd);
+        if (!ok) {
+            if (punched_to == 0) {
+                state.record(source, err, "Copy failed; source kept");
+            } else {
+                // The copy holds the only data before the checkpoint now
+                state.record(source, err, "Copy failed; source punched out up to byte " + std::to_string(punched_to) +
+                             ", run the move again to resume from " + state.journal_path);
+            }
+            return;
+        }
+        appendJournal(state, RECORD_DONE, job.relative, 0);
+    } else {
+        state.resumed++;
+        state.addProgress(job.size);
+    }
+
+    if (unlink(source.c_str()) != 0 && errno != ENOENT) {
+        state.record(source, errno, "Copied but cannot remove source");
+        return;
+    }
+    state.moved++;
+    state.addProgress(0, 1);
+}
+
+bool TreeMover::move(const std::string& source, const std::string& destination, std::vector<OperationResult>& errors,
+                     ProgressTracker* progress) {
+    resumed_files = 0;
+    moved_files = 0;
+
+    struct stat source_stat;
+    if (lstat(source.c_str(), &source_stat) != 0) {
+        errors.emplace_back(false, std::string("Cannot stat source: ") + strerror(errno), errno);
+        errors.back().path = source;
+        return false;
+    }
+
+    MoveState state;
+    state.source = source;
+    state.destination = destination;
+    state.journal_path = journalPath(destination);
+    state.source_is_dir = S_ISDIR(source_stat.st_mode);
+    state.errors = &errors;
+    state.progress = progress;
+
+    std::string parent = state.journal_path.substr(0, state.journal_path.rfind('/'));
+    state.sync_fd = open(parent.empty() ? "/" : parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (state.sync_fd < 0) {
+        errors.emplace_back(false, std::string("Cannot open destination directory: ") + strerror(errno), errno);
+        errors.back().path = parent;
+        return false;
+    }
+    if (!openJournal(state, errors)) {
+        close(state.sync_fd);
+        return false;
+    }
+
+    std::vector<MoveJob> files;
+    std::vector<MoveJob> directories;
+    if (S_ISDIR(source_stat.st_mode)) {
+        scanTree(state, "", files, directories);
+    } else {
+        files.push_back({"", static_cast<size_t>(source_stat.st_size), source_stat.st_mode});
+    }
+    if (progress) {
+        size_t total_bytes = 0;
+        for (const auto& job : files) {
+            total_bytes += job.size;
+        }
+        progress->addTotals(total_bytes, files.size());
+    }
+
+    {
+        ThreadPool pool(worker_count);
+        std::vector<const MoveJob*> group;
+        size_t group_bytes = 0;
+        auto submitGroup = [&]() {
+            if (group.empty()) return;
+            pool.submit([this, &state, jobs = std::move(group)]() { moveGroup(state, jobs); });
+            group.clear();
+            group_bytes = 0;
+        };
+
+        for (const auto& job : files) {
+            if (job.size >= CHECKPOINT_BYTES) {
+                pool.submit([this, &state, &job]() { moveLarge(state, job); });
+                continue;
+            }
+            group.push_back(&job);
+            group_bytes += job.size;
+            if (group.size() >= GROUP_FILES || group_bytes >= GROUP_BYTES) {
+                submitGroup();
+            }
+        }
+        submitGroup();
+        pool.wait();
+    }
+
+    // Directories last, children before parents: final modes on the copies,
+    // and the source directories go once they are empty
+    bool files_failed = !errors.empty();
+    for (auto it = directories.rbegin(); it != directories.rend(); ++it) {
+        chmod(state.destinationPath(it->relative).c_str(), it->mode & 07777);
+        std::string path = state.sourcePath(it->relative);
+        if (rmdir(path.c_str()) != 0 && errno != ENOENT && !files_failed) {
+            state.record(path, errno, "Cannot remove source directory");
+        }
+    }
+
+    moved_files = state.moved;
+    resumed_files = state.resumed;
+    close(state.journal_fd);
+    close(state.sync_fd);
+
+    // Keep the journal while anything is left, so the next run resumes
+    if (errors.empty()) {
+        unlink(state.journal_path.c_str());
+        return true;
+    }
+    return false;
+}
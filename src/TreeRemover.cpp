@@ -0,0 +1,306 @@
+#include "TreeRemover.h"
+#include "ThreadPool.h"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace {
+
+std::string joinPath(const std::string& dir, const char* name) {
+    if (!dir.empty() && dir.back() == '/') {
+        return dir + name;
+    }
+    return dir + "/" + name;
+}
+
+bool isDotEntry(const char* name) {
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+// d_type when the filesystem provides it, otherwise one fstatat() that does
+// not follow symlinks. Returns DT_UNKNOWN if the entry vanished or is unreadable.
+unsigned char entryType(int dir_fd, const struct dirent* entry) {
+    if (entry->d_type != DT_UNKNOWN) {
+        return entry->d_type;
+    }
+    struct stat st;
+    if (fstatat(dir_fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        return DT_UNKNOWN;
+    }
+    return S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+}
+
+} // namespace
+
+struct TreeRemover::RemoveState {
+    ThreadPool* pool;
+    std::atomic<size_t> live_directories{0};
+    std::mutex errors_mutex;
+    std::vector<OperationResult>* errors;
+    bool root_removed = false;
+
+    void record(const std::string& path, int code, const std::string& message) {
+        OperationResult error(false, message + ": " + strerror(code), code);
+        error.path = path;
+        std::lock_guard<std::mutex> lock(errors_mutex);
+        errors->push_back(std::move(error));
+    }
+};
+
+// A directory removed by a pool task. It stays open until its last
+// subdirectory task finishes, then it is closed and removed from its parent.
+struct TreeRemover::RemoveNode {
+    RemoveNode* parent;
+    std::string name;
+    std::string path;
+    DIR* dir = nullptr;
+    std::atomic<size_t> pending{1};  // own listing plus unfinished subdirectories
+    std::atomic<bool> failed{false};
+};
+
+TreeRemover::TreeRemover(size_t workers) : worker_count(workers), background_busy(false), stopping(false) {
+}
+
+TreeRemover::~TreeRemover() {
+    {
+        std::lock_guard<std::mutex> lock(background_mutex);
+        stopping = true;
+    }
+    background_ready.notify_all();
+    if (background_thread.joinable()) {
+        background_thread.join();
+    }
+}
+
+void TreeRemover::setWorkerCount(size_t count) {
+    worker_count = count;
+}
+
+void TreeRemover::removeNode(RemoveState& state, RemoveNode* node) {
+    int parent_fd = node->parent ? dirfd(node->parent->dir) : AT_FDCWD;
+    int fd = openat(parent_fd, node->name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    node->dir = fd >= 0 ? fdopendir(fd) : nullptr;
+    if (!node->dir) {
+        if (fd >= 0) close(fd);
+        state.record(node->path, errno, "Cannot open directory");
+        node->failed = true;
+        finishNode(state, node);
+        return;
+    }
+
+    int dir_fd = dirfd(node->dir);
+    struct dirent* entry;
+    while ((entry = readdir(node->dir)) != nullptr) {
+        const char* name = entry->d_name;
+        if (isDotEntry(name)) {
+            continue;
+        }
+
+        unsigned char type = entryType(dir_fd, entry);
+        if (type != DT_DIR) {
+            if (unlinkat(dir_fd, name, 0) == 0 || errno == ENOENT) {
+                continue;
+            }
+            if (errno != EISDIR) {
+                state.record(joinPath(node->path, name), errno, "Failed to remove file");
+                node->failed = true;
+                continue;
+            }
+        }
+
+        std::string child_path = joinPath(node->path, name);
+        if (state.live_directories.load(std::memory_order_relaxed) < MAX_OPEN_DIRECTORIES) {
+            RemoveNode* child = new RemoveNode();
+            child->parent = node;
+            child->name = name;
+            child->path = std::move(child_path);
+            state.live_directories++;
+            node->pending++;
+            state.pool->submit([this, &state, child]() { removeNode(state, child); });
+        } else if (!removeSerial(state, dir_fd, name, child_path)) {
+            node->failed = true;
+        }
+    }
+
+    finishNode(state, node);
+}
+
+void TreeRemover::finishNode(RemoveState& state, RemoveNode* node) {
+    // Walk upwards while each finished directory was the last one its parent waited for
+    while (node && node->pending.fetch_sub(1) == 1) {
+        if (node->dir) {
+            closedir(node->dir);
+        }
+
+        RemoveNode* parent = node->parent;
+        bool removed = false;
+        if (!node->failed) {
+            int parent_fd = parent ? dirfd(parent->dir) : AT_FDCWD;
+            if (unlinkat(parent_fd, node->name.c_str(), AT_REMOVEDIR) == 0) {
+                removed = true;
+            } else {
+                state.record(node->path, errno, "Failed to remove directory");
+            }
+        }
+
+        if (parent) {
+            if (!removed) parent->failed = true;
+        } else {
+            state.root_removed = removed;
+        }
+
+        delete node;
+        state.live_directories--;
+        node = parent;
+    }
+}
+
+bool TreeRemover::removeSerial(RemoveState& state, int parent_fd, const char* name, const std::string& path) {
+    int fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR* dir = fd >= 0 ? fdopendir(fd) : nullptr;
+    if (!dir) {
+        if (fd >= 0) close(fd);
+        state.record(path, errno, "Cannot open directory");
+        return false;
+    }
+
+    bool success = true;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        const char* child = entry->d_name;
+        if (isDotEntry(child)) {
+            continue;
+        }
+
+        unsigned char type = entryType(fd, entry);
+        if (type != DT_DIR) {
+            if (unlinkat(fd, child, 0) == 0 || errno == ENOENT) {
+                continue;
+            }
+            if (errno != EISDIR) {
+                state.record(joinPath(path, child), errno, "Failed to remove file");
+                success = false;
+                continue;
+            }
+        }
+
+        if (!removeSerial(state, fd, child, joinPath(path, child))) {
+            success = false;
+        }
+    }
+    closedir(dir);
+
+    if (!success) {
+        return false;
+    }
+    if (unlinkat(parent_fd, name, AT_REMOVEDIR) != 0) {
+        state.record(path, errno, "Failed to remove directory");
+        return false;
+    }
+    return true;
+}
+
+bool TreeRemover::removeTree(const std::string& path, std::vector<OperationResult>& errors) {
+    RemoveState state;
+    state.errors = &errors;
+
+    ThreadPool pool(worker_count);
+    state.pool = &pool;
+
+    RemoveNode* root = new RemoveNode();
+    root->parent = nullptr;
+    root->name = path;
+    root->path = path;
+    state.live_directories++;
+    pool.submit([this, &state, root]() { removeNode(state, root); });
+    pool.wait();
+
+    return state.root_removed;
+}
+
+std::string TreeRemover::removeLater(const std::string& path) {
+    std::string source = path;
+    while (source.size() > 1 && source.back() == '/') {
+        source.pop_back();
+    }
+
+    size_t slash = source.rfind('/');
+    std::string parent = slash == std::string::npos ? "." : source.substr(0, slash == 0 ? 1 : slash);
+    std::string base = slash == std::string::npos ? source : source.substr(slash + 1);
+    if (base.empty() || base == "." || base == ".." || source == "/") {
+        errno = EINVAL;
+        return "";
+    }
+
+    // A hidden sibling is on the same filesystem, so the rename is atomic and instant
+    static std::atomic<unsigned> sequence{0};
+    std::string trash = joinPath(parent, ("." + base + ".deleting-" + std::to_string(getpid()) + "-" +
+                                          std::to_string(sequence++)).c_str());
+    if (::rename(source.c_str(), trash.c_str()) != 0) {
+        return "";
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(background_mutex);
+        background_queue.push_back(trash);
+        if (!background_thread.joinable()) {
+            background_thread = std::thread(&TreeRemover::backgroundLoop, this);
+        }
+    }
+    background_ready.notify_one();
+    return trash;
+}
+
+size_t TreeRemover::pendingCount() {
+    std::lock_guard<std::mutex> lock(background_mutex);
+    return background_queue.size() + (background_busy ? 1 : 0);
+}
+
+void TreeRemover::waitIdle() {
+    std::unique_lock<std::mutex> lock(background_mutex);
+    background_idle.wait(lock, [this]() { return background_queue.empty() && !background_busy; });
+}
+
+void TreeRemover::backgroundLoop() {
+    while (true) {
+        std::string path;
+        {
+            std::unique_lock<std::mutex> lock(background_mutex);
+            background_ready.wait(lock, [this]() { return stopping || !background_queue.empty(); });
+            if (background_queue.empty()) {
+                return;
+            }
+            path = std::move(background_queue.front());
+            background_queue.pop_front();
+            background_busy = true;
+        }
+
+        std::vector<OperationResult> errors;
+        struct stat st;
+        if (lstat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            removeTree(path, errors);
+        } else if (unlink(path.c_str()) != 0 && errno != ENOENT) {
+            OperationResult error(false, std::string("Failed to remove file: ") + strerror(errno), errno);
+            error.path = path;
+            errors.push_back(error);
+        }
+
+        // Nobody is waiting on a background delete, so failures are reported here
+        if (!errors.empty()) {
+            std::cerr << "Background delete of '" << path << "' left " << errors.size() << " error(s), first: "
+                      << errors.front().path << ": " << errors.front().message << std::endl;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(background_mutex);
+            background_busy = false;
+            if (background_queue.empty()) {
+                background_idle.notify_all();
+            }
+        }
+    }
+}
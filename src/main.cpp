@@ -5,6 +5,7 @@
 #include <cstring>
 #include <unistd.h>
 #include <limits>
+#include <fstream>
 #include "FileExplorer.h"
 
 void printUsage() {
@@ -13,6 +14,8 @@ void printUsage() {
     std::cout << "Options:\n";
     std::cout << "  -h, --help     Show this help message\n";
     std::cout << "  -v, --version  Show version information\n";
+    std::cout << "  --batch FILE   Run explorer commands from FILE, one per line\n";
+    std::cout << "  --stdin        Run explorer commands read from standard input\n";
     std::cout << "\nModes:\n";
     std::cout << "  1. File Explorer - Navigate and manage files\n";
     std::cout << "  2. Shell        - Execute commands with piping\n";
@@ -35,6 +38,24 @@ void showMainMenu() {
     std::cout << "Enter your choice (1-5): ";
 }
 
+int runBatchMode(const std::string& script_path, bool from_stdin) {
+    // Nothing is interactive in batch mode, so let iostreams buffer freely
+    std::ios::sync_with_stdio(false);
+    std::cin.tie(nullptr);
+
+    FileExplorer fileExplorer;
+    if (from_stdin) {
+        return fileExplorer.runBatch(std::cin, "<stdin>");
+    }
+
+    std::ifstream script(script_path);
+    if (!script) {
+        std::cerr << "Error: Cannot open batch script: " << script_path << std::endl;
+        return 2;
+    }
+    return fileExplorer.runBatch(script, script_path);
+}
+
 int main(int argc, char* argv[]) {
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -44,6 +65,14 @@ int main(int argc, char* argv[]) {
         } else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--version") == 0) {
             printVersion();
             return 0;
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --batch requires a script file" << std::endl;
+                return 2;
+            }
+            return runBatchMode(argv[i + 1], false);
+        } else if (strcmp(argv[i], "--stdin") == 0) {
+            return runBatchMode("", true);
         }
     }
 